@@ -0,0 +1,29 @@
+#include <string.h>
+
+#include "ap_agg.h"
+
+void ap_agg_add(ap_aggregates_t *agg, const ap_agg_entry_t *e, int delta) {
+    agg->total += delta;
+    agg->auth_counts[e->authmode & 0x0F] += delta;
+    if (e->hidden) agg->hidden_count += delta;
+    if (e->resolved) agg->hidden_resolved_count += delta;
+    if (e->weak) agg->weak_signal_count += delta;
+    if (e->returning) agg->returning_count += delta;
+    if (e->channel >= 1 && e->channel <= 14) agg->channel_counts[e->channel] += delta;
+}
+
+void ap_agg_account(ap_aggregates_t *agg, ap_index_t *ix, int idx,
+                    const ap_agg_entry_t *e, int delta) {
+    bool on = delta > 0;
+
+    ap_agg_add(agg, e, delta);
+    ap_bitmap_set(&ix->live, idx, on);
+    ap_bitmap_set(&ix->auth[e->authmode & 0x0F], idx, on);
+    ap_bitmap_set(&ix->cls[e->classification & 0x07], idx, on);
+    if (e->channel <= 14) ap_bitmap_set(&ix->channel[e->channel], idx, on);
+}
+
+void ap_agg_clear(ap_aggregates_t *agg, ap_index_t *ix) {
+    memset(agg, 0, sizeof(*agg));
+    memset(ix, 0, sizeof(*ix));
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+// Incremental AP table aggregates and secondary indexes.
+//
+// Pure data code with no ESP-IDF dependencies so it can be built and tested
+// on the host (see host_test/). The firmware keeps one ap_aggregates_t and one
+// ap_index_t next to g_aps and calls ap_agg_account() around every mutation of
+// a slot; locking is the caller's business.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef AP_AGG_SLOTS
+#define AP_AGG_SLOTS      512     // must match MAX_APS in main.c
+#endif
+#define AP_AGG_CHANNELS   15      // index 0 unused, 1..14
+#define AP_AGG_AUTHMODES  16
+#define AP_AGG_CLASSES    8
+
+// Running totals over the live entries of the AP table. radio_total and
+// radio_channel_counts are maintained by the firmware's radio grouping, not
+// by ap_agg_account().
+typedef struct {
+    uint32_t total;
+    uint32_t auth_counts[AP_AGG_AUTHMODES];
+    uint32_t hidden_count;
+    uint32_t weak_signal_count;
+    uint32_t channel_counts[AP_AGG_CHANNELS];
+    uint32_t returning_count;           // seen in an earlier session or evicted earlier
+    uint32_t hidden_resolved_count;     // hidden APs whose SSID was sniffed
+    uint32_t radio_total;               // physical radios (see RADIO GROUPS)
+    uint32_t radio_channel_counts[AP_AGG_CHANNELS];
+} ap_aggregates_t;
+
+// One bit per table slot.
+typedef struct {
+    uint32_t w[AP_AGG_SLOTS / 32];
+} ap_bitmap_t;
+
+// Secondary indexes for /api/aps filtering.
+typedef struct {
+    ap_bitmap_t live;
+    ap_bitmap_t channel[AP_AGG_CHANNELS];
+    ap_bitmap_t auth[AP_AGG_AUTHMODES];
+    ap_bitmap_t cls[AP_AGG_CLASSES];
+} ap_index_t;
+
+// The attributes of one AP that the counters and indexes depend on.
+typedef struct {
+    uint8_t authmode;
+    uint8_t channel;
+    uint8_t classification;
+    bool    hidden;         // no SSID in beacons (resolved or not)
+    bool    resolved;       // hidden, but the SSID was sniffed
+    bool    weak;           // below the weak-signal threshold
+    bool    returning;
+} ap_agg_entry_t;
+
+static inline void ap_bitmap_set(ap_bitmap_t *bm, int idx, bool on) {
+    if (on) bm->w[idx >> 5] |= (1u << (idx & 31));
+    else    bm->w[idx >> 5] &= ~(1u << (idx & 31));
+}
+
+static inline bool ap_bitmap_test(const ap_bitmap_t *bm, int idx) {
+    return (bm->w[idx >> 5] >> (idx & 31)) & 1u;
+}
+
+// Lowest clear bit below n, or -1 when all are set. n is a multiple of 32.
+static inline int ap_bitmap_first_clear(const ap_bitmap_t *bm, int n) {
+    for (int i = 0; i < n / 32; i++) {
+        if (bm->w[i] != UINT32_MAX) return i * 32 + __builtin_ctz(~bm->w[i]);
+    }
+    return -1;
+}
+
+// Adds (delta = +1) or removes (delta = -1) one entry from the counters.
+void ap_agg_add(ap_aggregates_t *agg, const ap_agg_entry_t *e, int delta);
+
+// Adds or removes the entry in table slot idx from both the counters and the
+// indexes. Remove the old state before mutating a slot, add the new state
+// afterwards.
+void ap_agg_account(ap_aggregates_t *agg, ap_index_t *ix, int idx,
+                    const ap_agg_entry_t *e, int delta);
+
+// Drops every entry from the counters and indexes (radio counters included).
+void ap_agg_clear(ap_aggregates_t *agg, ap_index_t *ix);
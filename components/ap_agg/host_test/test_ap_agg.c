@@ -0,0 +1,146 @@
+// Randomized cross-check of the incremental aggregates and indexes against a
+// full recompute over a model table. Follows the firmware's usage: account -1
+// before mutating a live slot, +1 afterwards; evict = -1 and mark free; clear
+// wipes everything.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ap_agg.h"
+
+#define ITERATIONS   200000
+#define CHECK_EVERY  97
+
+typedef struct {
+    bool in_use;
+    ap_agg_entry_t e;
+} slot_t;
+
+static slot_t          s_table[AP_AGG_SLOTS];
+static ap_aggregates_t s_agg;
+static ap_index_t      s_ix;
+
+static uint32_t s_rng = 0x9E3779B9u;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static void random_entry(ap_agg_entry_t *e) {
+    e->authmode       = rnd() % AP_AGG_AUTHMODES;
+    e->channel        = rnd() % AP_AGG_CHANNELS;    // 0 = unknown channel
+    e->classification = rnd() % AP_AGG_CLASSES;
+    e->hidden         = (rnd() & 3) == 0;
+    e->resolved       = e->hidden && (rnd() & 1);
+    e->weak           = rnd() & 1;
+    e->returning      = (rnd() & 7) == 0;
+}
+
+static void recompute(ap_aggregates_t *agg, ap_index_t *ix) {
+    memset(agg, 0, sizeof(*agg));
+    memset(ix, 0, sizeof(*ix));
+    for (int i = 0; i < AP_AGG_SLOTS; i++) {
+        if (!s_table[i].in_use) continue;
+        const ap_agg_entry_t *e = &s_table[i].e;
+        agg->total++;
+        agg->auth_counts[e->authmode]++;
+        if (e->hidden) agg->hidden_count++;
+        if (e->resolved) agg->hidden_resolved_count++;
+        if (e->weak) agg->weak_signal_count++;
+        if (e->returning) agg->returning_count++;
+        if (e->channel >= 1) agg->channel_counts[e->channel]++;
+        ap_bitmap_set(&ix->live, i, true);
+        ap_bitmap_set(&ix->auth[e->authmode], i, true);
+        ap_bitmap_set(&ix->cls[e->classification], i, true);
+        ap_bitmap_set(&ix->channel[e->channel], i, true);
+    }
+}
+
+static int check(int iter) {
+    ap_aggregates_t want;
+    ap_index_t want_ix;
+    recompute(&want, &want_ix);
+    if (memcmp(&want, &s_agg, sizeof(want)) != 0) {
+        fprintf(stderr, "iteration %d: counters diverged (total %u, want %u)\n",
+                iter, (unsigned)s_agg.total, (unsigned)want.total);
+        return 1;
+    }
+    if (memcmp(&want_ix, &s_ix, sizeof(want_ix)) != 0) {
+        fprintf(stderr, "iteration %d: indexes diverged\n", iter);
+        return 1;
+    }
+    int want_hole = -1;
+    for (int i = 0; i < AP_AGG_SLOTS && want_hole < 0; i++) {
+        if (!s_table[i].in_use) want_hole = i;
+    }
+    if (ap_bitmap_first_clear(&s_ix.live, AP_AGG_SLOTS) != want_hole) {
+        fprintf(stderr, "iteration %d: first free slot %d, want %d\n", iter,
+                ap_bitmap_first_clear(&s_ix.live, AP_AGG_SLOTS), want_hole);
+        return 1;
+    }
+    return 0;
+}
+
+static int random_slot(bool in_use) {
+    for (int tries = 0; tries < 4 * AP_AGG_SLOTS; tries++) {
+        int i = rnd() % AP_AGG_SLOTS;
+        if (s_table[i].in_use == in_use) return i;
+    }
+    return -1;
+}
+
+int main(void) {
+    unsigned inserts = 0, updates = 0, evicts = 0, clears = 0;
+
+    for (int iter = 0; iter < ITERATIONS; iter++) {
+        uint32_t op = rnd() % 1000;
+
+        if (op < 450) {
+            int i = random_slot(false);
+            if (i < 0) i = random_slot(true);       // full: evict-and-reuse
+            if (i < 0) continue;
+            if (s_table[i].in_use) {
+                ap_agg_account(&s_agg, &s_ix, i, &s_table[i].e, -1);
+                evicts++;
+            }
+            random_entry(&s_table[i].e);
+            s_table[i].in_use = true;
+            ap_agg_account(&s_agg, &s_ix, i, &s_table[i].e, +1);
+            inserts++;
+        } else if (op < 850) {
+            int i = random_slot(true);
+            if (i < 0) continue;
+            ap_agg_entry_t *e = &s_table[i].e;
+            ap_agg_account(&s_agg, &s_ix, i, e, -1);
+            switch (rnd() % 4) {                    // the mutations the firmware makes
+            case 0: e->channel = rnd() % AP_AGG_CHANNELS; break;
+            case 1: e->weak = rnd() & 1; break;
+            case 2: if (e->hidden) e->resolved = true; break;
+            default: random_entry(e); break;
+            }
+            ap_agg_account(&s_agg, &s_ix, i, e, +1);
+            updates++;
+        } else if (op < 998) {
+            int i = random_slot(true);
+            if (i < 0) continue;
+            ap_agg_account(&s_agg, &s_ix, i, &s_table[i].e, -1);
+            s_table[i].in_use = false;
+            evicts++;
+        } else {
+            ap_agg_clear(&s_agg, &s_ix);
+            memset(s_table, 0, sizeof(s_table));
+            clears++;
+        }
+
+        if (iter % CHECK_EVERY == 0 && check(iter)) return 1;
+    }
+    if (check(ITERATIONS)) return 1;
+
+    printf("ok: %u inserts, %u updates, %u evicts, %u clears\n",
+           inserts, updates, evicts, clears);
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <string.h>
+
+#include "ap_snap.h"
+
+uint32_t ap_snap_hash(const uint8_t *buf, size_t len) {
+    if (!len) return 0;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ buf[i]) * 16777619u;
+    return h ? h : 1;
+}
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    put_u16(p, v);
+    put_u16(p + 2, v >> 16);
+}
+
+static uint16_t get_u16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+void ap_snap_begin(ap_snap_writer_t *w, uint8_t *buf, uint8_t *vol, uint32_t now_ms) {
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->vol = vol;
+    w->now_ms = now_ms;
+    vol[0] = 0;
+}
+
+void ap_snap_put(ap_snap_writer_t *w, const ap_snap_entry_t *e) {
+    uint8_t *p = w->buf + w->len;
+    bool same_oui = w->vol[0] > 0 && memcmp(w->oui, e->bssid, 3) == 0;
+    const char *nul = memchr(e->ssid, '\0', 32);
+    size_t ssid_len = nul ? (size_t)(nul - e->ssid) : 32;
+
+    *p++ = (e->slot & AP_SNAP_SLOT_MASK) |
+           (e->returning ? AP_SNAP_F_RETURNING : 0) |
+           (e->resolved ? AP_SNAP_F_RESOLVED : 0) |
+           (same_oui ? AP_SNAP_F_SAME_OUI : 0);
+    memcpy(p, same_oui ? e->bssid + 3 : e->bssid, same_oui ? 3 : 6);
+    p += same_oui ? 3 : 6;
+    memcpy(w->oui, e->bssid, 3);
+
+    *p++ = e->channel;
+    *p++ = e->authmode;
+    put_u32(p, e->caps);                  p += 4;
+    memcpy(p, e->country, 2);             p += 2;
+    put_u16(p, e->beacon_int);            p += 2;
+    put_u32(p, e->first_seen_ms / 1000);  p += 4;
+    *p++ = (uint8_t)ssid_len;
+    memcpy(p, e->ssid, ssid_len);
+    p += ssid_len;
+    w->len = p - w->buf;
+
+    uint32_t age = w->now_ms - e->last_seen_ms;
+    age = (int32_t)age < 0 ? 0 : age / 1000;
+    uint8_t *v = w->vol + ap_snap_vol_size(w->vol);
+    v[0] = e->rssi;
+    v[1] = e->rssi_min;
+    v[2] = e->rssi_max;
+    put_u16(v + 3, e->seen_count);
+    put_u16(v + 5, age > UINT16_MAX ? UINT16_MAX : age);
+    w->vol[0]++;
+}
+
+bool ap_snap_vol_split(const uint8_t *blob, size_t len, const uint8_t **sec, int n) {
+    size_t off = 0;
+    for (int i = 0; i < n; i++) sec[i] = NULL;
+    for (int i = 0; i < n; i++) {
+        if (off >= len || blob[off] > AP_SNAP_CHUNK_SLOTS ||
+            off + ap_snap_vol_size(blob + off) > len) {
+            return false;
+        }
+        sec[i] = blob + off;
+        off += ap_snap_vol_size(blob + off);
+    }
+    return off == len;
+}
+
+void ap_snap_reader_init(ap_snap_reader_t *r, const uint8_t *buf, size_t len,
+                         const uint8_t *vol, uint32_t now_ms) {
+    memset(r, 0, sizeof(*r));
+    r->buf = buf;
+    r->len = len;
+    r->vol = vol;
+    r->now_ms = now_ms;
+}
+
+bool ap_snap_next(ap_snap_reader_t *r, ap_snap_entry_t *e) {
+    if (r->off >= r->len) return false;
+    const uint8_t *p = r->buf + r->off;
+    const uint8_t *end = r->buf + r->len;
+    uint8_t head = *p++;
+    int n = (head & AP_SNAP_F_SAME_OUI) ? 3 : 6;
+    if ((n == 3 && r->index == 0) || end - p < n + AP_SNAP_FIXED_LEN) return false;
+    memcpy(r->bssid + 6 - n, p, n);
+    p += n;
+
+    memset(e, 0, sizeof(*e));
+    e->slot      = head & AP_SNAP_SLOT_MASK;
+    e->returning = (head & AP_SNAP_F_RETURNING) != 0;
+    e->resolved  = (head & AP_SNAP_F_RESOLVED) != 0;
+    memcpy(e->bssid, r->bssid, 6);
+    e->channel       = *p++;
+    e->authmode      = *p++;
+    e->caps          = get_u32(p);            p += 4;
+    memcpy(e->country, p, 2);                 p += 2;
+    e->beacon_int    = get_u16(p);            p += 2;
+    e->first_seen_ms = get_u32(p) * 1000;     p += 4;
+    uint8_t ssid_len = *p++;
+    if (ssid_len > 32 || end - p < ssid_len) return false;
+    memcpy(e->ssid, p, ssid_len);
+    p += ssid_len;
+    r->off = p - r->buf;
+
+    e->rssi = e->rssi_min = e->rssi_max = -100;
+    e->seen_count   = 1;
+    e->last_seen_ms = e->first_seen_ms;
+    if (r->vol && r->index < r->vol[0]) {
+        const uint8_t *v = r->vol + 1 + r->index * AP_SNAP_VOL_LEN;
+        e->rssi       = (int8_t)v[0];
+        e->rssi_min   = (int8_t)v[1];
+        e->rssi_max   = (int8_t)v[2];
+        e->seen_count = get_u16(v + 3);
+        e->last_seen_ms = r->now_ms - (uint32_t)get_u16(v + 5) * 1000;
+        if ((int32_t)(e->last_seen_ms - e->first_seen_ms) < 0) e->last_seen_ms = e->first_seen_ms;
+    }
+    r->index++;
+    return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+// Compact encoding of the AP table for the warm start snapshot.
+//
+// Pure data code with no ESP-IDF dependencies so it can be built and tested
+// on the host (see host_test/). The table is stored a chunk of
+// AP_SNAP_CHUNK_SLOTS slots at a time. Each chunk encodes to two parts: the
+// identity of its APs (BSSID, SSID, channel, auth, caps, flags), which only
+// changes when an AP is inserted, evicted or reconfigured, and a vol section
+// with what changes on every sighting (RSSI, seen count, age). The firmware
+// hashes the first part to decide whether the chunk needs rewriting and
+// keeps the vol sections of all chunks in one small blob; flash and locking
+// are the caller's business.
+//
+// A record is a flag byte (slot within the chunk plus AP_SNAP_F_*), the
+// BSSID (only its last three bytes when the OUI repeats the previous
+// record's), the fixed fields and the SSID. The vol section is a record
+// count followed by that many fixed-size entries in record order.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AP_SNAP_CHUNK_SLOTS   32
+#define AP_SNAP_SLOT_MASK     0x1F
+#define AP_SNAP_F_RETURNING   0x20
+#define AP_SNAP_F_RESOLVED    0x40
+#define AP_SNAP_F_SAME_OUI    0x80    // only bssid[3..5] follow
+
+#define AP_SNAP_FIXED_LEN     15      // channel .. ssid_len
+#define AP_SNAP_REC_MAX       (1 + 6 + AP_SNAP_FIXED_LEN + 32)
+#define AP_SNAP_VOL_LEN       7
+#define AP_SNAP_VOL_SECTION   (1 + AP_SNAP_CHUNK_SLOTS * AP_SNAP_VOL_LEN)
+
+// The persisted attributes of one AP.
+typedef struct {
+    uint8_t  slot;              // within the chunk
+    uint8_t  bssid[6];
+    char     ssid[33];
+    uint8_t  channel;
+    uint8_t  authmode;
+    uint32_t caps;
+    char     country[2];
+    uint16_t beacon_int;
+    uint32_t first_seen_ms;     // stored in seconds
+    bool     returning;
+    bool     resolved;
+
+    // Sighting state, kept in the vol section.
+    int8_t   rssi;
+    int8_t   rssi_min;
+    int8_t   rssi_max;
+    uint16_t seen_count;
+    uint32_t last_seen_ms;      // stored as whole seconds before now_ms
+} ap_snap_entry_t;
+
+typedef struct {
+    uint8_t  *buf;
+    size_t    len;
+    uint8_t  *vol;
+    uint32_t  now_ms;
+    uint8_t   oui[3];
+} ap_snap_writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t         len;
+    size_t         off;
+    const uint8_t *vol;         // NULL if the vol section was lost
+    int            index;
+    uint32_t       now_ms;
+    uint8_t        bssid[6];
+} ap_snap_reader_t;
+
+// FNV-1a; 0 is reserved for an empty chunk.
+uint32_t ap_snap_hash(const uint8_t *buf, size_t len);
+
+// Starts a chunk. buf takes up to AP_SNAP_CHUNK_SLOTS * AP_SNAP_REC_MAX
+// bytes, vol up to AP_SNAP_VOL_SECTION; ages are taken relative to now_ms.
+void ap_snap_begin(ap_snap_writer_t *w, uint8_t *buf, uint8_t *vol, uint32_t now_ms);
+
+// Appends one entry; entries go in ascending slot order.
+void ap_snap_put(ap_snap_writer_t *w, const ap_snap_entry_t *e);
+
+// Size of the vol section starting at vol.
+static inline size_t ap_snap_vol_size(const uint8_t *vol) {
+    return 1 + (size_t)vol[0] * AP_SNAP_VOL_LEN;
+}
+
+// Finds the vol sections of up to n chunks in a vol blob. Returns false if
+// the blob is malformed, leaving the remaining sections NULL.
+bool ap_snap_vol_split(const uint8_t *blob, size_t len, const uint8_t **sec, int n);
+
+void ap_snap_reader_init(ap_snap_reader_t *r, const uint8_t *buf, size_t len,
+                         const uint8_t *vol, uint32_t now_ms);
+
+// Decodes the next entry. Returns false at the end of the chunk or at a
+// malformed record. Entries without vol data come back seen once, at their
+// first sighting, with rssi -100.
+bool ap_snap_next(ap_snap_reader_t *r, ap_snap_entry_t *e);
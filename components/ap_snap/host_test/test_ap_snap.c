@@ -0,0 +1,211 @@
+// Round trip of a random model table through the snapshot encoding, then the
+// firmware's save pattern against it: pack every chunk, compare its hash
+// with the previous save's and count the chunks that would be rewritten. A
+// parked device only re-sees the APs it already has, which must leave every
+// chunk alone; one insert or rename between saves may touch one chunk.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ap_snap.h"
+
+#define SLOTS        512
+#define CHUNKS       (SLOTS / AP_SNAP_CHUNK_SLOTS)
+#define SAVES        200
+#define SIGHTINGS    40      // re-sightings between two saves
+
+typedef struct {
+    bool in_use;
+    ap_snap_entry_t e;
+} slot_t;
+
+static slot_t   s_table[SLOTS];
+static uint32_t s_hash[CHUNKS];
+static uint8_t  s_buf[CHUNKS][AP_SNAP_CHUNK_SLOTS * AP_SNAP_REC_MAX];
+static size_t   s_len[CHUNKS];
+static uint8_t  s_vol[CHUNKS * AP_SNAP_VOL_SECTION];
+static size_t   s_vol_len;
+static uint32_t s_now = 100000;
+
+static uint32_t s_rng = 0x9E3779B9u;
+
+static uint32_t rnd(void) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static void random_entry(ap_snap_entry_t *e, int slot) {
+    memset(e, 0, sizeof(*e));
+    e->slot = slot % AP_SNAP_CHUNK_SLOTS;
+    // A handful of vendors, so OUIs repeat within a chunk.
+    uint32_t oui = rnd() % 4;
+    e->bssid[0] = 0x02;
+    e->bssid[1] = oui;
+    e->bssid[2] = 0x10;
+    e->bssid[3] = slot >> 8;
+    e->bssid[4] = slot;
+    e->bssid[5] = rnd();
+    int n = rnd() % 33;
+    for (int i = 0; i < n; i++) e->ssid[i] = 'a' + rnd() % 26;
+    e->channel       = 1 + rnd() % 14;
+    e->authmode      = rnd() % 9;
+    e->caps          = rnd();
+    e->country[0]    = 'D';
+    e->country[1]    = 'E';
+    e->beacon_int    = 100;
+    e->first_seen_ms = s_now;
+    e->returning     = rnd() & 1;
+    e->resolved      = !n && (rnd() & 1);
+    e->rssi = e->rssi_min = e->rssi_max = -30 - rnd() % 60;
+    e->seen_count    = 1;
+    e->last_seen_ms  = s_now;
+}
+
+static void sight(ap_snap_entry_t *e) {
+    e->rssi = -30 - rnd() % 60;
+    if (e->rssi < e->rssi_min) e->rssi_min = e->rssi;
+    if (e->rssi > e->rssi_max) e->rssi_max = e->rssi;
+    e->seen_count++;
+    e->last_seen_ms = s_now;
+}
+
+// Packs the table like snap_save() and returns how many chunks changed.
+static int save(void) {
+    int changed = 0;
+    s_vol_len = 0;
+    for (int c = 0; c < CHUNKS; c++) {
+        ap_snap_writer_t w;
+        ap_snap_begin(&w, s_buf[c], s_vol + s_vol_len, s_now);
+        for (int i = c * AP_SNAP_CHUNK_SLOTS; i < (c + 1) * AP_SNAP_CHUNK_SLOTS; i++) {
+            if (s_table[i].in_use) ap_snap_put(&w, &s_table[i].e);
+        }
+        s_vol_len += ap_snap_vol_size(s_vol + s_vol_len);
+        s_len[c] = w.len;
+        uint32_t h = ap_snap_hash(s_buf[c], w.len);
+        if (h != s_hash[c]) changed++;
+        s_hash[c] = h;
+    }
+    return changed;
+}
+
+static int same(const ap_snap_entry_t *a, const ap_snap_entry_t *b, bool vol) {
+    if (a->slot != b->slot || memcmp(a->bssid, b->bssid, 6) || strcmp(a->ssid, b->ssid) ||
+        a->channel != b->channel || a->authmode != b->authmode || a->caps != b->caps ||
+        memcmp(a->country, b->country, 2) || a->beacon_int != b->beacon_int ||
+        a->first_seen_ms / 1000 * 1000 != b->first_seen_ms ||
+        a->returning != b->returning || a->resolved != b->resolved) {
+        return 0;
+    }
+    if (!vol) return b->seen_count == 1 && b->rssi == -100 && b->last_seen_ms == b->first_seen_ms;
+    return a->rssi == b->rssi && a->rssi_min == b->rssi_min && a->rssi_max == b->rssi_max &&
+           a->seen_count == b->seen_count && b->last_seen_ms >= a->last_seen_ms &&
+           b->last_seen_ms - a->last_seen_ms < 1000;
+}
+
+// Restores every chunk and compares it with the model table.
+static int restore_check(bool with_vol) {
+    const uint8_t *sec[CHUNKS];
+    if (!ap_snap_vol_split(s_vol, s_vol_len, sec, CHUNKS)) {
+        fprintf(stderr, "vol blob of %zu bytes does not split\n", s_vol_len);
+        return 1;
+    }
+    for (int c = 0; c < CHUNKS; c++) {
+        ap_snap_reader_t r;
+        ap_snap_entry_t e;
+        int i = c * AP_SNAP_CHUNK_SLOTS;
+        ap_snap_reader_init(&r, s_buf[c], s_len[c], with_vol ? sec[c] : NULL, s_now);
+        while (ap_snap_next(&r, &e)) {
+            while (i < SLOTS && !s_table[i].in_use) i++;
+            if (i >= (c + 1) * AP_SNAP_CHUNK_SLOTS || !same(&s_table[i].e, &e, with_vol)) {
+                fprintf(stderr, "chunk %d: record %d does not match slot %d\n", c, r.index, i);
+                return 1;
+            }
+            i++;
+        }
+        if (r.off != s_len[c]) {
+            fprintf(stderr, "chunk %d: stopped at %zu of %zu bytes\n", c, r.off, s_len[c]);
+            return 1;
+        }
+        while (i < (c + 1) * AP_SNAP_CHUNK_SLOTS && !s_table[i].in_use) i++;
+        if (i < (c + 1) * AP_SNAP_CHUNK_SLOTS) {
+            fprintf(stderr, "chunk %d: slot %d missing\n", c, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int random_live_slot(void) {
+    for (;;) {
+        int i = rnd() % SLOTS;
+        if (s_table[i].in_use) return i;
+    }
+}
+
+int main(void) {
+    for (int i = 0; i < SLOTS; i++) {
+        s_table[i].in_use = (rnd() % 8) != 0;
+        random_entry(&s_table[i].e, i);
+    }
+    save();
+    if (restore_check(true) || restore_check(false)) return 1;
+
+    // Parked: only re-sightings.
+    uint32_t vol_hash = ap_snap_hash(s_vol, s_vol_len);
+    for (int s = 0; s < SAVES; s++) {
+        s_now += 60000;
+        for (int k = 0; k < SIGHTINGS; k++) sight(&s_table[random_live_slot()].e);
+        int changed = save();
+        if (changed) {
+            fprintf(stderr, "parked save %d rewrote %d chunks\n", s, changed);
+            return 1;
+        }
+        uint32_t h = ap_snap_hash(s_vol, s_vol_len);
+        if (h == vol_hash) {
+            fprintf(stderr, "parked save %d left the vol blob unchanged\n", s);
+            return 1;
+        }
+        vol_hash = h;
+    }
+    if (restore_check(true)) return 1;
+
+    // Parked with one new AP or one resolved SSID per save.
+    for (int s = 0; s < SAVES; s++) {
+        s_now += 60000;
+        for (int k = 0; k < SIGHTINGS; k++) sight(&s_table[random_live_slot()].e);
+        int i = rnd() % SLOTS;
+        if (!s_table[i].in_use) {
+            s_table[i].in_use = true;
+            random_entry(&s_table[i].e, i);
+        } else {
+            snprintf(s_table[i].e.ssid, sizeof(s_table[i].e.ssid), "resolved-%d", s);
+            s_table[i].e.resolved = true;
+        }
+        int changed = save();
+        if (changed > 1) {
+            fprintf(stderr, "save %d rewrote %d chunks for one change\n", s, changed);
+            return 1;
+        }
+    }
+    if (restore_check(true)) return 1;
+
+    // Truncated chunks stop cleanly.
+    for (size_t cut = 0; cut < s_len[0]; cut++) {
+        ap_snap_reader_t r;
+        ap_snap_entry_t e;
+        ap_snap_reader_init(&r, s_buf[0], cut, NULL, s_now);
+        while (ap_snap_next(&r, &e)) {}
+        if (r.off > cut) {
+            fprintf(stderr, "truncated chunk read past %zu bytes\n", cut);
+            return 1;
+        }
+    }
+
+    size_t raw = 0;
+    for (int c = 0; c < CHUNKS; c++) raw += s_len[c];
+    printf("ok: %d saves, %zu chunk bytes + %zu vol bytes\n", 2 * SAVES, raw, s_vol_len);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <string.h>
+
+#include "captive_dns.h"
+
+int dns_build_response(uint8_t *pkt, int len, int cap, uint32_t our_ip) {
+    if (len < DNS_HEADER_LEN) return -1;
+    if (pkt[2] & 0x80) return -1;                      // already a response
+
+    uint8_t opcode = (pkt[2] >> 3) & 0x0F;
+    uint16_t qdcount = ((uint16_t)pkt[4] << 8) | pkt[5];
+
+    // QR=1, keep opcode and RD, AA=1; RA=1
+    pkt[2] = 0x80 | (pkt[2] & 0x79) | 0x04;
+    pkt[3] = 0x80;
+    memset(pkt + 6, 0, 6);                             // AN/NS/AR counts
+
+    if (opcode != 0 || qdcount == 0) {
+        pkt[3] |= (opcode != 0) ? 4 : 1;               // NOTIMP / FORMERR
+        pkt[4] = pkt[5] = 0;
+        return DNS_HEADER_LEN;
+    }
+
+    int pos = DNS_HEADER_LEN;
+    while (pos < len && pkt[pos] != 0) {
+        uint8_t label = pkt[pos];
+        if ((label & 0xC0) == 0xC0) {                  // compression pointer ends the name
+            pos++;
+            break;
+        }
+        if (label > 63) return -1;
+        pos += label + 1;
+    }
+    pos++;                                             // terminating zero / pointer low byte
+    if (pos + 4 > len) return -1;
+
+    uint16_t qtype  = ((uint16_t)pkt[pos] << 8) | pkt[pos + 1];
+    uint16_t qclass = ((uint16_t)pkt[pos + 2] << 8) | pkt[pos + 3];
+    pos += 4;
+
+    pkt[4] = 0;
+    pkt[5] = 1;
+
+    if ((qtype == DNS_TYPE_A || qtype == DNS_TYPE_ANY) && qclass == DNS_CLASS_IN &&
+        pos + DNS_ANSWER_LEN <= cap) {
+        uint8_t *ans = pkt + pos;
+        ans[0] = 0xC0; ans[1] = 0x0C;                  // name: pointer to question
+        ans[2] = 0x00; ans[3] = DNS_TYPE_A;
+        ans[4] = 0x00; ans[5] = DNS_CLASS_IN;
+        ans[6] = 0x00; ans[7] = 0x00; ans[8] = 0x00; ans[9] = DNS_TTL_SEC;
+        ans[10] = 0x00; ans[11] = 0x04;
+        memcpy(ans + 12, &our_ip, 4);
+        pkt[7] = 1;
+        return pos + DNS_ANSWER_LEN;
+    }
+
+    return pos;
+}
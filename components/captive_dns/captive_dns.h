@@ -0,0 +1,30 @@
+#pragma once
+
+// Captive-portal DNS answer builder.
+//
+// Pure packet code with no ESP-IDF or lwIP dependencies so it can be built
+// and load-tested on the host (see host_test/). The firmware's
+// dns_server_task owns the socket and the counters.
+
+#include <stdint.h>
+
+#define DNS_PORT        53
+#define DNS_MAX_PACKET  512
+#define DNS_HEADER_LEN  12
+#define DNS_ANSWER_LEN  16
+#define DNS_TTL_SEC     60
+#define DNS_TYPE_A      1
+#define DNS_TYPE_ANY    255
+#define DNS_CLASS_IN    1
+
+// Rewrites the query in pkt (len bytes, cap bytes of storage) into our
+// response in place and returns its length, or -1 to drop the packet.
+// Only the first question is answered: A/ANY get our_ip (network byte order),
+// every other type (AAAA, HTTPS, ...) gets an empty NOERROR so clients don't
+// retry. EDNS and other additional records are discarded.
+int dns_build_response(uint8_t *pkt, int len, int cap, uint32_t our_ip);
+
+// Answer count of a response built by dns_build_response (0 or 1).
+static inline int dns_response_answers(const uint8_t *pkt) {
+    return pkt[7];
+}
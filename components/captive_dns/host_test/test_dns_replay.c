@@ -0,0 +1,146 @@
+// Replays connectivity-check query storms through dns_build_response.
+//
+// Every query in the storm file is first checked against its expected answer
+// class, then every truncated prefix of it is fed through to make sure short
+// reads are dropped without touching bytes past the datagram. Finally the
+// whole storm is replayed in a loop, copying each query into a receive-sized
+// buffer as recvfrom would, and the sustained queries/second is reported.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "captive_dns.h"
+
+#define MAX_QUERIES     512
+#define REPLAY_QUERIES  2000000
+
+typedef enum { EXP_A, EXP_EMPTY, EXP_NOTIMP, EXP_FORMERR, EXP_DROP } expect_t;
+
+typedef struct {
+    expect_t expect;
+    int      len;
+    int      line;
+    uint8_t  data[DNS_MAX_PACKET];
+} query_t;
+
+static query_t s_queries[MAX_QUERIES];
+static int     s_count;
+
+static const uint32_t OUR_IP = 0x0104A8C0;          // 192.168.4.1, network order
+
+static int parse_expect(const char *tok, expect_t *out) {
+    static const char *names[] = { "A", "EMPTY", "NOTIMP", "FORMERR", "DROP" };
+    for (int i = 0; i < 5; i++) {
+        if (strcmp(tok, names[i]) == 0) {
+            *out = (expect_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int load_storms(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[2 * DNS_MAX_PACKET + 64];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n') continue;
+        char tok[16], hex[2 * DNS_MAX_PACKET + 1];
+        if (sscanf(line, "%15s %1024s", tok, hex) != 2 || s_count >= MAX_QUERIES) goto bad;
+        query_t *q = &s_queries[s_count];
+        if (parse_expect(tok, &q->expect) < 0 || strlen(hex) % 2) goto bad;
+        q->len = (int)strlen(hex) / 2;
+        q->line = lineno;
+        for (int i = 0; i < q->len; i++) {
+            unsigned b;
+            if (sscanf(hex + 2 * i, "%2x", &b) != 1) goto bad;
+            q->data[i] = (uint8_t)b;
+        }
+        s_count++;
+    }
+    fclose(f);
+    return 0;
+bad:
+    fprintf(stderr, "%s:%d: bad storm line\n", path, lineno);
+    fclose(f);
+    return -1;
+}
+
+static int check_response(const query_t *q, const uint8_t *pkt, int len) {
+    if (q->expect == EXP_DROP) return len == -1 ? 0 : -1;
+    if (len < DNS_HEADER_LEN || len > DNS_MAX_PACKET) return -1;
+    if (pkt[0] != q->data[0] || pkt[1] != q->data[1]) return -1;   // ID kept
+    if (!(pkt[2] & 0x80)) return -1;                                // QR set
+    if (pkt[6] || pkt[8] || pkt[9] || pkt[10] || pkt[11]) return -1;
+
+    uint8_t rcode = pkt[3] & 0x0F;
+    switch (q->expect) {
+    case EXP_NOTIMP:  return (rcode == 4 && len == DNS_HEADER_LEN) ? 0 : -1;
+    case EXP_FORMERR: return (rcode == 1 && len == DNS_HEADER_LEN) ? 0 : -1;
+    case EXP_EMPTY:
+        return (rcode == 0 && pkt[5] == 1 && dns_response_answers(pkt) == 0) ? 0 : -1;
+    case EXP_A:
+        if (rcode != 0 || pkt[5] != 1 || dns_response_answers(pkt) != 1) return -1;
+        return memcmp(pkt + len - 4, &OUR_IP, 4) == 0 ? 0 : -1;
+    default:
+        return -1;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || load_storms(argv[1]) < 0 || s_count == 0) return 1;
+
+    uint8_t pkt[DNS_MAX_PACKET];
+    int failures = 0;
+
+    for (int i = 0; i < s_count; i++) {
+        const query_t *q = &s_queries[i];
+        memcpy(pkt, q->data, q->len);
+        int len = dns_build_response(pkt, q->len, sizeof(pkt), OUR_IP);
+        if (check_response(q, pkt, len) < 0) {
+            fprintf(stderr, "line %d: unexpected response (len %d)\n", q->line, len);
+            failures++;
+        }
+
+        // Truncated datagrams: an exact-size heap copy lets ASan/valgrind
+        // catch any read past the received length.
+        for (int cut = 0; cut < q->len; cut++) {
+            uint8_t *t = malloc(cut ? cut : 1);
+            memcpy(t, q->data, cut);
+            int tl = dns_build_response(t, cut, cut, OUR_IP);
+            if (tl > cut) {
+                fprintf(stderr, "line %d: %d-byte prefix produced %d bytes\n",
+                        q->line, cut, tl);
+                failures++;
+            }
+            free(t);
+        }
+    }
+    if (failures) return 1;
+
+    struct timespec t0, t1;
+    unsigned answered = 0, empty = 0, dropped = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int n = 0; n < REPLAY_QUERIES; n++) {
+        const query_t *q = &s_queries[n % s_count];
+        memcpy(pkt, q->data, q->len);
+        int len = dns_build_response(pkt, q->len, sizeof(pkt), OUR_IP);
+        if (len < 0) dropped++;
+        else if (dns_response_answers(pkt)) answered++;
+        else empty++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%d storm queries, %d replayed in %.3f s: %.0f queries/s "
+           "(%u answered, %u empty, %u dropped)\n",
+           s_count, REPLAY_QUERIES, sec, REPLAY_QUERIES / sec, answered, empty, dropped);
+    return 0;
+}
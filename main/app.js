@@ -83,6 +83,8 @@ const GeoTracker = {
             const resp = await fetch('/api/gps/network');
             if (!resp.ok) throw new Error(`HTTP ${resp.status}`);
             const data = await resp.json();
+            // 202: the device is still resolving; keep whatever we had.
+            if (data.pending) return this.lastLocation || null;
 
             const lat = data.latitude || data.lat;
             const lon = data.longitude || data.lon;
@@ -94,7 +96,7 @@ const GeoTracker = {
                 lat,
                 lon,
                 accuracy: data.accuracy || 5000,
-                timestamp: Date.now(),
+                timestamp: Date.now() - (data.age_ms || 0),
                 source: 'network'
             };
             if (!silent) {
@@ -143,6 +145,8 @@ const GeoTracker = {
                         lat: pos.coords.latitude,
                         lon: pos.coords.longitude,
                         accuracy: pos.coords.accuracy,
+                        speed: pos.coords.speed,
+                        heading: pos.coords.heading,
                         timestamp: pos.timestamp || Date.now()
                     };
                     if (!silent) {
@@ -207,6 +211,8 @@ const GeoTracker = {
                     lat: pos.coords.latitude,
                     lon: pos.coords.longitude,
                     accuracy: pos.coords.accuracy,
+                    speed: pos.coords.speed,
+                    heading: pos.coords.heading,
                     timestamp: pos.timestamp || Date.now()
                 };
                 updateGpsStatus(this.lastLocation);
@@ -236,47 +242,219 @@ const GeoTracker = {
     }
 };
 
-const ClientDataStore = {
-    mergeAps: function(newAps, location) {
-        const stored = StorageManager.getLocalAps();
-        const apMap = new Map(stored.map(ap => [ap.bssid, ap]));
-
-        newAps.forEach(ap => {
-            const existing = apMap.get(ap.bssid) || {};
-            const merged = {
-                ...existing,
-                ...ap
-            };
+// Merging and JSON (de)serialization of the AP store run in a worker, so the
+// 2 s poll never parses or stringifies the whole store on the main thread.
+// The worker owns the authoritative map and answers each merge with just the
+// records it changed; the page keeps a mirror of them for rendering and
+// export. Workers cannot reach localStorage, so the worker serializes and the
+// page writes, batched every PERSIST_INTERVAL_MS and when the page is hidden.
+// apStoreCore is shipped to the worker as source and doubles as the
+// main-thread fallback where workers are unavailable.
+function apStoreCore(port) {
+    const aps = new Map();
+    let lastLocation = null;
+
+    const mergeOne = (ap, location) => {
+        const existing = aps.get(ap.bssid) || {};
+        const merged = {
+            ...existing,
+            ...ap
+        };
 
-            merged.seen = Math.max(existing.seen || 0, ap.seen || 0);
+        merged.seen = Math.max(existing.seen || 0, ap.seen || 0);
 
-            if (existing.first_seen && ap.first_seen) {
-                merged.first_seen = Math.min(existing.first_seen, ap.first_seen);
+        if (existing.first_seen && ap.first_seen) {
+            merged.first_seen = Math.min(existing.first_seen, ap.first_seen);
+        }
+
+        if (location) {
+            const shouldUpdateLocation = !existing.location ||
+                (location.timestamp && location.timestamp > (existing.location.timestamp || 0));
+            if (shouldUpdateLocation) {
+                merged.location = { ...location };
             }
+        }
 
-            if (location) {
-                const shouldUpdateLocation = !existing.location ||
-                    (location.timestamp && location.timestamp > (existing.location.timestamp || 0));
-                if (shouldUpdateLocation) {
-                    merged.location = { ...location };
+        aps.set(ap.bssid, merged);
+        return merged;
+    };
+
+    port.onmessage = ({ data: msg }) => {
+        switch (msg.type) {
+            case 'load': {
+                let list = [];
+                try {
+                    list = msg.raw ? JSON.parse(msg.raw) : [];
+                } catch (e) {
+                    list = [];
                 }
+                list.forEach(ap => aps.set(ap.bssid, ap));
+                port.postMessage({ type: 'loaded', id: msg.id, aps: list });
+                break;
             }
+            case 'merge': {
+                if (msg.location) lastLocation = msg.location;
+                const changed = msg.aps.map(ap => mergeOne(ap, msg.location));
+                port.postMessage({ type: 'merged', id: msg.id, aps: changed });
+                break;
+            }
+            case 'persist': {
+                const list = Array.from(aps.values());
+                port.postMessage({
+                    type: 'persist',
+                    id: msg.id,
+                    localAps: JSON.stringify(list),
+                    currentScan: JSON.stringify({
+                        timestamp: Date.now(),
+                        date: new Date().toISOString(),
+                        apCount: list.length,
+                        aps: list,
+                        metadata: { location: lastLocation }
+                    })
+                });
+                break;
+            }
+            case 'clear':
+                aps.clear();
+                lastLocation = null;
+                port.postMessage({ type: 'cleared', id: msg.id });
+                break;
+        }
+    };
+}
+
+// Same message interface as a Worker, running apStoreCore on this thread.
+function inlineStorePort() {
+    const page = { onmessage: null };
+    const core = {
+        onmessage: null,
+        postMessage: msg => setTimeout(() => page.onmessage && page.onmessage({ data: msg }))
+    };
+    page.postMessage = msg => setTimeout(() => core.onmessage({ data: msg }));
+    apStoreCore(core);
+    return page;
+}
 
-            apMap.set(ap.bssid, merged);
+const ClientDataStore = {
+    PERSIST_INTERVAL_MS: 15000,
+    aps: new Map(),         // mirror of the worker's records, by BSSID
+    location: null,
+    updatedAt: 0,
+    dirty: false,
+    port: null,
+    ready: null,
+    pending: new Map(),
+    nextId: 1,
+    clearedBefore: 0,       // replies to requests older than a clear are stale
+
+    init: function() {
+        try {
+            const src = `(${apStoreCore.toString()})(self);`;
+            const url = URL.createObjectURL(new Blob([src], { type: 'text/javascript' }));
+            this.port = new Worker(url);
+            this.port.onerror = e => {
+                // e.g. blob: workers blocked; replay what is in flight inline
+                console.warn('AP store worker failed, merging on the main thread', e);
+                this.attach(inlineStorePort());
+                this.pending.forEach(({ msg }) => this.port.postMessage(msg));
+            };
+        } catch (e) {
+            console.warn('AP store worker unavailable, merging on the main thread', e);
+            this.port = inlineStorePort();
+        }
+        this.attach(this.port);
+
+        this.ready = this.request({ type: 'load', raw: localStorage.getItem(StorageManager.LOCAL_APS_KEY) });
+
+        setInterval(() => this.persist(), this.PERSIST_INTERVAL_MS);
+        document.addEventListener('visibilitychange', () => {
+            if (document.visibilityState === 'hidden') this.persist();
         });
+        // The worker cannot answer once the page is going away
+        window.addEventListener('pagehide', () => this.persistNow());
+    },
+
+    attach: function(port) {
+        this.port = port;
+        port.onmessage = ({ data }) => this.onMessage(data);
+    },
 
-        const mergedList = Array.from(apMap.values());
-        StorageManager.saveLocalAps(mergedList);
-        StorageManager.saveCurrentScan(mergedList, { location });
-        return mergedList;
+    request: function(msg) {
+        const id = this.nextId++;
+        return new Promise(resolve => {
+            const sent = { ...msg, id };
+            this.pending.set(id, { resolve, msg: sent });
+            this.port.postMessage(sent);
+        });
+    },
+
+    onMessage: function(msg) {
+        const stale = msg.id < this.clearedBefore;
+        if ((msg.type === 'loaded' || msg.type === 'merged') && !stale) {
+            msg.aps.forEach(ap => this.aps.set(ap.bssid, ap));
+        } else if (msg.type === 'persist' && !stale) {
+            try {
+                localStorage.setItem(StorageManager.LOCAL_APS_KEY, msg.localAps);
+                localStorage.setItem(StorageManager.CURRENT_SCAN_KEY, msg.currentScan);
+            } catch (e) {
+                console.warn('AP store persist failed', e);
+                this.dirty = true;
+            }
+        }
+        const req = this.pending.get(msg.id);
+        if (req) {
+            this.pending.delete(msg.id);
+            req.resolve(msg);
+        }
+    },
+
+    // Folds a delta into the store; resolves to the full merged list.
+    mergeAps: async function(newAps, location) {
+        await this.ready;
+        await this.request({ type: 'merge', aps: newAps, location });
+        if (location) this.location = location;
+        if (newAps.length) this.dirty = true;
+        this.updatedAt = Date.now();
+        return this.list();
+    },
+
+    list: function() {
+        return Array.from(this.aps.values());
+    },
+
+    summary: function() {
+        return { timestamp: this.updatedAt, apCount: this.aps.size, location: this.location };
+    },
+
+    // Batched write through the worker; a no-op when nothing changed.
+    persist: function() {
+        if (!this.dirty) return Promise.resolve();
+        this.dirty = false;
+        return this.request({ type: 'persist' });
+    },
+
+    // Synchronous write from the mirror, for unload and explicit saves.
+    persistNow: function() {
+        if (!this.dirty) return;
+        this.dirty = false;
+        const list = this.list();
+        StorageManager.saveLocalAps(list);
+        StorageManager.saveCurrentScan(list, { location: this.location });
     },
 
     clear: function() {
+        this.aps.clear();
+        this.location = null;
+        this.dirty = false;
+        this.clearedBefore = this.nextId;
+        this.port.postMessage({ type: 'clear' });
         StorageManager.saveLocalAps([]);
         StorageManager.saveCurrentScan([], {});
     }
 };
 
+ClientDataStore.init();
+
 // ===== EXPORT MANAGER =====
 const ExportManager = {
     toCSV: function(aps, filename = 'wardrive_export.csv') {
@@ -472,6 +650,7 @@ document.getElementById("btnClear").onclick = async () => {
 
 document.getElementById("btnSaveCurrentScan").onclick = () => {
     const name = prompt("Enter a name for this scan:", `Scan ${new Date().toLocaleString()}`);
+    ClientDataStore.persistNow();
     if (name && StorageManager.saveToHistory(name)) {
         log(document.getElementById("log"), "✓ SCAN SAVED TO HISTORY");
         updateExportTab();
@@ -531,15 +710,19 @@ function renderWifiScan(results = []) {
         });
 }
 
+function renderWifiStatus(data) {
+    if (!wifiStatusText) return;
+    const status = data.connected ? 'Connected' : 'Not connected';
+    const detail = data.ssid ? `SSID: ${data.ssid}` : 'SSID: —';
+    const ip = data.ip ? `IP: ${data.ip}` : '';
+    wifiStatusText.textContent = `${status} • ${detail} ${ip}`.trim();
+}
+
 async function refreshWifiStatus() {
     if (!wifiStatusText) return;
     try {
         const res = await fetch('/api/wifi/status');
-        const data = await res.json();
-        const status = data.connected ? 'Connected' : 'Not connected';
-        const detail = data.ssid ? `SSID: ${data.ssid}` : 'SSID: —';
-        const ip = data.ip ? `IP: ${data.ip}` : '';
-        wifiStatusText.textContent = `${status} • ${detail} ${ip}`.trim();
+        renderWifiStatus(await res.json());
     } catch (err) {
         wifiStatusText.textContent = 'WiFi status unavailable';
     }
@@ -580,60 +763,232 @@ document.getElementById('btnWifiConnect')?.addEventListener('click', async () =>
     }
 });
 
+// ===== AP API =====
+// /api/aps is paged server-side; follow X-Next-Cursor until the device has
+// returned every record matching the filters.
+async function fetchAps(params = {}, cursor = null) {
+    const aps = [];
+    do {
+        const query = new URLSearchParams({ ...params, limit: 100 });
+        if (cursor) query.set('cursor', cursor);
+        const res = await fetch(`/api/aps?${query}`);
+        aps.push(...await res.json());
+        cursor = res.headers.get('X-Next-Cursor');
+    } while (cursor);
+    return aps;
+}
+
 // ===== DASHBOARD UPDATE =====
-function renderDashboardTable(aps) {
-    const tbody = document.getElementById("dashApList");
-    tbody.innerHTML = "";
+// Keyed, windowed rendering of the live feed. Rows are cached by BSSID and
+// only cells whose content changed are rewritten; only the rows inside the
+// scroll viewport (plus OVERSCAN either side) are attached, with spacer rows
+// standing in for the rest. One delegated listener handles row clicks.
+const DashboardTable = {
+    OVERSCAN: 8,
+    COLUMNS: 9,
+    rowHeight: 46,          // refined from rendered rows
+    rows: new Map(),        // BSSID -> cached <tr>
+    data: [],
+    scheduled: false,
+
+    init: function() {
+        this.tbody = document.getElementById("dashApList");
+        this.scroller = this.tbody.closest('.table-wrapper');
+        this.topPad = this.spacer();
+        this.bottomPad = this.spacer();
+
+        this.scroller.addEventListener('scroll', () => this.schedule(), { passive: true });
+        window.addEventListener('resize', () => this.schedule());
+        this.tbody.addEventListener('click', e => {
+            const tr = e.target.closest('tr[data-bssid]');
+            if (tr) prefillInjectorTarget(tr.dataset.bssid, tr.ap ? tr.ap.ssid : '');
+        });
+    },
 
-    if (aps.length === 0) {
-        tbody.innerHTML = '<tr class="no-data"><td colspan="9">No networks detected yet...</td></tr>';
-        return;
+    spacer: function() {
+        const tr = document.createElement('tr');
+        tr.className = 'spacer-row';
+        const td = document.createElement('td');
+        td.colSpan = this.COLUMNS;
+        tr.appendChild(td);
+        return tr;
+    },
+
+    setData: function(aps) {
+        // Stable order so equal-signal rows do not swap places every poll
+        aps.sort((a, b) => (b.rssi - a.rssi) || (a.bssid < b.bssid ? -1 : a.bssid > b.bssid ? 1 : 0));
+        this.data = aps;
+        if (this.rows.size > aps.length) {
+            const live = new Set(aps.map(ap => ap.bssid));
+            for (const bssid of this.rows.keys()) {
+                if (!live.has(bssid)) this.rows.delete(bssid);
+            }
+        }
+        this.render();
+    },
+
+    schedule: function() {
+        if (this.scheduled) return;
+        this.scheduled = true;
+        requestAnimationFrame(() => {
+            this.scheduled = false;
+            this.render();
+        });
+    },
+
+    render: function() {
+        const aps = this.data;
+        if (aps.length === 0) {
+            this.rows.clear();
+            this.tbody.innerHTML = `<tr class="no-data"><td colspan="${this.COLUMNS}">No networks detected yet...</td></tr>`;
+            return;
+        }
+
+        const viewport = this.scroller.clientHeight || window.innerHeight;
+        const scrollTop = this.scroller.scrollTop;
+        const visible = Math.ceil(viewport / this.rowHeight);
+        // The list may have shrunk below a scroll position the browser has
+        // not clamped yet
+        let start = Math.min(Math.floor(scrollTop / this.rowHeight), aps.length - visible);
+        start = Math.max(0, start - this.OVERSCAN);
+        start -= start % 2;     // keeps the :nth-child striping from flickering
+        const end = Math.min(aps.length, Math.ceil((scrollTop + viewport) / this.rowHeight) + this.OVERSCAN);
+
+        const wanted = [this.topPad];
+        for (let i = start; i < end; i++) wanted.push(this.row(aps[i]));
+        wanted.push(this.bottomPad);
+        this.topPad.firstChild.style.height = `${start * this.rowHeight}px`;
+        this.bottomPad.firstChild.style.height = `${(aps.length - end) * this.rowHeight}px`;
+
+        // Reconcile in place so rows that stay in view are not re-attached
+        let cursor = this.tbody.firstChild;
+        for (const el of wanted) {
+            if (el === cursor) {
+                cursor = cursor.nextSibling;
+            } else {
+                this.tbody.insertBefore(el, cursor);
+            }
+        }
+        while (cursor) {
+            const next = cursor.nextSibling;
+            this.tbody.removeChild(cursor);
+            cursor = next;
+        }
+
+        if (end > start) {
+            const measured = (this.bottomPad.offsetTop - wanted[1].offsetTop) / (end - start);
+            if (measured > 0 && Math.abs(measured - this.rowHeight) > 1) {
+                this.rowHeight = measured;
+                this.schedule();
+            }
+        }
+    },
+
+    row: function(ap) {
+        let tr = this.rows.get(ap.bssid);
+        if (!tr) {
+            tr = document.createElement('tr');
+            tr.className = 'clickable-row';
+            tr.dataset.bssid = ap.bssid;
+            for (let i = 0; i < this.COLUMNS; i++) tr.appendChild(document.createElement('td'));
+            tr.cells[1].style.cssText = 'font-family: monospace; font-size: 0.8em;';
+            tr.cells[1].textContent = ap.bssid;
+            tr.cells[6].style.fontSize = '0.85em';
+            this.rows.set(ap.bssid, tr);
+        }
+        tr.ap = ap;
+
+        this.cell(tr.cells[0], `<strong>${ap.ssid}</strong>${ap.ssid_resolved ? ' <span class="status-old" title="Hidden network, name seen in sniffed frames">(hidden)</span>' : ''}${ap.returning ? ' <span class="status-old" title="Seen on an earlier run">&#8634;</span>' : ''}`);
+        this.cell(tr.cells[2], `${ap.rssi} dBm`, getSignalClass(ap.rssi));
+        this.cell(tr.cells[3], `${ap.channel}`);
+        this.cell(tr.cells[4], getSecurityBadge(ap.auth_str));
+        this.cell(tr.cells[5], `${ap.seen}`);
+        this.cell(tr.cells[6], formatLastSeen(ap.age_ms));
+        this.cell(tr.cells[7], formatCoords(ap.location));
+        this.cell(tr.cells[8], getStatusText(ap.age_ms), getStatusClass(ap.age_ms));
+        return tr;
+    },
+
+    cell: function(td, html, cls = '') {
+        if (td.html !== html) {
+            td.innerHTML = html;
+            td.html = html;
+        }
+        if (td.className !== cls) td.className = cls;
     }
+};
 
-    aps.sort((a, b) => b.rssi - a.rssi);
+DashboardTable.init();
 
-    aps.forEach(ap => {
-        const tr = document.createElement("tr");
-        const signalClass = getSignalClass(ap.rssi);
-        const statusClass = getStatusClass(ap.age_ms);
+function renderDashboardTable(aps) {
+    DashboardTable.setData(aps);
+}
 
-        tr.innerHTML = `
-            <td><strong>${ap.ssid}</strong></td>
-            <td style="font-family: monospace; font-size: 0.8em;">${ap.bssid}</td>
-            <td class="${signalClass}">${ap.rssi} dBm</td>
-            <td>${ap.channel}</td>
-            <td>${getSecurityBadge(ap.auth_str)}</td>
-            <td>${ap.seen}</td>
-            <td style="font-size: 0.85em;">${formatLastSeen(ap.age_ms)}</td>
-            <td>${formatCoords(ap.location)}</td>
-            <td class="${statusClass}">${getStatusText(ap.age_ms)}</td>
-        `;
-        tr.classList.add('clickable-row');
-        tr.addEventListener('click', () => prefillInjectorTarget(ap.bssid, ap.ssid));
-        tbody.appendChild(tr);
-    });
+// Latest phone fix for the device's coverage grid and scan cadence,
+// piggybacked on the poll. Speed (m/s) and heading are sent when the
+// browser reports them; otherwise the device derives speed itself.
+function fixParam(loc) {
+    if (!loc || typeof loc.lat !== 'number' || typeof loc.lon !== 'number') return '';
+    const age = Math.max(0, Date.now() - (loc.timestamp || Date.now()));
+    let param = `&lat=${loc.lat.toFixed(7)}&lon=${loc.lon.toFixed(7)}` +
+        `&acc=${Math.round(loc.accuracy || 9999)}&fix_age_ms=${age}`;
+    if (Number.isFinite(loc.speed)) param += `&speed=${loc.speed.toFixed(1)}`;
+    if (Number.isFinite(loc.heading)) param += `&heading=${Math.round(loc.heading) % 360}`;
+    return param;
 }
 
+// Delta sync state for /api/dashboard: newest "modified" we hold (a sighting
+// or an in-place change such as a resolved hidden SSID), plus the
+// device's table generation and clock so a clear or reboot forces a resync.
+// lastRtt is reported back on the next poll so the device can compare UI
+// latency between scan modes.
+const DashboardSync = { since: 0, gen: null, serverNow: 0, lastRtt: 0 };
+
 async function updateDashboard() {
     try {
         const locationPromise = GeoTracker.watchId !== null
             ? Promise.resolve(GeoTracker.lastLocation)
             : GeoTracker.getPosition({ silent: true });
 
-        // Fetch APs
-        const apsRes = await fetch("/api/aps");
-        const aps = await apsRes.json();
+        // State, uplink and AP delta in one request
+        const rttParam = DashboardSync.lastRtt ? `&rtt_ms=${DashboardSync.lastRtt}` : '';
+        const started = performance.now();
+        const dashRes = await fetch(`/api/dashboard?since=${DashboardSync.since}${rttParam}${fixParam(GeoTracker.lastLocation)}`);
+        const dash = await dashRes.json();
+        DashboardSync.lastRtt = Math.max(1, Math.round(performance.now() - started));
+
+        if (DashboardSync.since &&
+            (dash.gen !== DashboardSync.gen || dash.now_ms < DashboardSync.serverNow)) {
+            DashboardSync.since = 0;
+            DashboardSync.gen = dash.gen;
+            DashboardSync.serverNow = 0;
+            return updateDashboard();
+        }
+
+        let aps = dash.aps;
+        if (dash.next) {
+            aps = aps.concat(await fetchAps({ since: DashboardSync.since, sort: 'last_seen' }, dash.next));
+        }
+        DashboardSync.gen = dash.gen;
+        DashboardSync.serverNow = dash.now_ms;
+        aps.forEach(ap => {
+            if (ap.modified > DashboardSync.since) DashboardSync.since = ap.modified;
+        });
 
         // Merge with local cache and attach GPS
         const latestLocation = await locationPromise;
-        const mergedAps = ClientDataStore.mergeAps(aps, latestLocation);
+        const mergedAps = await ClientDataStore.mergeAps(aps, latestLocation);
         updateGpsStatus(latestLocation);
 
-        // Fetch state
-        const stateRes = await fetch("/api/state");
-        const state = await stateRes.json();
+        // Cached rows only change age between deltas
+        mergedAps.forEach(ap => {
+            if (typeof ap.last_seen === 'number' && ap.last_seen <= dash.now_ms) {
+                ap.age_ms = dash.now_ms - ap.last_seen;
+            }
+        });
 
-        await refreshWifiStatus();
+        const state = dash.state;
+        renderWifiStatus(dash.wifi);
 
         // Update stats
         document.getElementById("apCount").textContent = mergedAps.length;
@@ -672,14 +1027,13 @@ async function updateDashboard() {
                  heapUsagePercent < 75 ? 'heap-warn' : 'heap-critical');
         }
         
-        renderDashboardTable([...mergedAps]);
-        updateExportTab();
+        renderDashboardTable(mergedAps);
     } catch(e) {
         console.error("Dashboard update error:", e);
-        const cached = StorageManager.getLocalAps();
+        const cached = ClientDataStore.list();
         document.getElementById("apCount").textContent = cached.length;
         updateGpsStatus(GeoTracker.lastLocation);
-        renderDashboardTable([...cached]);
+        renderDashboardTable(cached);
     }
 }
 
@@ -739,7 +1093,12 @@ setInterval(async () => {
     }
 }, 2000);
 
-setInterval(updateHandshakePanel, 5000);
+// The dashboard payload already carries handshake state
+setInterval(() => {
+    if (!document.getElementById("dashboard").classList.contains("active")) {
+        updateHandshakePanel();
+    }
+}, 5000);
 
 // Initial update
 updateDashboard();
@@ -747,14 +1106,14 @@ updateHandshakePanel();
 
 // ===== EXPORT TAB FUNCTIONALITY =====
 function updateExportTab() {
-    const currentScan = StorageManager.getCurrentScan();
+    const currentScan = ClientDataStore.aps.size ? ClientDataStore.summary() : null;
     const savedScans = StorageManager.getSavedScans();
     
     // Update current scan info
     const currentInfo = document.getElementById("currentScanInfo");
     if (currentScan) {
-        const locationText = currentScan.metadata && currentScan.metadata.location
-            ? formatCoords(currentScan.metadata.location)
+        const locationText = currentScan.location
+            ? formatCoords(currentScan.location)
             : 'No lock';
         currentInfo.innerHTML = `
             <div class="scan-info">
@@ -801,9 +1160,9 @@ function updateExportTab() {
 
 // Export button handlers
 document.getElementById("btnExportCurrentCSV").onclick = () => {
-    const scan = StorageManager.getCurrentScan();
-    if (scan) {
-        ExportManager.toCSV(scan.aps, `wardrive_current_${Date.now()}.csv`);
+    const aps = ClientDataStore.list();
+    if (aps.length) {
+        ExportManager.toCSV(aps, `wardrive_current_${Date.now()}.csv`);
         log(document.getElementById("log"), "✓ EXPORTED CURRENT SCAN AS CSV");
     } else {
         alert("No current scan data to export");
@@ -811,9 +1170,9 @@ document.getElementById("btnExportCurrentCSV").onclick = () => {
 };
 
 document.getElementById("btnExportCurrentJSON").onclick = () => {
-    const scan = StorageManager.getCurrentScan();
-    if (scan) {
-        ExportManager.toJSON(scan.aps, `wardrive_current_${Date.now()}.json`);
+    const aps = ClientDataStore.list();
+    if (aps.length) {
+        ExportManager.toJSON(aps, `wardrive_current_${Date.now()}.json`);
         log(document.getElementById("log"), "✓ EXPORTED CURRENT SCAN AS JSON");
     } else {
         alert("No current scan data to export");
@@ -821,9 +1180,9 @@ document.getElementById("btnExportCurrentJSON").onclick = () => {
 };
 
 document.getElementById("btnExportCurrentKML").onclick = () => {
-    const scan = StorageManager.getCurrentScan();
-    if (scan) {
-        ExportManager.toKML(scan.aps, `wardrive_current_${Date.now()}.kml`);
+    const aps = ClientDataStore.list();
+    if (aps.length) {
+        ExportManager.toKML(aps, `wardrive_current_${Date.now()}.kml`);
         log(document.getElementById("log"), "✓ EXPORTED CURRENT SCAN AS KML");
     } else {
         alert("No current scan data to export");
@@ -873,11 +1232,10 @@ document.getElementById("btnScan").onclick = async () => {
         
         await fetch("/api/scan/once", { method: "POST" });
 
-        const res = await fetch("/api/aps");
-        const aps = await res.json();
+        const aps = await fetchAps();
 
         const latestLocation = await GeoTracker.getPosition();
-        const mergedAps = ClientDataStore.mergeAps(aps, latestLocation);
+        const mergedAps = await ClientDataStore.mergeAps(aps, latestLocation);
         updateGpsStatus(latestLocation);
 
         const tbody = document.getElementById("apList");
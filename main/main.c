@@ -1,11 +1,14 @@
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <time.h>
 #include <sys/time.h>
 #include <ctype.h>
+#include <math.h>
 #include "lwip/sockets.h"
 #include "lwip/netdb.h"
 
@@ -13,6 +16,7 @@
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 
 #include "esp_random.h"
 #include "esp_system.h"
@@ -21,12 +25,18 @@
 #include "esp_netif_ip_addr.h"
 #include "esp_wifi.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "esp_http_server.h"
 #include "esp_mac.h"
 #include "esp_http_client.h"
 
+#include "ap_agg.h"
+#include "ap_snap.h"
+#include "captive_dns.h"
+
 static esp_err_t handler_api_handshake_start(httpd_req_t *req);
 static esp_err_t handler_api_handshake_stop(httpd_req_t *req);
 static esp_err_t handler_api_handshake_status(httpd_req_t *req);
@@ -38,9 +48,10 @@ static const char *TAG = "NEO_WARDRIVE";
 // ========================= CONFIG ==========================
 
 #define MAX_APS           512
-#define JSON_BUF_SIZE     16384
-#define SCAN_INTERVAL_MS  5000
+#define SCAN_INTERVAL_MS  5000    // defaults of the built-in "walk" profile
 #define CHANNEL_DWELL_MS  120
+#define WEAK_SIGNAL_RSSI  -70
+#define CHANNEL_CONFLICT_APS 3
 
 static const char *AP_SSID = "NeoWardrive";
 static const char *AP_PASS = "neo_wardrive_01";
@@ -111,10 +122,19 @@ typedef struct {
     uint8_t  authmode;
     uint32_t first_seen_ms;
     uint32_t last_seen_ms;
+    uint32_t modified_ms;   // last in-place change (resolved SSID), 0 = none
     uint16_t seen_count;
     int8_t   rssi_min;
     int8_t   rssi_max;
     ap_class_t classification;
+    uint32_t caps;          // AP_CAP_* bits from scan records and sniffed beacons
+    char     country[3];
+    uint16_t beacon_int;    // TU, 0 until a beacon has been sniffed
+    int16_t  radio;         // g_radios slot of the physical radio, -1 = ungrouped
+    bool     returning;     // BSSID was in the seen-before filter on insert
+    bool     ssid_resolved; // hidden SSID learned from a sniffed frame
+    int16_t  recent_prev;   // recency list links (slot indices, -1 = none)
+    int16_t  recent_next;
 } ap_info_t;
 
 typedef struct {
@@ -133,6 +153,7 @@ typedef struct {
     uint32_t wpa3_count;
     uint32_t open_count;
     uint32_t hidden_count;
+    uint32_t hidden_resolved;
     uint32_t weak_signal_count;
     uint32_t channel_conflicts;
 } security_stats_t;
@@ -140,9 +161,20 @@ typedef struct {
 typedef struct {
     uint8_t channel;
     uint32_t ap_count;
+    uint32_t radio_count;
     float congestion_score;
+    int16_t airtime_x10;        // measured utilization, -1 if not observed
+    uint16_t loaded_aps;        // APs with observed data traffic
+    uint32_t clients;           // summed over those APs
+    uint32_t load;              // summed AP load (see CLIENT DENSITY)
 } channel_analysis_t;
 
+// Running totals (ap_aggregates_t) and secondary indexes (ap_index_t) over
+// the live entries of g_aps live in components/ap_agg. They are kept in step
+// with every insert/update/evict so the analysis endpoints never have to walk
+// the table. Guarded by g_ap_mutex.
+_Static_assert(MAX_APS == AP_AGG_SLOTS, "ap_agg slot count must match MAX_APS");
+
 typedef struct {
     uint32_t count;
     uint32_t last_time_ms;
@@ -156,12 +188,44 @@ typedef struct {
     uint32_t handshake_captured;
 } packet_stats_t;
 
+typedef struct {
+    uint32_t queries;
+    uint32_t answered_a;
+    uint32_t answered_empty;
+    uint32_t dropped;
+    uint32_t send_failed;       // sendto errors, usually pbuf exhaustion
+    uint32_t max_burst;         // most queries drained in one wakeup
+} dns_stats_t;
+
+typedef struct {
+    uint32_t dispatched;
+    uint32_t async_dispatched;
+    uint32_t async_busy;
+    uint32_t rate_limited;
+} httpd_stats_t;
+
 // ========================= STATE ===========================
 
 static ap_info_t g_aps[MAX_APS];
 static int g_ap_count = 0;
 static uint32_t g_ap_insert_index = 0;
 
+// Live entries of g_aps threaded most-recently-seen first. Every merge stamps
+// the same now_ms(), so the list stays ordered by last_seen_ms and a "seen in
+// the last N seconds" query only walks the entries that qualify.
+static int16_t g_recent_head = -1;
+static int16_t g_recent_tail = -1;
+
+// Newest modified_ms in the table. While it is after a delta query's
+// "since", the recency walk can't stop at the first older sighting.
+static uint32_t g_ap_modified_ms = 0;
+
+// Bumped whenever the table is cleared so delta clients know to resync.
+static uint32_t g_ap_generation = 0;
+
+// Bumped on every write to g_aps; snap_save() skips while it is unchanged.
+static uint32_t g_ap_changes = 0;
+
 // Wardrive state
 static bool      g_wardrive_on      = false;
 static httpd_handle_t g_httpd       = NULL;
@@ -177,19 +241,34 @@ static deauth_event_t   g_deauth_log[32];
 static int              g_deauth_head = 0;
 static security_stats_t g_security_stats = {0};
 static packet_stats_t   g_packet_stats   = {0};
+static dns_stats_t      g_dns_stats      = {0};
+static httpd_stats_t    g_httpd_stats    = {0};
+static ap_aggregates_t  g_agg            = {0};
+static ap_index_t       g_idx;
+
+// Frame classes the active scan profile asks the sniffer for. Control and
+// data frames feed airtime and client accounting; management is always on.
+static uint32_t g_sniff_mask = WIFI_PROMIS_FILTER_MASK_MGMT |
+                               WIFI_PROMIS_FILTER_MASK_CTRL |
+                               WIFI_PROMIS_FILTER_MASK_DATA;
 
 static void update_promiscuous_filter(void) {
     wifi_promiscuous_filter_t filt = {
-        .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT |
-                       (g_packet_stats.handshake_listening ? WIFI_PROMIS_FILTER_MASK_DATA : 0)
+        .filter_mask = g_sniff_mask | WIFI_PROMIS_FILTER_MASK_MGMT
     };
+    // Handshake capture needs data frames whatever the profile says
+    if (g_packet_stats.handshake_listening) filt.filter_mask |= WIFI_PROMIS_FILTER_MASK_DATA;
     esp_wifi_set_promiscuous_filter(&filt);
 }
 
 // ========================= UTILS ===========================
 
+// Set once at boot by snap_restore() so timestamps restored from a warm-start
+// snapshot stay in the past and the clock carries on from where it stopped.
+static uint32_t g_now_offset_ms;
+
 static uint32_t now_ms(void) {
-    return (uint32_t)(esp_timer_get_time() / 1000ULL);
+    return (uint32_t)(esp_timer_get_time() / 1000ULL) + g_now_offset_ms;
 }
 
 static void mac_to_str(const uint8_t mac[6], char *out, size_t len) {
@@ -232,6 +311,25 @@ static void str_to_mac(const char *str, uint8_t mac[6]) {
            &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]);
 }
 
+// The request URI is bounded by CONFIG_HTTPD_MAX_URI_LEN, so a buffer this
+// size always holds the whole query string. Anything smaller makes
+// httpd_req_get_url_query_str fail on long queries (a dashboard poll with a
+// GPS fix) and every lookup fall back to its default.
+#define QUERY_MAX (CONFIG_HTTPD_MAX_URI_LEN + 1)
+
+static uint32_t query_u32(httpd_req_t *req, const char *key, uint32_t def) {
+    char query[QUERY_MAX];
+    char val[16];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) return def;
+    if (httpd_query_key_value(query, key, val, sizeof(val)) != ESP_OK) return def;
+    return (uint32_t)strtoul(val, NULL, 10);
+}
+
+// "?window=N" restricts aggregate endpoints to APs seen in the last N seconds.
+static uint32_t query_window_ms(httpd_req_t *req) {
+    return query_u32(req, "window", 0) * 1000;
+}
+
 static const char* auth_mode_to_str(wifi_auth_mode_t mode) {
     switch (mode) {
         case WIFI_AUTH_OPEN:           return "OPEN";
@@ -293,1149 +391,5682 @@ static ap_class_t classify_ap(const ap_info_t *ap) {
     return AP_CLASS_HOME;
 }
 
-// ========================= AP DB ===========================
+// ========================= BEACON IE CACHE =========================
+// The scan API only reports authmode, ciphers, a few PHY flags and WPS. For
+// the rest (AKM suites, PMF, VHT/HE, beacon interval) the sniffer walks the
+// IEs of beacons and probe responses in place and stores the result in a
+// small direct-mapped cache keyed by BSSID. merge_scan_record() folds the
+// cache into the AP record, so this costs no extra airtime. Only frames on
+// the channel the radio is parked on are seen; other APs keep the scan-only
+// bits.
+
+#define AP_CAP_PRIVACY      (1u << 0)   // capability info privacy bit
+#define AP_CAP_RSN          (1u << 1)
+#define AP_CAP_WPA          (1u << 2)   // WPA1 vendor IE
+#define AP_CAP_PAIR_WEP     (1u << 3)
+#define AP_CAP_PAIR_TKIP    (1u << 4)
+#define AP_CAP_PAIR_CCMP    (1u << 5)
+#define AP_CAP_PAIR_GCMP    (1u << 6)
+#define AP_CAP_GROUP_WEP    (1u << 7)
+#define AP_CAP_GROUP_TKIP   (1u << 8)
+#define AP_CAP_GROUP_CCMP   (1u << 9)
+#define AP_CAP_AKM_8021X    (1u << 10)
+#define AP_CAP_AKM_PSK      (1u << 11)
+#define AP_CAP_AKM_SAE      (1u << 12)
+#define AP_CAP_AKM_OWE      (1u << 13)
+#define AP_CAP_AKM_FT       (1u << 14)
+#define AP_CAP_AKM_SUITE_B  (1u << 15)
+#define AP_CAP_PMF_CAPABLE  (1u << 16)
+#define AP_CAP_PMF_REQUIRED (1u << 17)
+#define AP_CAP_WPS          (1u << 18)
+#define AP_CAP_HT           (1u << 19)
+#define AP_CAP_VHT          (1u << 20)
+#define AP_CAP_HE           (1u << 21)
+#define AP_CAP_GROUP_GCMP   (1u << 22)  // GCMP or GCMP-256 group cipher
+#define AP_CAP_IE_PARSED    (1u << 31)  // bits below came from a sniffed beacon
+
+// Bits the scan record can supply; the rest only come from sniffed IEs.
+#define AP_CAP_SCAN_MASK    (AP_CAP_PAIR_WEP | AP_CAP_PAIR_TKIP | AP_CAP_PAIR_CCMP | \
+                             AP_CAP_PAIR_GCMP | AP_CAP_GROUP_WEP | AP_CAP_GROUP_TKIP | \
+                             AP_CAP_GROUP_CCMP | AP_CAP_GROUP_GCMP | AP_CAP_WPS | \
+                             AP_CAP_HT | AP_CAP_HE)
+
+#define IE_CACHE_SIZE       64          // power of two
 
-static int find_ap_by_bssid(const uint8_t bssid[6]) {
-    for (int i = 0; i < g_ap_count; i++) {
-        if (g_aps[i].in_use && mac_equal(g_aps[i].bssid, bssid)) {
-            return i;
-        }
-    }
-    return -1;
+typedef struct {
+    uint8_t  bssid[6];
+    char     country[2];
+    uint16_t beacon_int;
+    uint32_t caps;                      // 0 = empty slot
+} ie_cache_entry_t;
+
+static DRAM_ATTR ie_cache_entry_t g_ie_cache[IE_CACHE_SIZE];
+static portMUX_TYPE g_ie_cache_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline IRAM_ATTR uint32_t bssid_hash(const uint8_t *b) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) h = (h ^ b[i]) * 16777619u;
+    return h;
 }
 
-static void sanitize_ssid(char *dst, const uint8_t *src, size_t max_len) {
-    size_t in_len = strnlen((const char *)src, max_len);
-    size_t len = 0;
+// Suite type for OUI 00-0F-AC (RSN) or 00-50-F2 (WPA1); -1 for vendor suites.
+static inline IRAM_ATTR int ie_suite_type(const uint8_t *p, bool wpa1) {
+    if (wpa1 ? (p[0] != 0x00 || p[1] != 0x50 || p[2] != 0xF2)
+             : (p[0] != 0x00 || p[1] != 0x0F || p[2] != 0xAC)) return -1;
+    return p[3];
+}
 
-    for (size_t i = 0; i < in_len; i++) {
-        uint8_t c = src[i];
-        dst[len++] = (c >= 32 && c < 127) ? c : '?';
-        if (len >= (max_len - 1)) break;
+static IRAM_ATTR uint32_t ie_cipher_bits(int type, bool group) {
+    switch (type) {
+        case 1: case 5:        return group ? AP_CAP_GROUP_WEP  : AP_CAP_PAIR_WEP;
+        case 2:                return group ? AP_CAP_GROUP_TKIP : AP_CAP_PAIR_TKIP;
+        case 4: case 10:       return group ? AP_CAP_GROUP_CCMP : AP_CAP_PAIR_CCMP;
+        case 8: case 9:        return group ? AP_CAP_GROUP_GCMP : AP_CAP_PAIR_GCMP;
+        default:               return 0;
     }
-    dst[len] = 0;
 }
 
-static void update_ap_list_from_scan(void) {
-    uint16_t num = 0;
-    esp_wifi_scan_get_ap_num(&num);
-
-    if (num == 0) {
-        ESP_LOGW(TAG, "No APs found in scan");
-        return;
+static IRAM_ATTR uint32_t ie_akm_bits(int type) {
+    switch (type) {
+        case 1: case 5:        return AP_CAP_AKM_8021X;
+        case 2: case 6:        return AP_CAP_AKM_PSK;
+        case 3:                return AP_CAP_AKM_8021X | AP_CAP_AKM_FT;
+        case 4:                return AP_CAP_AKM_PSK | AP_CAP_AKM_FT;
+        case 8: case 24:       return AP_CAP_AKM_SAE;
+        case 9: case 25:       return AP_CAP_AKM_SAE | AP_CAP_AKM_FT;
+        case 11: case 12:      return AP_CAP_AKM_8021X | AP_CAP_AKM_SUITE_B;
+        case 18:               return AP_CAP_AKM_OWE;
+        default:               return 0;
     }
+}
 
-    wifi_ap_record_t *records = malloc(sizeof(wifi_ap_record_t) * num);
-    if (!records) {
-        ESP_LOGE(TAG, "Failed to allocate memory for scan results");
-        return;
+// Parses the body of an RSN IE, or of a WPA1 vendor IE after its OUI/type.
+static IRAM_ATTR uint32_t ie_parse_rsn(const uint8_t *p, int len, bool wpa1) {
+    uint32_t caps = wpa1 ? AP_CAP_WPA : AP_CAP_RSN;
+    if (len < 6) return caps;
+    p += 2; len -= 2;                                   // version
+
+    caps |= ie_cipher_bits(ie_suite_type(p, wpa1), true);
+    p += 4; len -= 4;
+
+    for (int pass = 0; pass < 2; pass++) {              // pairwise, then AKM
+        if (len < 2) return caps;
+        int count = p[0] | (p[1] << 8);
+        p += 2; len -= 2;
+        for (int i = 0; i < count; i++, p += 4, len -= 4) {
+            if (len < 4) return caps;
+            int type = ie_suite_type(p, wpa1);
+            caps |= pass == 0 ? ie_cipher_bits(type, false) : ie_akm_bits(type);
+        }
     }
 
-    uint16_t actual_num = num;
-    esp_err_t err = esp_wifi_scan_get_ap_records(&actual_num, records);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "scan_get_ap_records failed: %s", esp_err_to_name(err));
-        free(records);
-        return;
+    if (!wpa1 && len >= 2) {
+        if (p[0] & 0x80) caps |= AP_CAP_PMF_CAPABLE;
+        if (p[0] & 0x40) caps |= AP_CAP_PMF_REQUIRED;
     }
+    return caps;
+}
 
-    uint32_t now = now_ms();
-
-    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        for (int i = 0; i < actual_num; i++) {
-            wifi_ap_record_t *r = &records[i];
-
-            int idx = find_ap_by_bssid(r->bssid);
-
-            if (idx < 0) {
-                idx = g_ap_insert_index++ % MAX_APS;
-                ap_info_t *dst = &g_aps[idx];
-                memset(dst, 0, sizeof(*dst));
-
-                dst->in_use = true;
-                memcpy(dst->bssid, r->bssid, 6);
-                sanitize_ssid(dst->ssid, r->ssid, sizeof(dst->ssid));
-
-                dst->rssi          = r->rssi;
-                dst->rssi_min      = r->rssi;
-                dst->rssi_max      = r->rssi;
-                dst->channel       = r->primary;
-                dst->authmode      = (uint8_t)r->authmode;
-                dst->first_seen_ms = now;
-                dst->last_seen_ms  = now;
-                dst->seen_count    = 1;
-                dst->classification = classify_ap(dst);
-
-                if (g_ap_count < MAX_APS) {
-                    g_ap_count++;
+// Walks a beacon or probe response (802.11 header included, FCS excluded)
+// and records its capabilities in the cache. Runs in the sniffer callback.
+static IRAM_ATTR void ie_cache_update(const uint8_t *frame, int len) {
+    if (len < 36) return;
+    const uint8_t *bssid = frame + 16;
+    uint16_t beacon_int = frame[32] | (frame[33] << 8);
+    uint32_t caps = AP_CAP_IE_PARSED;
+    char country[2] = {0, 0};
+
+    if (frame[34] & 0x10) caps |= AP_CAP_PRIVACY;
+
+    const uint8_t *ie = frame + 36;
+    const uint8_t *end = frame + len;
+    while (ie + 2 <= end && ie + 2 + ie[1] <= end) {
+        const uint8_t *body = ie + 2;
+        int ie_len = ie[1];
+        switch (ie[0]) {
+            case 7:
+                if (ie_len >= 2) { country[0] = body[0]; country[1] = body[1]; }
+                break;
+            case 45:  caps |= AP_CAP_HT;  break;
+            case 191: caps |= AP_CAP_VHT; break;
+            case 48:  caps |= ie_parse_rsn(body, ie_len, false); break;
+            case 221:
+                if (ie_len >= 4 && body[0] == 0x00 && body[1] == 0x50 && body[2] == 0xF2) {
+                    if (body[3] == 1) caps |= ie_parse_rsn(body + 4, ie_len - 4, true);
+                    if (body[3] == 4) caps |= AP_CAP_WPS;
                 }
-            } else {
-                ap_info_t *dst = &g_aps[idx];
-                dst->rssi = r->rssi;
-                if (r->rssi < dst->rssi_min) dst->rssi_min = r->rssi;
-                if (r->rssi > dst->rssi_max) dst->rssi_max = r->rssi;
-                dst->channel       = r->primary;
-                dst->authmode      = (uint8_t)r->authmode;
-                dst->last_seen_ms  = now;
-                if (dst->seen_count < 0xFFFF) dst->seen_count++;
-
-                dst->classification = classify_ap(dst);
-            }
-            if (idx >= g_ap_count) {
-                g_ap_count = idx + 1;
-            }
-
+                break;
+            case 255:
+                if (ie_len >= 1 && body[0] == 35) caps |= AP_CAP_HE;
+                break;
         }
+        ie += 2 + ie_len;
+    }
 
-        xSemaphoreGive(g_ap_mutex);
-        ESP_LOGI(TAG, "AP list updated: %d total APs, %d in this scan", g_ap_count, actual_num);
+    ie_cache_entry_t *e = &g_ie_cache[bssid_hash(bssid) & (IE_CACHE_SIZE - 1)];
+    taskENTER_CRITICAL(&g_ie_cache_mux);
+    memcpy(e->bssid, bssid, 6);
+    e->caps = caps;
+    e->beacon_int = beacon_int;
+    e->country[0] = country[0];
+    e->country[1] = country[1];
+    taskEXIT_CRITICAL(&g_ie_cache_mux);
+}
+
+static uint32_t scan_cipher_bits(wifi_cipher_type_t c, bool group) {
+    switch (c) {
+        case WIFI_CIPHER_TYPE_WEP40:
+        case WIFI_CIPHER_TYPE_WEP104:    return group ? AP_CAP_GROUP_WEP  : AP_CAP_PAIR_WEP;
+        case WIFI_CIPHER_TYPE_TKIP:      return group ? AP_CAP_GROUP_TKIP : AP_CAP_PAIR_TKIP;
+        case WIFI_CIPHER_TYPE_CCMP:      return group ? AP_CAP_GROUP_CCMP : AP_CAP_PAIR_CCMP;
+        case WIFI_CIPHER_TYPE_TKIP_CCMP: return group ? AP_CAP_GROUP_TKIP | AP_CAP_GROUP_CCMP
+                                                      : AP_CAP_PAIR_TKIP | AP_CAP_PAIR_CCMP;
+        case WIFI_CIPHER_TYPE_GCMP:
+        case WIFI_CIPHER_TYPE_GCMP256:   return group ? AP_CAP_GROUP_GCMP : AP_CAP_PAIR_GCMP;
+        default:                         return 0;
+    }
+}
+
+// Fills ap->caps/country/beacon_int from the scan record and, when one has
+// been sniffed, the cached beacon. Caller holds g_ap_mutex.
+static void ap_merge_caps(ap_info_t *ap, const wifi_ap_record_t *r) {
+    uint32_t caps = scan_cipher_bits(r->pairwise_cipher, false) |
+                    scan_cipher_bits(r->group_cipher, true);
+    if (r->phy_11n)  caps |= AP_CAP_HT;
+    if (r->phy_11ax) caps |= AP_CAP_HE;
+    if (r->wps)      caps |= AP_CAP_WPS;
+    if (r->country.cc[0]) {
+        ap->country[0] = r->country.cc[0];
+        ap->country[1] = r->country.cc[1];
+        ap->country[2] = '\0';
     }
 
-    free(records);
+    ie_cache_entry_t e;
+    const ie_cache_entry_t *slot = &g_ie_cache[bssid_hash(ap->bssid) & (IE_CACHE_SIZE - 1)];
+    taskENTER_CRITICAL(&g_ie_cache_mux);
+    e = *slot;
+    taskEXIT_CRITICAL(&g_ie_cache_mux);
+
+    if (e.caps && mac_equal(e.bssid, ap->bssid)) {
+        caps |= e.caps;
+        ap->beacon_int = e.beacon_int;
+        if (e.country[0] >= 'A' && e.country[0] <= 'Z') {
+            ap->country[0] = e.country[0];
+            ap->country[1] = e.country[1];
+            ap->country[2] = '\0';
+        }
+    } else {
+        caps |= ap->caps & ~AP_CAP_SCAN_MASK;      // keep earlier beacon-only bits
+    }
+    ap->caps = caps;
 }
 
-// ========================= SAFE SCAN WRAPPER ===========================
+// ========================= BEACON TIMING =========================
+// A cloned BSSID shows up as one beacon stream coming from two radios. Each
+// tracked BSSID keeps the last beacon's TSF, sequence number, local arrival
+// time and RSSI; a second transmitter makes the TSF jump or run backwards
+// against our clock, the sequence counter step back, arrivals drift off the
+// beacon-interval grid and RSSI flip between two levels. Counters are halved
+// every BT_DECAY_BEACONS so old events age out. A busy slot is not taken
+// over by a colliding BSSID until it has been idle for BT_STEAL_IDLE_US, so
+// two BSSIDs sharing a slot on a dense channel don't keep resetting each
+// other; the newcomer stays untracked meanwhile.
+
+#define BT_TRACK_SIZE       32      // power of two, direct-mapped by BSSID hash
+#define BT_TSF_TOL_US       2000    // plus 0.1% of the gap for clock drift
+#define BT_JITTER_TOL_US    3000
+#define BT_RSSI_JUMP_DB     12
+#define BT_MIN_BEACONS      20
+#define BT_DECAY_BEACONS    128
+#define BT_FLAG_CONFIDENCE  50
+#define BT_STEAL_IDLE_US    1000000
 
-static esp_err_t safe_scan_start()
-{
-    // Temporarily disable promiscuous mode during scan
-    esp_wifi_set_promiscuous(false);
+typedef struct {
+    uint8_t  bssid[6];
+    int8_t   last_rssi;
+    uint8_t  pad;
+    uint64_t last_tsf;
+    uint32_t last_rx_us;
+    uint32_t total;         // beacons since tracking started
+    uint16_t last_seq;
+    uint16_t beacons;       // since the last decay
+    uint16_t tsf_back;      // TSF went backwards
+    uint16_t tsf_skew;      // TSF advance disagrees with the local clock
+    uint16_t seq_back;      // sequence number repeated or went backwards
+    uint16_t jitter;        // arrival off the beacon-interval grid
+    uint16_t rssi_jump;
+} beacon_track_t;
+
+static DRAM_ATTR beacon_track_t g_beacon_track[BT_TRACK_SIZE];
+static portMUX_TYPE g_beacon_track_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Called from the sniffer for every beacon (header included, FCS excluded).
+static IRAM_ATTR void beacon_track_update(const uint8_t *frame, int len, const wifi_pkt_rx_ctrl_t *rx) {
+    if (len < 36) return;
+    const uint8_t *bssid = frame + 16;
+    uint16_t seq = (uint16_t)((frame[22] | (frame[23] << 8)) >> 4);
+    uint64_t tsf = 0;
+    for (int i = 7; i >= 0; i--) tsf = (tsf << 8) | frame[24 + i];
+    uint32_t period = (uint32_t)(frame[32] | (frame[33] << 8)) * 1024;
+    uint32_t rx_us = rx->timestamp;
+    int8_t rssi = rx->rssi;
+
+    beacon_track_t *t = &g_beacon_track[bssid_hash(bssid) & (BT_TRACK_SIZE - 1)];
+    taskENTER_CRITICAL(&g_beacon_track_mux);
+
+    if (memcmp(t->bssid, bssid, 6) != 0 || t->total == 0) {
+        if (t->total && rx_us - t->last_rx_us < BT_STEAL_IDLE_US) {
+            taskEXIT_CRITICAL(&g_beacon_track_mux);
+            return;
+        }
+        memset(t, 0, sizeof(*t));
+        memcpy(t->bssid, bssid, 6);
+    } else {
+        uint32_t dt = rx_us - t->last_rx_us;
 
-    wifi_scan_config_t scan_cfg = {
-        .ssid = NULL,
-        .bssid = NULL,
-        .channel = 0,
-        .show_hidden = true,
-        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
-        .scan_time.active.min = CHANNEL_DWELL_MS,
-        .scan_time.active.max = CHANNEL_DWELL_MS
-    };
+        if (tsf < t->last_tsf) {
+            t->tsf_back++;
+        } else {
+            uint64_t dtsf = tsf - t->last_tsf;
+            uint64_t diff = dtsf > dt ? dtsf - dt : dt - dtsf;
+            if (diff > BT_TSF_TOL_US + dt / 1000) t->tsf_skew++;
+        }
 
-    esp_err_t err = esp_wifi_scan_start(&scan_cfg, true);
-    
-    // Re-enable promiscuous mode after scan completes
-    esp_wifi_set_promiscuous(true);
+        uint16_t dseq = (seq - t->last_seq) & 0x0FFF;
+        if (dseq == 0 || dseq > 2048) t->seq_back++;
 
-    return err;
-}
+        if (period) {
+            uint32_t r = dt % period;
+            if (r > BT_JITTER_TOL_US && period - r > BT_JITTER_TOL_US) t->jitter++;
+        }
 
+        int d = rssi - t->last_rssi;
+        if (d >= BT_RSSI_JUMP_DB || d <= -BT_RSSI_JUMP_DB) t->rssi_jump++;
 
-// ========================= CSV EXPORT =========================
+        if (++t->beacons >= BT_DECAY_BEACONS) {
+            t->beacons >>= 1;
+            t->tsf_back >>= 1;
+            t->tsf_skew >>= 1;
+            t->seq_back >>= 1;
+            t->jitter >>= 1;
+            t->rssi_jump >>= 1;
+        }
+    }
 
-static void build_csv_export(char *buf, size_t len) {
-    size_t off = 0;
+    t->last_tsf   = tsf;
+    t->last_rx_us = rx_us;
+    t->last_seq   = seq;
+    t->last_rssi  = rssi;
+    t->total++;
 
-    off += snprintf(buf + off, len - off,
-                    "SSID,BSSID,RSSI,RSSI_MIN,RSSI_MAX,Channel,Auth,Seen_Count,First_Seen_MS,Last_Seen_MS\n");
+    taskEXIT_CRITICAL(&g_beacon_track_mux);
+}
 
-    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        for (int i = 0; i < g_ap_count && off < len - 256; i++) {
-            ap_info_t *ap = &g_aps[i];
-            if (!ap->in_use) continue;
+// 0-100 likelihood that the stream comes from two transmitters; -1 until
+// BT_MIN_BEACONS intervals have been observed.
+static int beacon_track_confidence(const beacon_track_t *t) {
+    if (t->beacons < BT_MIN_BEACONS) return -1;
+    uint32_t n = t->beacons;
+    uint32_t tsf  = (t->tsf_back + t->tsf_skew) * 400 / n;
+    uint32_t seq  = t->seq_back * 400 / n;
+    uint32_t jit  = t->jitter * 400 / n;
+    uint32_t rssi = t->rssi_jump * 400 / n;
+    if (tsf > 100)  tsf = 100;
+    if (seq > 100)  seq = 100;
+    if (jit > 100)  jit = 100;
+    if (rssi > 100) rssi = 100;
+    return (int)((35 * tsf + 25 * seq + 25 * jit + 15 * rssi) / 100);
+}
 
-            char bssid_str[18];
-            mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
+static bool beacon_track_lookup(const uint8_t bssid[6], beacon_track_t *out) {
+    const beacon_track_t *t = &g_beacon_track[bssid_hash(bssid) & (BT_TRACK_SIZE - 1)];
+    taskENTER_CRITICAL(&g_beacon_track_mux);
+    *out = *t;
+    taskEXIT_CRITICAL(&g_beacon_track_mux);
+    return out->total > 0 && mac_equal(out->bssid, bssid);
+}
 
-            const char *ssid_display = ap->ssid[0] ? ap->ssid : "<hidden>";
+// ========================= AP DB ===========================
 
-            off += snprintf(buf + off, len - off,
-                            "\"%s\",%s,%d,%d,%d,%u,%s,%u,%lu,%lu\n",
-                            ssid_display,
-                            bssid_str,
-                            (int)ap->rssi,
-                            (int)ap->rssi_min,
-                            (int)ap->rssi_max,
-                            (unsigned)ap->channel,
-                            auth_mode_to_str(ap->authmode),
-                            (unsigned)ap->seen_count,
-                            (unsigned long)ap->first_seen_ms,
-                            (unsigned long)ap->last_seen_ms);
+static int find_ap_by_bssid(const uint8_t bssid[6]) {
+    for (int i = 0; i < g_ap_count; i++) {
+        if (g_aps[i].in_use && mac_equal(g_aps[i].bssid, bssid)) {
+            return i;
         }
-        xSemaphoreGive(g_ap_mutex);
     }
+    return -1;
 }
 
-// ========================= SECURITY ANALYSIS FUNCTIONS =========================
-
-static void analyze_security(void) {
-    memset(&g_security_stats, 0, sizeof(g_security_stats));
-
-    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        for (int i = 0; i < g_ap_count; i++) {
-            ap_info_t *ap = &g_aps[i];
-            if (!ap->in_use) continue;
+static void sanitize_ssid(char *dst, const uint8_t *src, size_t max_len) {
+    size_t in_len = strnlen((const char *)src, max_len);
+    size_t len = 0;
 
-            switch (ap->authmode) {
-                case WIFI_AUTH_OPEN:
-                    g_security_stats.open_count++;
-                    break;
-                case WIFI_AUTH_WEP:
-                    g_security_stats.wep_count++;
-                    break;
-                case WIFI_AUTH_WPA_PSK:
-                    g_security_stats.wpa_count++;
-                    break;
-                case WIFI_AUTH_WPA2_PSK:
-                case WIFI_AUTH_WPA_WPA2_PSK:
-                    g_security_stats.wpa2_count++;
-                    break;
-                case WIFI_AUTH_WPA3_PSK:
-                case WIFI_AUTH_WPA2_WPA3_PSK:
-                    g_security_stats.wpa3_count++;
-                    break;
-            }
+    for (size_t i = 0; i < in_len; i++) {
+        uint8_t c = src[i];
+        dst[len++] = (c >= 32 && c < 127) ? c : '?';
+        if (len >= (max_len - 1)) break;
+    }
+    dst[len] = 0;
+}
 
-            if (ap->ssid[0] == '\0') {
-                g_security_stats.hidden_count++;
-            }
+// ========================= MEMORY ACCOUNTING ======================
+// Per-subsystem memory, reported by /api/tasks. Most state is static and
+// registered once at boot (mem_register_statics()); heap allocations go
+// through mem_alloc()/mem_free() with a tag, and memory the Wi-Fi driver
+// holds on our behalf (scan records) is noted with mem_note().
 
-            if (ap->rssi < -70) {
-                g_security_stats.weak_signal_count++;
-            }
-        }
+typedef enum {
+    MEM_AP_TABLE = 0,       // g_aps, indexes, aggregates, radio groups
+    MEM_RESPONSES,          // response stream pool
+    MEM_SCAN_RECORDS,       // records queued in the driver after a scan
+    MEM_SNIFFER,            // sniffer-side tables
+    MEM_ANALYTICS,          // sketches, grid, history rings
+    MEM_PERSIST,            // NVS filter / snapshot buffers
+    MEM_TAG_COUNT
+} mem_tag_t;
+
+static const char *const k_mem_tag_names[MEM_TAG_COUNT] = {
+    "ap_table", "responses", "scan_records", "sniffer", "analytics", "persist"
+};
 
-        int channel_counts[14] = {0};
-        for (int i = 0; i < g_ap_count; i++) {
-            if (g_aps[i].in_use && g_aps[i].channel >= 1 && g_aps[i].channel <= 13) {
-                channel_counts[g_aps[i].channel]++;
-            }
-        }
+typedef struct {
+    uint32_t static_bytes;
+    uint32_t live;          // heap / driver bytes currently held
+    uint32_t peak;
+    uint32_t allocs;
+    uint32_t failures;
+} mem_tag_stats_t;
+
+static mem_tag_stats_t g_mem[MEM_TAG_COUNT];
+static portMUX_TYPE g_mem_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Callers hold g_mem_mux.
+static void mem_note_locked(mem_tag_t tag, int32_t delta) {
+    mem_tag_stats_t *m = &g_mem[tag];
+    m->live = (delta < 0 && (uint32_t)-delta > m->live) ? 0 : m->live + delta;
+    if (m->live > m->peak) m->peak = m->live;
+}
 
-        for (int ch = 1; ch <= 13; ch++) {
-            if (channel_counts[ch] >= 3) {
-                g_security_stats.channel_conflicts++;
-            }
-        }
+static void mem_note(mem_tag_t tag, int32_t delta) {
+    taskENTER_CRITICAL(&g_mem_mux);
+    mem_note_locked(tag, delta);
+    taskEXIT_CRITICAL(&g_mem_mux);
+}
 
-        xSemaphoreGive(g_ap_mutex);
+static void *mem_alloc(mem_tag_t tag, size_t size) {
+    void *p = malloc(size);
+    taskENTER_CRITICAL(&g_mem_mux);
+    if (p) {
+        g_mem[tag].allocs++;
+        mem_note_locked(tag, (int32_t)size);
+    } else {
+        g_mem[tag].failures++;
     }
+    taskEXIT_CRITICAL(&g_mem_mux);
+    return p;
 }
 
-static void get_channel_congestion(channel_analysis_t *results, int *count) {
-    int channel_counts[14] = {0};
-    *count = 0;
+static void mem_free(mem_tag_t tag, void *p, size_t size) {
+    if (!p) return;
+    free(p);
+    mem_note(tag, -(int32_t)size);
+}
 
-    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        for (int i = 0; i < g_ap_count; i++) {
-            if (g_aps[i].in_use && g_aps[i].channel >= 1 && g_aps[i].channel <= 13) {
-                channel_counts[g_aps[i].channel]++;
-            }
-        }
+// ========================= UNIQUE AP SKETCH =======================
+// g_aps saturates at MAX_APS, so long drives lose track of how many distinct
+// networks were passed. Every BSSID from scans and sniffed beacons / probe
+// responses also goes into HyperLogLog sketches: one session-wide (p=10,
+// ~3.3% standard error) plus one per channel and per auth mode (p=7,
+// ~9.2%). Auth modes are only known from scan records. Registers only ever
+// grow, so sketches from other sessions or devices merge by register-wise
+// max (GET/POST /api/unique/sketch).
+
+#define HLL_P_TOTAL     10
+#define HLL_P_SUB       7
+#define HLL_M_TOTAL     (1 << HLL_P_TOTAL)
+#define HLL_M_SUB       (1 << HLL_P_SUB)
+#define HLL_CHANNELS    14      // index 0 unused, as in airtime
+#define HLL_AUTH_MAX    16
+#define HLL_VERSION     1
+
+// Flat so export and merge can treat it as one register array.
+typedef struct {
+    uint8_t total[HLL_M_TOTAL];
+    uint8_t channel[HLL_CHANNELS][HLL_M_SUB];
+    uint8_t auth[HLL_AUTH_MAX][HLL_M_SUB];
+} unique_sketch_t;
 
-        int max_aps = 1;
-        for (int ch = 1; ch <= 13; ch++) {
-            if (channel_counts[ch] > max_aps) {
-                max_aps = channel_counts[ch];
-            }
-        }
+// Wire header in front of the raw registers.
+typedef struct {
+    char    magic[3];
+    uint8_t version;
+    uint8_t p_total;
+    uint8_t p_sub;
+    uint8_t channels;
+    uint8_t auths;
+} unique_sketch_hdr_t;
+
+static DRAM_ATTR unique_sketch_t g_unique;
+static portMUX_TYPE g_unique_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const unique_sketch_hdr_t k_unique_hdr = {
+    { 'H', 'L', 'L' }, HLL_VERSION, HLL_P_TOTAL, HLL_P_SUB, HLL_CHANNELS, HLL_AUTH_MAX
+};
+
+// The hash and register helpers run from the sniffer callback (unique_note,
+// client_note, hidden_observe) and must be in IRAM like their callers.
+static inline IRAM_ATTR uint32_t hll_fmix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
 
-        for (int ch = 1; ch <= 13; ch++) {
-            results[*count].channel = ch;
-            results[*count].ap_count = channel_counts[ch];
-            results[*count].congestion_score =
-                (max_aps > 0) ? (channel_counts[ch] * 100.0f / max_aps) : 0.0f;
-            (*count)++;
-        }
+static inline IRAM_ATTR uint32_t hll_hash(const uint8_t mac[6]) {
+    uint32_t lo = (uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 |
+                  (uint32_t)mac[4] << 8  | mac[5];
+    uint32_t hi = (uint32_t)mac[0] << 8 | mac[1];
+    return hll_fmix32(lo ^ hll_fmix32(hi + 0x9e3779b9u));
+}
 
-        xSemaphoreGive(g_ap_mutex);
+static inline IRAM_ATTR void hll_add(uint8_t *regs, int p, uint32_t h) {
+    uint32_t idx = h >> (32 - p);
+    // The sentinel bit caps rank at 33 - p when the remaining bits are zero.
+    uint8_t rank = (uint8_t)(__builtin_clz((h << p) | (1u << (p - 1))) + 1);
+    if (regs[idx] < rank) regs[idx] = rank;
+}
+
+// auth < 0 when unknown (sniffed frames). Safe from the sniffer callback.
+IRAM_ATTR static void unique_note(const uint8_t bssid[6], uint8_t channel, int auth) {
+    uint32_t h = hll_hash(bssid);
+    taskENTER_CRITICAL(&g_unique_mux);
+    hll_add(g_unique.total, HLL_P_TOTAL, h);
+    if (channel < HLL_CHANNELS) hll_add(g_unique.channel[channel], HLL_P_SUB, h);
+    if (auth >= 0 && auth < HLL_AUTH_MAX) hll_add(g_unique.auth[auth], HLL_P_SUB, h);
+    taskEXIT_CRITICAL(&g_unique_mux);
+}
+
+// Standard HLL estimate with linear counting for the small range; regs is
+// a private copy. Registers are bucketed by rank first so only 33 float
+// terms are summed (no FPU on the S2).
+static uint32_t hll_estimate(const uint8_t *regs, int p) {
+    uint32_t m = 1u << p;
+    uint16_t hist[34] = {0};
+    for (uint32_t i = 0; i < m; i++) hist[regs[i] < 33 ? regs[i] : 33]++;
+    if (hist[0] == m) return 0;
+
+    float sum = 0.0f;
+    for (int k = 0; k < 34; k++) {
+        if (hist[k]) sum += ldexpf((float)hist[k], -k);
     }
+    float alpha = 0.7213f / (1.0f + 1.079f / (float)m);
+    float est = alpha * (float)m * (float)m / sum;
+    if (est <= 2.5f * (float)m && hist[0] > 0) {
+        est = (float)m * logf((float)m / (float)hist[0]);
+    }
+    return (uint32_t)(est + 0.5f);
 }
 
-static void detect_rogue_aps(char *buf, size_t len) {
-    size_t off = 0;
-    off += snprintf(buf + off, len - off, "[");
+// The register copy lives in a static scratch buffer rather than 1 KB of the
+// caller's stack; g_unique_scratch_mutex serializes its users and
+// g_unique_mux is held only for the memcpy.
+static uint8_t g_unique_scratch[HLL_M_TOTAL];
+static SemaphoreHandle_t g_unique_scratch_mutex = NULL;
+
+static uint32_t unique_estimate(const uint8_t *live, int p) {
+    size_t m = (size_t)1 << p;
+    if (xSemaphoreTake(g_unique_scratch_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) return 0;
+    taskENTER_CRITICAL(&g_unique_mux);
+    memcpy(g_unique_scratch, live, m);
+    taskEXIT_CRITICAL(&g_unique_mux);
+    uint32_t est = hll_estimate(g_unique_scratch, p);
+    xSemaphoreGive(g_unique_scratch_mutex);
+    return est;
+}
 
-    bool first = true;
+// Standard error in tenths of a percent: 1.04 / sqrt(m).
+static int hll_err_x10(int p) {
+    return p == HLL_P_TOTAL ? 33 : 92;
+}
 
-    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        for (int i = 0; i < g_ap_count; i++) {
-            ap_info_t *ap = &g_aps[i];
-            if (!ap->in_use) continue;
+// ========================= CLIENT DENSITY =========================
+// How busy each AP is, from sniffed data frames: distinct stations per BSSID
+// plus data-frame rate. Station MACs are only hashed into a 32-register HLL
+// per AP (linear counting keeps small counts close) and never stored. Two
+// CLIENT_EPOCH_S epochs are kept and unioned, so figures cover the last
+// 30-60 s. The sniffer only hears data on the home channel (and during scan
+// dwell), so APs elsewhere have no slot and report load null.
+
+#define CLIENT_SLOTS        64      // power of two, direct-mapped by BSSID
+#define CLIENT_HLL_P        5
+#define CLIENT_HLL_M        (1 << CLIENT_HLL_P)
+#define CLIENT_EPOCH_S      30
+#define CLIENT_LOAD_PER_STA 5       // load points per station
+#define CLIENT_LOAD_FPS_DIV 4       // data frames/s per load point
 
-            bool is_suspicious = false;
-            char reason[128] = "";
+typedef struct {
+    bool     in_use;
+    uint8_t  bssid[6];
+    uint8_t  channel;
+    uint8_t  regs[2][CLIENT_HLL_M];
+    uint32_t frames[2];
+    uint32_t last_ms;
+    // Derived once a second by client_load_sample().
+    uint16_t clients;
+    uint16_t fps_x10;
+    int8_t   load;                  // 0-100, -1 until the first sample
+} client_slot_t;
+
+static DRAM_ATTR client_slot_t g_clients[CLIENT_SLOTS];
+static DRAM_ATTR uint8_t g_clients_epoch;
+static DRAM_ATTR uint32_t g_clients_dropped;   // frames lost to a busy slot
+static portMUX_TYPE g_clients_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Data frame from the sniffer; hdr/len cover the MAC header onwards.
+IRAM_ATTR static void client_note(const uint8_t *hdr, int len, uint8_t channel) {
+    if (len < 24) return;
+
+    const uint8_t *bssid;
+    const uint8_t *sta;
+    switch (hdr[1] & 0x03) {
+        case 0x01: bssid = &hdr[4];  sta = &hdr[10]; break;   // to DS
+        case 0x02: bssid = &hdr[10]; sta = &hdr[4];  break;   // from DS
+        default:   return;                                    // IBSS / WDS
+    }
+    if (sta[0] & 0x01) return;      // group-addressed
 
-            for (int j = i + 1; j < g_ap_count; j++) {
-                if (g_aps[j].in_use &&
-                    strlen(ap->ssid) > 0 &&
-                    strcmp(ap->ssid, g_aps[j].ssid) == 0 &&
-                    !mac_equal(ap->bssid, g_aps[j].bssid)) {
-                    is_suspicious = true;
-                    snprintf(reason, sizeof(reason),
-                             "Duplicate SSID - Possible Evil Twin");
-                    break;
-                }
-            }
+    uint32_t slot = hll_hash(bssid) & (CLIENT_SLOTS - 1);
+    uint32_t h = hll_hash(sta);
+    uint32_t now = now_ms();
 
-            if (ap->authmode == WIFI_AUTH_OPEN && strlen(ap->ssid) > 0) {
-                const char *common_names[] = {
-                    "Free WiFi", "Public WiFi", "Guest", "Airport WiFi", "Hotel WiFi"
-                };
-                for (int k = 0; k < 5; k++) {
-                    if (strcasecmp(ap->ssid, common_names[k]) == 0) {
-                        is_suspicious = true;
-                        snprintf(reason, sizeof(reason),
-                                 "Open network with generic name");
-                        break;
-                    }
-                }
-            }
+    taskENTER_CRITICAL(&g_clients_mux);
+    client_slot_t *c = &g_clients[slot];
+    if (!c->in_use || (memcmp(c->bssid, bssid, 6) != 0 &&
+                       now - c->last_ms > 2 * CLIENT_EPOCH_S * 1000)) {
+        memset(c, 0, sizeof(*c));
+        c->in_use = true;
+        c->load = -1;
+        memcpy(c->bssid, bssid, 6);
+    } else if (memcmp(c->bssid, bssid, 6) != 0) {
+        g_clients_dropped++;
+        taskEXIT_CRITICAL(&g_clients_mux);
+        return;
+    }
+    hll_add(c->regs[g_clients_epoch], CLIENT_HLL_P, h);
+    c->frames[g_clients_epoch]++;
+    c->channel = channel;
+    c->last_ms = now;
+    taskEXIT_CRITICAL(&g_clients_mux);
+}
 
-            if (is_suspicious && off < len - 256) {
-                if (!first) off += snprintf(buf + off, len - off, ",");
-                first = false;
-
-                char bssid_str[18];
-                mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
-
-                off += snprintf(buf + off, len - off,
-                                "{\"ssid\":\"%s\",\"bssid\":\"%s\","
-                                "\"reason\":\"%s\",\"rssi\":%d,\"channel\":%u}",
-                                ap->ssid[0] ? ap->ssid : "<hidden>",
-                                bssid_str,
-                                reason,
-                                (int)ap->rssi,
-                                (unsigned)ap->channel);
-            }
+// 1 Hz from stats_task: refreshes the derived figures, frees slots idle
+// for two epochs and starts a new epoch every CLIENT_EPOCH_S.
+static void client_load_sample(void) {
+    static uint32_t epoch_start_ms;
+    uint32_t now = now_ms();
+    uint32_t into_epoch = now - epoch_start_ms;
+    bool rotate = into_epoch >= CLIENT_EPOCH_S * 1000;
+    uint8_t next = g_clients_epoch ^ 1;
+    uint32_t window_ms = CLIENT_EPOCH_S * 1000 + (rotate ? 0 : into_epoch);
+
+    for (int i = 0; i < CLIENT_SLOTS; i++) {
+        uint8_t regs[CLIENT_HLL_M];
+        uint32_t frames;
+
+        taskENTER_CRITICAL(&g_clients_mux);
+        client_slot_t *c = &g_clients[i];
+        if (!c->in_use) {
+            taskEXIT_CRITICAL(&g_clients_mux);
+            continue;
+        }
+        if (now - c->last_ms > 2 * CLIENT_EPOCH_S * 1000) {
+            c->in_use = false;
+            taskEXIT_CRITICAL(&g_clients_mux);
+            continue;
+        }
+        for (int r = 0; r < CLIENT_HLL_M; r++) {
+            regs[r] = c->regs[0][r] > c->regs[1][r] ? c->regs[0][r] : c->regs[1][r];
+        }
+        frames = c->frames[0] + c->frames[1];
+        taskEXIT_CRITICAL(&g_clients_mux);
+
+        uint32_t clients = hll_estimate(regs, CLIENT_HLL_P);
+        uint32_t fps_x10 = (uint32_t)((uint64_t)frames * 10000 / window_ms);
+        uint32_t load = clients * CLIENT_LOAD_PER_STA + fps_x10 / (10 * CLIENT_LOAD_FPS_DIV);
+
+        taskENTER_CRITICAL(&g_clients_mux);
+        c->clients = (uint16_t)(clients > UINT16_MAX ? UINT16_MAX : clients);
+        c->fps_x10 = (uint16_t)(fps_x10 > UINT16_MAX ? UINT16_MAX : fps_x10);
+        c->load    = (int8_t)(load > 100 ? 100 : load);
+        if (rotate) {
+            memset(c->regs[next], 0, CLIENT_HLL_M);
+            c->frames[next] = 0;
         }
+        taskEXIT_CRITICAL(&g_clients_mux);
+    }
 
-        xSemaphoreGive(g_ap_mutex);
+    if (rotate) {
+        g_clients_epoch = next;
+        epoch_start_ms = now;
     }
+}
 
-    off += snprintf(buf + off, len - off, "]");
+// Returns the AP's load (0-100), or -1 if its data traffic is not observed.
+static int client_load_get(const uint8_t bssid[6], uint16_t *clients, uint16_t *fps_x10) {
+    int load = -1;
+    const client_slot_t *c = &g_clients[hll_hash(bssid) & (CLIENT_SLOTS - 1)];
+    taskENTER_CRITICAL(&g_clients_mux);
+    if (c->in_use && c->load >= 0 && memcmp(c->bssid, bssid, 6) == 0) {
+        *clients = c->clients;
+        *fps_x10 = c->fps_x10;
+        load = c->load;
+    }
+    taskEXIT_CRITICAL(&g_clients_mux);
+    return load;
 }
 
-static void get_vulnerable_networks(char *buf, size_t len) {
-    size_t off = 0;
-    off += snprintf(buf + off, len - off, "[");
+// ========================= SEEN-BEFORE FILTER =====================
+// Bloom filter of every BSSID ever inserted into g_aps, persisted to NVS.
+// merge_scan_record() consults it on insert so re-encountered APs (earlier
+// sessions, or evicted earlier in this one) are flagged "returning" instead
+// of counting as new discoveries. 32768 bits with 6 double-hashed probes:
+// ~0.6% false positives at 3000 BSSIDs, ~5% at 5000. All access is under
+// g_ap_mutex; lookup and insert touch only the static bit array.
+
+#define SEEN_BITS           (4096 * 8)  // power of two
+#define SEEN_PROBES         6
+#define SEEN_VERSION        1
+#define SEEN_SAVE_MS        (10 * 60 * 1000)
+#define SEEN_NVS_NAMESPACE  "wardrive"
+#define SEEN_NVS_KEY        "seen_bloom"
 
-    bool first = true;
+typedef struct {
+    uint8_t  version;
+    uint8_t  probes;
+    uint16_t reserved;
+    uint32_t inserted;          // insert calls that set at least one new bit
+    uint8_t  bits[SEEN_BITS / 8];
+} seen_filter_t;
+
+static seen_filter_t g_seen;
+static struct {
+    uint32_t loaded;            // g_seen.inserted at boot
+    uint32_t last_save_ms;
+    uint32_t saves;
+    esp_err_t last_err;
+    bool     dirty;
+    volatile bool save_req;
+} g_seen_state;
+
+// Returns true if all probe bits were already set; sets them when insert.
+static bool seen_probe(const uint8_t bssid[6], bool insert) {
+    uint32_t h1 = hll_hash(bssid);
+    uint32_t h2 = hll_fmix32(h1 ^ 0x5bd1e995u) | 1;
+    bool present = true;
+    for (int i = 0; i < SEEN_PROBES; i++) {
+        uint32_t bit = (h1 + (uint32_t)i * h2) & (SEEN_BITS - 1);
+        uint8_t mask = (uint8_t)(1u << (bit & 7));
+        if (!(g_seen.bits[bit >> 3] & mask)) {
+            present = false;
+            if (insert) g_seen.bits[bit >> 3] |= mask;
+        }
+    }
+    if (insert && !present) {
+        g_seen.inserted++;
+        g_seen_state.dirty = true;
+    }
+    return present;
+}
 
-    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        for (int i = 0; i < g_ap_count && off < len - 256; i++) {
-            ap_info_t *ap = &g_aps[i];
-            if (!ap->in_use) continue;
+static void seen_load(void) {
+    g_seen.version = SEEN_VERSION;
+    g_seen.probes  = SEEN_PROBES;
 
-            bool is_vulnerable = false;
-            char vulnerability[128] = "";
-            char severity[16] = "";
+    nvs_handle_t h;
+    if (nvs_open(SEEN_NVS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return;
 
-            if (ap->authmode == WIFI_AUTH_WEP) {
-                is_vulnerable = true;
-                snprintf(vulnerability, sizeof(vulnerability),
-                         "WEP encryption (deprecated, easily cracked)");
-                snprintf(severity, sizeof(severity), "CRITICAL");
-            } else if (ap->authmode == WIFI_AUTH_WPA_PSK) {
-                is_vulnerable = true;
-                snprintf(vulnerability, sizeof(vulnerability),
-                         "WPA1 encryption (deprecated, vulnerable)");
-                snprintf(severity, sizeof(severity), "HIGH");
-            } else if (ap->authmode == WIFI_AUTH_OPEN) {
-                is_vulnerable = true;
-                snprintf(vulnerability, sizeof(vulnerability),
-                         "No encryption (unprotected network)");
-                snprintf(severity, sizeof(severity), "HIGH");
-            }
+    size_t len = sizeof(g_seen);
+    esp_err_t err = nvs_get_blob(h, SEEN_NVS_KEY, &g_seen, &len);
+    nvs_close(h);
 
-            if (is_vulnerable) {
-                if (!first) off += snprintf(buf + off, len - off, ",");
-                first = false;
-
-                char bssid_str[18];
-                mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
-
-                off += snprintf(buf + off, len - off,
-                                "{\"ssid\":\"%s\",\"bssid\":\"%s\",\"vulnerability\":\"%s\","
-                                "\"severity\":\"%s\",\"auth\":\"%s\",\"rssi\":%d,\"channel\":%u}",
-                                ap->ssid[0] ? ap->ssid : "<hidden>",
-                                bssid_str,
-                                vulnerability,
-                                severity,
-                                auth_mode_to_str(ap->authmode),
-                                (int)ap->rssi,
-                                (unsigned)ap->channel);
-            }
-        }
+    if (err != ESP_OK || len != sizeof(g_seen) ||
+        g_seen.version != SEEN_VERSION || g_seen.probes != SEEN_PROBES) {
+        memset(&g_seen, 0, sizeof(g_seen));
+        g_seen.version = SEEN_VERSION;
+        g_seen.probes  = SEEN_PROBES;
+        if (err == ESP_OK) ESP_LOGW(TAG, "Seen-before filter format changed, starting empty");
+        return;
+    }
+    g_seen_state.loaded = g_seen.inserted;
+    ESP_LOGI(TAG, "Seen-before filter loaded: %lu BSSIDs", (unsigned long)g_seen.inserted);
+}
 
-        xSemaphoreGive(g_ap_mutex);
+// Writes the filter when it changed and SEEN_SAVE_MS passed, or when a save
+// was requested. Runs from wardrive_task; the flash write happens on a heap
+// copy so scans are not blocked behind it.
+static void seen_maybe_save(void) {
+    uint32_t now = now_ms();
+    bool requested = g_seen_state.save_req;
+    if (!g_seen_state.dirty && !requested) return;
+    if (!requested && now - g_seen_state.last_save_ms < SEEN_SAVE_MS) return;
+    g_seen_state.save_req = false;
+
+    seen_filter_t *copy = mem_alloc(MEM_PERSIST, sizeof(*copy));
+    if (!copy) return;
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        mem_free(MEM_PERSIST, copy, sizeof(*copy));
+        return;
+    }
+    *copy = g_seen;
+    g_seen_state.dirty = false;
+    xSemaphoreGive(g_ap_mutex);
+
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(SEEN_NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(h, SEEN_NVS_KEY, copy, sizeof(*copy));
+        if (err == ESP_OK) err = nvs_commit(h);
+        nvs_close(h);
     }
+    mem_free(MEM_PERSIST, copy, sizeof(*copy));
 
-    off += snprintf(buf + off, len - off, "]");
+    g_seen_state.last_err = err;
+    g_seen_state.last_save_ms = now;
+    if (err == ESP_OK) {
+        g_seen_state.saves++;
+    } else {
+        g_seen_state.dirty = true;
+        ESP_LOGW(TAG, "Seen-before filter save failed: %s", esp_err_to_name(err));
+    }
 }
 
-// ========================= PACKET INJECTION FUNCTIONS =========================
+// ========================= RADIO GROUPS ===========================
+// Multi-BSSID and mesh APs advertise several BSSIDs from one radio: the MACs
+// differ in the first octet (locally administered variants) or the low
+// nibble of the last one, and the BSSIDs share a channel and RSSI. APs are
+// clustered on that key with a bounded open-addressing table (RADIO_PROBE
+// probes, so joins and leaves are O(1)); g_agg counts radios next to
+// BSSIDs. An AP that finds no free group counts as its own radio.
 
-static void craft_deauth_frame(uint8_t *frame, const uint8_t *target_mac, const uint8_t *ap_mac) {
-    frame[0] = 0xC0;
-    frame[1] = 0x00;
+#define RADIO_GROUPS    256     // power of two
+#define RADIO_PROBE     4
+#define RADIO_RSSI_DB   10
 
-    frame[2] = 0x00;
-    frame[3] = 0x00;
+typedef struct {
+    uint8_t  key[5];            // BSSID octets 1-4, high nibble of octet 5
+    uint8_t  channel;
+    int8_t   rssi;              // latest member RSSI
+    uint8_t  pad;
+    uint16_t members;           // 0 = free slot
+} radio_group_t;
 
-    memcpy(&frame[4],  target_mac, 6);
-    memcpy(&frame[10], ap_mac,     6);
-    memcpy(&frame[16], ap_mac,     6);
+static radio_group_t g_radios[RADIO_GROUPS];
 
-    frame[22] = 0x00;
-    frame[23] = 0x00;
+static void radio_key(const uint8_t bssid[6], uint8_t key[5]) {
+    memcpy(key, bssid + 1, 4);
+    key[4] = bssid[5] & 0xF0;
+}
 
-    frame[24] = 0x07;
-    frame[25] = 0x00;
+static void radio_count(uint8_t channel, int delta) {
+    g_agg.radio_total += delta;
+    if (channel <= 14) g_agg.radio_channel_counts[channel] += delta;
 }
 
-static void craft_disassoc_frame(uint8_t *frame, const uint8_t *target_mac, const uint8_t *ap_mac) {
-    frame[0] = 0xA0;
-    frame[1] = 0x00;
+// Caller holds g_ap_mutex.
+static void radio_join(int idx) {
+    ap_info_t *ap = &g_aps[idx];
+    uint8_t key[5];
+    radio_key(ap->bssid, key);
+
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 5; i++) h = (h ^ key[i]) * 16777619u;
+    h = (h ^ ap->channel) * 16777619u;
+
+    int free_slot = -1;
+    for (int i = 0; i < RADIO_PROBE; i++) {
+        int slot = (int)((h + i) & (RADIO_GROUPS - 1));
+        radio_group_t *g = &g_radios[slot];
+        if (!g->members) {
+            if (free_slot < 0) free_slot = slot;
+            continue;
+        }
+        if (g->channel == ap->channel && memcmp(g->key, key, 5) == 0 &&
+            abs(g->rssi - ap->rssi) <= RADIO_RSSI_DB) {
+            g->members++;
+            g->rssi = ap->rssi;
+            ap->radio = (int16_t)slot;
+            return;
+        }
+    }
 
-    frame[2] = 0x00;
-    frame[3] = 0x00;
+    if (free_slot >= 0) {
+        radio_group_t *g = &g_radios[free_slot];
+        memcpy(g->key, key, 5);
+        g->channel = ap->channel;
+        g->rssi = ap->rssi;
+        g->members = 1;
+        ap->radio = (int16_t)free_slot;
+    } else {
+        ap->radio = -1;
+    }
+    radio_count(ap->channel, +1);
+}
 
-    memcpy(&frame[4],  target_mac, 6);
-    memcpy(&frame[10], ap_mac,     6);
-    memcpy(&frame[16], ap_mac,     6);
+// Caller holds g_ap_mutex; must run before the AP's channel is changed.
+static void radio_leave(int idx) {
+    ap_info_t *ap = &g_aps[idx];
+    if (ap->radio >= 0) {
+        radio_group_t *g = &g_radios[ap->radio];
+        if (g->members && --g->members > 0) {
+            ap->radio = -1;
+            return;
+        }
+    }
+    radio_count(ap->channel, -1);
+    ap->radio = -1;
+}
 
-    frame[22] = 0x00;
-    frame[23] = 0x00;
+static void radio_touch(int idx) {
+    const ap_info_t *ap = &g_aps[idx];
+    if (ap->radio >= 0) g_radios[ap->radio].rssi = ap->rssi;
+}
 
-    frame[24] = 0x08;
-    frame[25] = 0x00;
+// ========================= AGGREGATES ===========================
+
+static ap_agg_entry_t agg_entry(const ap_info_t *ap) {
+    return (ap_agg_entry_t){
+        .authmode       = ap->authmode,
+        .channel        = ap->channel,
+        .classification = ap->classification,
+        .hidden         = ap->ssid[0] == '\0' || ap->ssid_resolved,
+        .resolved       = ap->ssid_resolved,
+        .weak           = ap->rssi < WEAK_SIGNAL_RSSI,
+        .returning      = ap->returning,
+    };
 }
 
-static void craft_probe_request(uint8_t *frame, size_t *len, const char *ssid) {
-    int idx = 0;
+// Adds (delta = +1) or removes (delta = -1) the AP in slot idx from g_agg and
+// the secondary indexes. Callers remove the old state before mutating an
+// entry and add the new state afterwards. Must be called with g_ap_mutex held.
+static void agg_account(int idx, int delta) {
+    ap_agg_entry_t e = agg_entry(&g_aps[idx]);
+    ap_agg_account(&g_agg, &g_idx, idx, &e, delta);
+}
 
-    frame[idx++] = 0x40;
-    frame[idx++] = 0x00;
+// window_ms == 0 returns the whole-table counters in O(1); otherwise only APs
+// seen within the window are counted by walking the head of the recency list.
+static void agg_snapshot(ap_aggregates_t *out, uint32_t window_ms) {
+    memset(out, 0, sizeof(*out));
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        if (window_ms == 0) {
+            *out = g_agg;
+        } else {
+            uint32_t now = now_ms();
+            uint32_t radio_seen[RADIO_GROUPS / 32] = {0};
+            for (int i = g_recent_head; i >= 0; i = g_aps[i].recent_next) {
+                const ap_info_t *ap = &g_aps[i];
+                if (now - ap->last_seen_ms > window_ms) break;
+                ap_agg_entry_t e = agg_entry(ap);
+                ap_agg_add(out, &e, +1);
+
+                if (ap->radio >= 0) {
+                    uint32_t bit = 1u << (ap->radio & 31);
+                    if (radio_seen[ap->radio >> 5] & bit) continue;
+                    radio_seen[ap->radio >> 5] |= bit;
+                }
+                out->radio_total++;
+                if (ap->channel <= 14) out->radio_channel_counts[ap->channel]++;
+            }
+        }
+        xSemaphoreGive(g_ap_mutex);
+    }
+}
 
-    frame[idx++] = 0x00;
-    frame[idx++] = 0x00;
+// ========================= RECENCY LIST ===========================
 
-    memset(&frame[idx], 0xFF, 6);
-    idx += 6;
+static void recent_unlink(int idx) {
+    ap_info_t *ap = &g_aps[idx];
+    if (ap->recent_prev >= 0) g_aps[ap->recent_prev].recent_next = ap->recent_next;
+    else g_recent_head = ap->recent_next;
+    if (ap->recent_next >= 0) g_aps[ap->recent_next].recent_prev = ap->recent_prev;
+    else g_recent_tail = ap->recent_prev;
+    ap->recent_prev = ap->recent_next = -1;
+}
 
-    frame[idx++] = 0x02;
-    for (int i = 1; i < 6; i++) {
-        frame[idx++] = esp_random() & 0xFF;
+static void recent_push_front(int idx) {
+    ap_info_t *ap = &g_aps[idx];
+    ap->recent_prev = -1;
+    ap->recent_next = g_recent_head;
+    if (g_recent_head >= 0) g_aps[g_recent_head].recent_prev = idx;
+    g_recent_head = idx;
+    if (g_recent_tail < 0) g_recent_tail = idx;
+}
+
+// ========================= HIDDEN SSID RESOLVER ===================
+// Hidden APs beacon an empty SSID, but answer directed probe requests from
+// their clients with the real one, and clients name it in (re)association
+// requests. Hidden BSSIDs in g_aps are watched in a small direct-mapped
+// set; the sniffer only hashes the BSSID of those frames and compares one
+// slot, so per-frame cost is constant and nothing is ever transmitted.
+// Found names are copied into g_aps later, under g_ap_mutex.
+
+#define HIDDEN_SLOTS    64      // power of two
+#define HIDDEN_STALE_MS 60000   // a waiting slot older than this may be taken
+
+typedef enum {
+    HIDDEN_FREE = 0,
+    HIDDEN_WAITING,
+    HIDDEN_FOUND
+} hidden_state_t;
+
+typedef struct {
+    uint8_t  bssid[6];
+    uint8_t  state;             // hidden_state_t
+    uint8_t  source;            // frame control byte that revealed the SSID
+    int16_t  ap_idx;            // g_aps slot hint, re-checked on apply
+    uint8_t  ssid[33];
+} hidden_slot_t;
+
+static DRAM_ATTR hidden_slot_t g_hidden[HIDDEN_SLOTS];
+static DRAM_ATTR volatile uint16_t g_hidden_waiting;
+static DRAM_ATTR volatile uint16_t g_hidden_found;
+static portMUX_TYPE g_hidden_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Caller holds g_ap_mutex. Called on insert and again on every sighting
+// while the AP is still hidden, so an AP that collided with another hidden
+// AP gets the slot once it frees up, or once the other AP has gone unseen
+// for HIDDEN_STALE_MS (out of range, so it can't be resolved anyway).
+static void hidden_watch(int idx) {
+    const ap_info_t *ap = &g_aps[idx];
+    hidden_slot_t *h = &g_hidden[hll_hash(ap->bssid) & (HIDDEN_SLOTS - 1)];
+    taskENTER_CRITICAL(&g_hidden_mux);
+    bool take = h->state == HIDDEN_FREE;
+    if (h->state == HIDDEN_WAITING && memcmp(h->bssid, ap->bssid, 6) != 0) {
+        int o = h->ap_idx;
+        take = o < 0 || o >= MAX_APS || !g_aps[o].in_use ||
+               !mac_equal(g_aps[o].bssid, h->bssid) ||
+               ap->last_seen_ms - g_aps[o].last_seen_ms > HIDDEN_STALE_MS;
+        if (take) g_hidden_waiting--;
     }
+    if (take) {
+        memcpy(h->bssid, ap->bssid, 6);
+        h->ap_idx = (int16_t)idx;
+        h->state = HIDDEN_WAITING;
+        g_hidden_waiting++;
+    }
+    taskEXIT_CRITICAL(&g_hidden_mux);
+}
 
-    memset(&frame[idx], 0xFF, 6);
-    idx += 6;
+// Caller holds g_ap_mutex; the AP is being evicted.
+static void hidden_unwatch(const uint8_t bssid[6]) {
+    hidden_slot_t *h = &g_hidden[hll_hash(bssid) & (HIDDEN_SLOTS - 1)];
+    taskENTER_CRITICAL(&g_hidden_mux);
+    if (h->state != HIDDEN_FREE && memcmp(h->bssid, bssid, 6) == 0) {
+        if (h->state == HIDDEN_WAITING) g_hidden_waiting--;
+        else                            g_hidden_found--;
+        h->state = HIDDEN_FREE;
+    }
+    taskEXIT_CRITICAL(&g_hidden_mux);
+}
 
-    frame[idx++] = 0x00;
-    frame[idx++] = 0x00;
+// Probe response (0x50), association request (0x00) or reassociation
+// request (0x20); hdr/len cover the MAC header onwards.
+IRAM_ATTR static void hidden_observe(const uint8_t *hdr, int len) {
+    if (!g_hidden_waiting) return;
 
-    frame[idx++] = 0x00;
-    uint8_t ssid_len = (uint8_t)strlen(ssid);
-    frame[idx++] = ssid_len;
-    memcpy(&frame[idx], ssid, ssid_len);
-    idx += ssid_len;
+    uint8_t fc = hdr[0];
+    int ie_off = fc == 0x50 ? 36 : fc == 0x00 ? 28 : 34;
+    // The SSID element comes first in all three frame bodies.
+    if (len < ie_off + 2 || hdr[ie_off] != 0) return;
+    uint8_t ssid_len = hdr[ie_off + 1];
+    if (ssid_len == 0 || ssid_len > 32 || ie_off + 2 + ssid_len > len) return;
+    const uint8_t *ssid = &hdr[ie_off + 2];
+    if (ssid[0] == 0) return;       // zero-filled, still hidden
+
+    const uint8_t *bssid = &hdr[16];
+    hidden_slot_t *h = &g_hidden[hll_hash(bssid) & (HIDDEN_SLOTS - 1)];
+    taskENTER_CRITICAL(&g_hidden_mux);
+    if (h->state == HIDDEN_WAITING && memcmp(h->bssid, bssid, 6) == 0) {
+        memcpy(h->ssid, ssid, ssid_len);
+        h->ssid[ssid_len] = 0;
+        h->source = fc;
+        h->state = HIDDEN_FOUND;
+        g_hidden_waiting--;
+        g_hidden_found++;
+    }
+    taskEXIT_CRITICAL(&g_hidden_mux);
+}
 
-    *len = idx;
+// Copies found names into g_aps. Caller holds g_ap_mutex.
+static void hidden_apply_locked(void) {
+    if (!g_hidden_found) return;
+
+    for (int i = 0; i < HIDDEN_SLOTS; i++) {
+        hidden_slot_t *h = &g_hidden[i];
+        if (h->state != HIDDEN_FOUND) continue;
+
+        uint8_t ssid[33];
+        uint8_t bssid[6];
+        int idx;
+        taskENTER_CRITICAL(&g_hidden_mux);
+        memcpy(ssid, h->ssid, sizeof(ssid));
+        memcpy(bssid, h->bssid, 6);
+        idx = h->ap_idx;
+        h->state = HIDDEN_FREE;
+        g_hidden_found--;
+        taskEXIT_CRITICAL(&g_hidden_mux);
+
+        if (idx < 0 || idx >= MAX_APS || !g_aps[idx].in_use || !mac_equal(g_aps[idx].bssid, bssid)) {
+            idx = find_ap_by_bssid(bssid);
+        }
+        if (idx < 0 || g_aps[idx].ssid[0]) continue;
+
+        ap_info_t *ap = &g_aps[idx];
+        agg_account(idx, -1);
+        sanitize_ssid(ap->ssid, ssid, sizeof(ap->ssid));
+        ap->ssid_resolved = true;
+        ap->classification = classify_ap(ap);
+        ap->modified_ms = g_ap_modified_ms = now_ms();
+        agg_account(idx, +1);
+        g_ap_changes++;
+
+        char bssid_str[18];
+        mac_to_str(bssid, bssid_str, sizeof(bssid_str));
+        ESP_LOGI(TAG, "Hidden SSID %s resolved: %s", bssid_str, ap->ssid);
+    }
 }
 
-// ========================= HTML UI =========================
+// From stats_task, so names appear without waiting for the next scan.
+static void hidden_apply(void) {
+    if (!g_hidden_found) return;
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(100)) != pdTRUE) return;
+    hidden_apply_locked();
+    xSemaphoreGive(g_ap_mutex);
+}
 
-static esp_err_t handler_api_aps(httpd_req_t *req) {
-    char *json_buf = malloc(JSON_BUF_SIZE);
-    if (!json_buf) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+// ========================= SCAN PROFILES ==========================
+// Named survey profiles replace the compile-time scan constants: sweep
+// interval, per-channel dwell, active/passive, channel set, sniffer frame
+// classes and table eviction policy. Up to PROFILE_MAX profiles live in NVS
+// next to the seen-before filter; the first three are built in and restored
+// if missing. Switching is live: wardrive_task and safe_scan_start() read
+// the active profile each time, the sniffer filter is reapplied on the spot
+// and a pending inter-sweep wait is cut short. Each profile keeps its own
+// discovery counters (new BSSIDs per minute of wardriving) so the numbers
+// can be compared on the same route.
+
+#define PROFILE_MAX         8
+#define PROFILE_NAME_LEN    12
+#define PROFILE_VERSION     1
+#define PROFILE_NVS_NAMESPACE "wardrive"
+#define PROFILE_NVS_KEY       "profiles"
+#define PROFILE_NVS_ACTIVE    "profile"
+
+#define SNIFF_CTRL          0x01
+#define SNIFF_DATA          0x02
+
+typedef enum {
+    EVICT_FIFO = 0,         // overwrite slots round-robin (insertion order)
+    EVICT_LRU,              // once full, replace the least recently seen AP
+    EVICT_COUNT
+} evict_policy_t;
+
+typedef struct {
+    char     name[PROFILE_NAME_LEN];
+    uint16_t interval_ms;   // pause between sweeps
+    uint16_t dwell_ms;      // per channel
+    uint16_t channel_mask;  // bit N = channel N, 0 = all
+    uint8_t  passive;
+    uint8_t  sniff;         // SNIFF_* frame classes besides management
+    uint8_t  evict;         // evict_policy_t
+    uint8_t  reserved[3];
+} scan_profile_t;
+
+typedef struct {
+    uint8_t        version;
+    uint8_t        count;
+    uint8_t        reserved[2];
+    scan_profile_t p[PROFILE_MAX];
+} profile_store_t;
+
+typedef struct {
+    uint32_t sweeps;
+    uint32_t active_ms;     // wardriving time spent under the profile
+    uint32_t new_aps;       // BSSIDs inserted into the table
+    uint32_t records;       // scan records merged
+} profile_stats_t;
+
+static const scan_profile_t k_builtin_profiles[] = {
+    { "walk",       SCAN_INTERVAL_MS, CHANNEL_DWELL_MS, 0, 0, SNIFF_CTRL | SNIFF_DATA, EVICT_FIFO, {0} },
+    { "drive",      1000,             50,               0, 0, 0,                       EVICT_LRU,  {0} },
+    { "stationary", 20000,            300,              0, 1, SNIFF_CTRL | SNIFF_DATA, EVICT_LRU,  {0} },
+};
+#define PROFILE_BUILTIN     (sizeof(k_builtin_profiles) / sizeof(k_builtin_profiles[0]))
+
+static const char *const k_evict_names[EVICT_COUNT] = { "fifo", "lru" };
+
+static profile_store_t g_profiles;
+static profile_stats_t g_profile_stats[PROFILE_MAX];
+static scan_profile_t  g_profile;           // copy of the active entry
+static uint8_t         g_profile_idx;
+static uint32_t        g_ap_inserts;        // under g_ap_mutex
+static uint32_t        g_ap_merges;
+static TaskHandle_t    g_wardrive_task;
+static portMUX_TYPE    g_profile_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static scan_profile_t profile_active(void) {
+    scan_profile_t p;
+    taskENTER_CRITICAL(&g_profile_mux);
+    p = g_profile;
+    taskEXIT_CRITICAL(&g_profile_mux);
+    return p;
+}
+
+static int profile_find(const char *name) {
+    for (int i = 0; i < g_profiles.count; i++) {
+        if (strncmp(g_profiles.p[i].name, name, PROFILE_NAME_LEN) == 0) return i;
     }
-    size_t off = 0;
-    off += snprintf(json_buf + off, JSON_BUF_SIZE - off, "[");
+    return -1;
+}
 
-    uint32_t now = now_ms();
+static void profile_save(void) {
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(PROFILE_NVS_NAMESPACE, NVS_READWRITE, &h);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(h, PROFILE_NVS_KEY, &g_profiles, sizeof(g_profiles));
+        if (err == ESP_OK) err = nvs_set_u8(h, PROFILE_NVS_ACTIVE, g_profile_idx);
+        if (err == ESP_OK) err = nvs_commit(h);
+        nvs_close(h);
+    }
+    if (err != ESP_OK) ESP_LOGW(TAG, "Scan profile save failed: %s", esp_err_to_name(err));
+}
 
-    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        bool first = true;
-        for (int i = 0; i < g_ap_count && off < JSON_BUF_SIZE - 512; i++) {
-            ap_info_t *ap = &g_aps[i];
-            if (!ap->in_use) continue;
+// Makes profile idx the active one. The sniffer filter changes immediately;
+// scan parameters apply from the next sweep.
+static void profile_activate(int idx) {
+    taskENTER_CRITICAL(&g_profile_mux);
+    g_profile_idx = (uint8_t)idx;
+    g_profile = g_profiles.p[idx];
+    taskEXIT_CRITICAL(&g_profile_mux);
 
-            if (!first) {
-                off += snprintf(json_buf + off, JSON_BUF_SIZE - off, ",");
-            }
-            first = false;
+    g_sniff_mask = ((g_profile.sniff & SNIFF_CTRL) ? WIFI_PROMIS_FILTER_MASK_CTRL : 0) |
+                   ((g_profile.sniff & SNIFF_DATA) ? WIFI_PROMIS_FILTER_MASK_DATA : 0);
+    update_promiscuous_filter();
+    if (g_wardrive_task) xTaskNotifyGive(g_wardrive_task);
+    ESP_LOGI(TAG, "Scan profile \"%s\": every %u ms, %u ms/channel %s",
+             g_profile.name, g_profile.interval_ms, g_profile.dwell_ms,
+             g_profile.passive ? "passive" : "active");
+}
 
-            char bssid_str[18];
-            mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
+static void profiles_load(void) {
+    nvs_handle_t h;
+    uint8_t active = 0;
+    size_t len = sizeof(g_profiles);
+    if (nvs_open(PROFILE_NVS_NAMESPACE, NVS_READONLY, &h) == ESP_OK) {
+        if (nvs_get_blob(h, PROFILE_NVS_KEY, &g_profiles, &len) != ESP_OK ||
+            len != sizeof(g_profiles) || g_profiles.version != PROFILE_VERSION ||
+            g_profiles.count > PROFILE_MAX) {
+            memset(&g_profiles, 0, sizeof(g_profiles));
+        }
+        nvs_get_u8(h, PROFILE_NVS_ACTIVE, &active);
+        nvs_close(h);
+    }
+    g_profiles.version = PROFILE_VERSION;
+    for (size_t i = 0; i < PROFILE_BUILTIN; i++) {
+        if (profile_find(k_builtin_profiles[i].name) < 0 && g_profiles.count < PROFILE_MAX) {
+            g_profiles.p[g_profiles.count++] = k_builtin_profiles[i];
+        }
+    }
+    for (int i = 0; i < g_profiles.count; i++) g_profiles.p[i].name[PROFILE_NAME_LEN - 1] = '\0';
+    profile_activate(active < g_profiles.count ? active : 0);
+}
 
-            uint32_t age = now - ap->last_seen_ms;
-
-            off += snprintf(json_buf + off, JSON_BUF_SIZE - off,
-                            "{\"ssid\":\"%s\",\"bssid\":\"%s\",\"rssi\":%d,"
-                            "\"rssi_min\":%d,\"rssi_max\":%d,\"channel\":%u,"
-                            "\"auth\":%u,\"auth_str\":\"%s\",\"seen\":%u,"
-                            "\"first_seen\":%lu,\"last_seen\":%lu,\"age_ms\":%lu}",
-                            ap->ssid[0] ? ap->ssid : "<hidden>",
-                            bssid_str,
-                            (int)ap->rssi,
-                            (int)ap->rssi_min,
-                            (int)ap->rssi_max,
-                            (unsigned)ap->channel,
-                            (unsigned)ap->authmode,
-                            auth_mode_to_str(ap->authmode),
-                            (unsigned)ap->seen_count,
-                            (unsigned long)ap->first_seen_ms,
-                            (unsigned long)ap->last_seen_ms,
-                            (unsigned long)age);
+// Slot for a new BSSID under the active eviction policy. Under LRU a full
+// table gives up the tail of the recency list; otherwise a free slot comes
+// from the insert cursor, the end of the table, or (after a partial
+// restore left holes) the live bitmap, all without walking g_aps. Caller
+// holds g_ap_mutex.
+static int profile_evict_slot(void) {
+    if (g_profile.evict == EVICT_LRU) {
+        if (g_agg.total >= MAX_APS && g_recent_tail >= 0) return g_recent_tail;
+        if (g_ap_insert_index < MAX_APS && !g_aps[g_ap_insert_index].in_use) {
+            return (int)g_ap_insert_index++;
         }
-        xSemaphoreGive(g_ap_mutex);
+        if (g_ap_count < MAX_APS) return g_ap_count;
+        int hole = ap_bitmap_first_clear(&g_idx.live, MAX_APS);
+        if (hole >= 0) return hole;
     }
+    return (int)(g_ap_insert_index++ % MAX_APS);
+}
 
-    off += snprintf(json_buf + off, JSON_BUF_SIZE - off, "]");
+// ========================= MOTION CADENCE =========================
+// Adapts the pause between background sweeps to how fast the client is
+// moving and how much each sweep still finds. Fixes pushed by the UI (with
+// the browser's speed/heading when it has them, otherwise speed derived
+// from successive fixes) set a base interval of one sweep per
+// g_cadence.spacing_m travelled; parked means max_ms. A sustained high or
+// low new-AP yield per sweep shortens or stretches that by a quarter / a
+// half. Changes are applied only when the target moves more than
+// CAD_HYST_PCT from the current interval, and the interval at most doubles
+// per decision. Above CAD_FAST_ON_CMS sweeps are restricted to 1/6/11 plus
+// the channels holding most of the table, with a full sweep every
+// CAD_FULL_EVERY sweeps and after a turn. Without a fresh fix the active
+// profile's interval is the base. Every change lands in a decision log, and
+// new APs / distance / time are tallied per speed band, separately for
+// adaptive and fixed cadence, so the yield per km can be compared.
+
+#define CAD_MIN_MS          500
+#define CAD_MAX_MS          30000
+#define CAD_SPACING_M       60      // Wi-Fi range is ~50-100 m from a car
+#define CAD_FIX_MAX_AGE_MS  15000
+#define CAD_FIX_MAX_ACC_M   100
+#define CAD_MAX_SPEED_CMS   7000    // faster segments are position glitches
+#define CAD_SEGMENT_MAX_MS  60000   // longer gaps re-anchor without odometry
+#define CAD_PARKED_CMS      50
+#define CAD_FAST_ON_CMS     1500    // ~54 km/h
+#define CAD_FAST_OFF_CMS    1100
+#define CAD_FAST_SHARE_PCT  10      // channels with this share stay in fast sweeps
+#define CAD_FULL_EVERY      4
+#define CAD_TURN_DEG        45
+#define CAD_HYST_PCT        25
+#define CAD_YIELD_HI_X100   200     // new APs per sweep, x100
+#define CAD_YIELD_LO_X100   20
+#define CAD_LOG             32
 
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t ret = httpd_resp_send(req, json_buf, off);
-    free(json_buf);
-    return ret;
+typedef enum {
+    SPEED_PARKED = 0,
+    SPEED_WALK,                 // < 3 m/s
+    SPEED_URBAN,                // < 15 m/s
+    SPEED_FAST,
+    SPEED_UNKNOWN,              // no fresh fix
+    SPEED_BANDS
+} speed_band_t;
+
+static const char *const k_speed_band_names[SPEED_BANDS] = {
+    "parked", "walk", "urban", "fast", "unknown"
+};
+
+typedef enum {
+    CAD_R_SPEED = 0,
+    CAD_R_NO_FIX,
+    CAD_R_YIELD_HIGH,
+    CAD_R_YIELD_LOW,
+    CAD_R_FAST,
+    CAD_R_FULL,
+    CAD_R_TURN,
+    CAD_R_COUNT
+} cad_reason_t;
+
+static const char *const k_cad_reason_names[CAD_R_COUNT] = {
+    "speed", "no_fix", "yield_high", "yield_low", "fast_channels", "all_channels", "turn"
+};
+
+// Position track; written from the HTTP side with g_ap_mutex held.
+typedef struct {
+    int32_t  anchor_lat_e7;     // last point that advanced the odometer
+    int32_t  anchor_lon_e7;
+    uint32_t anchor_ms;
+    uint16_t anchor_acc_m;
+    bool     anchored;
+    uint32_t fix_ms;            // newest fix
+    uint32_t speed_cms;
+    int16_t  heading_deg;       // -1 unknown
+    bool     speed_reported;    // from the client rather than derived
+    uint32_t odometer_m;
+    uint32_t rejected;          // implausible segments
+} motion_t;
+
+typedef struct {
+    uint32_t t_ms;
+    uint16_t speed_cms;
+    int16_t  heading_deg;
+    uint16_t yield_x100;
+    uint16_t interval_ms;
+    uint16_t channel_mask;
+    uint8_t  reason;
+} cad_decision_t;
+
+typedef struct {
+    uint32_t sweeps;
+    uint32_t time_ms;
+    uint32_t distance_m;
+    uint32_t new_aps;
+} cad_stats_t;
+
+// Decision state, owned by wardrive_task.
+typedef struct {
+    uint32_t interval_ms;       // 0 until the first decision
+    uint16_t next_mask;         // channels for the next sweep, 0 = profile's
+    bool     fast;
+    bool     turn_pending;
+    uint8_t  restricted;        // sweeps since the last full one
+    int16_t  last_heading;
+    uint32_t yield_x100;
+    uint32_t last_odometer_m;
+} cad_state_t;
+
+static motion_t g_motion = { .heading_deg = -1 };
+// Guarded by g_cadence_mutex. cadence_update copies what it needs, decides
+// on the copies and writes the result back, so the lock is only held for
+// the copies.
+static struct {
+    bool     enabled;
+    uint16_t min_ms;
+    uint16_t max_ms;
+    uint16_t spacing_m;
+    uint32_t epoch;             // bumped by POST /api/cadence
+    cad_state_t st;
+    cad_decision_t log[CAD_LOG];
+    uint16_t log_head;
+    uint16_t log_count;
+    cad_stats_t stats[2][SPEED_BANDS];      // [adaptive][band]
+} g_cadence = {
+    .enabled   = true,
+    .min_ms    = CAD_MIN_MS,
+    .max_ms    = CAD_MAX_MS,
+    .spacing_m = CAD_SPACING_M,
+    .st        = { .last_heading = -1 },
+};
+static SemaphoreHandle_t g_cadence_mutex = NULL;
+
+static uint32_t motion_distance_m(int32_t lat1, int32_t lon1, int32_t lat2, int32_t lon2) {
+    // Equirectangular is plenty for segments of a few hundred metres
+    const double k = M_PI / 180.0 / 1e7;
+    double mean_lat = (lat1 / 2.0 + lat2 / 2.0) * k;
+    double dx = (double)(lon2 - lon1) * k * cos(mean_lat);
+    double dy = (double)(lat2 - lat1) * k;
+    return (uint32_t)lround(6371000.0 * sqrt(dx * dx + dy * dy));
 }
 
-static esp_err_t handler_api_state(httpd_req_t *req) {
-    char buf[512];
-    g_stats.uptime_sec   = (uint32_t)(esp_timer_get_time() / 1000000ULL);
-    g_stats.free_heap    = esp_get_free_heap_size();
-    g_stats.min_free_heap = esp_get_minimum_free_heap_size();
+static speed_band_t speed_band(uint32_t speed_cms, bool fresh) {
+    if (!fresh)                       return SPEED_UNKNOWN;
+    if (speed_cms < CAD_PARKED_CMS)   return SPEED_PARKED;
+    if (speed_cms < 300)              return SPEED_WALK;
+    if (speed_cms < CAD_FAST_ON_CMS)  return SPEED_URBAN;
+    return SPEED_FAST;
+}
 
-    snprintf(buf, sizeof(buf),
-             "{\"wardrive\":%s,\"ap_count\":%d,\"total_scans\":%lu,"
-             "\"successful_scans\":%lu,\"failed_scans\":%lu,"
-             "\"uptime_sec\":%lu,\"free_heap\":%lu,\"min_free_heap\":%lu,"
-             "\"packets_sent\":%lu,\"handshake_listening\":%s,\"handshake_captured\":%lu}",
-             g_wardrive_on ? "true" : "false",
-             g_ap_count,
-             (unsigned long)g_stats.total_scans,
-             (unsigned long)g_stats.successful_scans,
-             (unsigned long)g_stats.failed_scans,
-             (unsigned long)g_stats.uptime_sec,
-             (unsigned long)g_stats.free_heap,
-             (unsigned long)g_stats.min_free_heap,
-             (unsigned long)g_packet_stats.packets_sent,
-             g_packet_stats.handshake_listening ? "true" : "false",
-             (unsigned long)g_packet_stats.handshake_captured);
+// Folds a fix into the track. speed_cms / heading_deg are -1 when the client
+// did not report them. Caller holds g_ap_mutex.
+static void motion_note_fix(int32_t lat_e7, int32_t lon_e7, uint16_t acc_m, uint32_t at_ms,
+                            int32_t speed_cms, int16_t heading_deg) {
+    motion_t *m = &g_motion;
+    // The UI resends its last fix with every poll; only newer ones count
+    if (m->fix_ms && (int32_t)(at_ms - m->fix_ms) < 500) return;
+    m->fix_ms = at_ms;
+    if (heading_deg >= 0) m->heading_deg = heading_deg;
+    m->speed_reported = speed_cms >= 0;
+    if (speed_cms >= 0) m->speed_cms = (uint32_t)speed_cms;
+    if (acc_m > CAD_FIX_MAX_ACC_M) return;
+
+    if (!m->anchored || at_ms - m->anchor_ms > CAD_SEGMENT_MAX_MS) {
+        m->anchor_lat_e7 = lat_e7;
+        m->anchor_lon_e7 = lon_e7;
+        m->anchor_ms = at_ms;
+        m->anchor_acc_m = acc_m;
+        m->anchored = true;
+        return;
+    }
 
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
+    uint32_t dt = at_ms - m->anchor_ms;
+    if (dt < 1000) return;
+    uint32_t d = motion_distance_m(m->anchor_lat_e7, m->anchor_lon_e7, lat_e7, lon_e7);
+    uint32_t cms = (uint32_t)((uint64_t)d * 100000 / dt);
+    if (cms > CAD_MAX_SPEED_CMS) {
+        m->rejected++;
+        return;
+    }
+    if (speed_cms < 0) m->speed_cms = cms;
+
+    // Movement inside the combined accuracy is jitter; keep the anchor so
+    // slow progress still accumulates.
+    if (d * 2 <= (uint32_t)m->anchor_acc_m + acc_m) return;
+    m->odometer_m += d;
+    m->anchor_lat_e7 = lat_e7;
+    m->anchor_lon_e7 = lon_e7;
+    m->anchor_ms = at_ms;
+    m->anchor_acc_m = acc_m;
 }
 
-static esp_err_t handler_api_channels(httpd_req_t *req) {
-    char buf[2048];
-    size_t off = 0;
-    int channel_count[14] = {0};
+static cad_decision_t cadence_decision(cad_reason_t reason, uint32_t speed_cms, int16_t heading,
+                                       const cad_state_t *s) {
+    return (cad_decision_t){
+        .t_ms         = now_ms(),
+        .speed_cms    = (uint16_t)(speed_cms > UINT16_MAX ? UINT16_MAX : speed_cms),
+        .heading_deg  = heading,
+        .yield_x100   = (uint16_t)(s->yield_x100 > UINT16_MAX ? UINT16_MAX : s->yield_x100),
+        .interval_ms  = (uint16_t)s->interval_ms,
+        .channel_mask = s->next_mask,
+        .reason       = (uint8_t)reason,
+    };
+}
+
+// Caller holds g_cadence_mutex.
+static void cadence_log(const cad_decision_t *d) {
+    g_cadence.log[g_cadence.log_head] = *d;
+    g_cadence.log_head = (g_cadence.log_head + 1) % CAD_LOG;
+    if (g_cadence.log_count < CAD_LOG) g_cadence.log_count++;
+}
+
+// 1/6/11 plus every channel holding CAD_FAST_SHARE_PCT of the live table,
+// limited to the profile's channels when it has a set.
+static uint16_t cadence_fast_mask(const uint32_t counts[15], uint32_t total, uint16_t profile_mask) {
+    uint16_t mask = (1u << 1) | (1u << 6) | (1u << 11);
+    for (int ch = 1; ch <= 13 && total; ch++) {
+        if (counts[ch] * 100 >= total * CAD_FAST_SHARE_PCT) mask |= 1u << ch;
+    }
+    if (profile_mask && (mask & profile_mask)) mask &= profile_mask;
+    else if (profile_mask) mask = profile_mask;
+    return mask;
+}
+
+// Channels for the next background sweep; 0 means the profile's set.
+// Called from wardrive_task, the only writer of next_mask.
+static uint16_t cadence_channels(void) {
+    return g_cadence.enabled ? g_cadence.st.next_mask : 0;
+}
 
+// Runs after each wardrive_task iteration; returns the pause before the next
+// sweep. new_aps / elapsed_ms describe the sweep that just finished.
+static uint32_t cadence_update(const scan_profile_t *p, bool swept, uint32_t new_aps,
+                               uint32_t elapsed_ms) {
+    uint32_t now = now_ms();
+    motion_t m = {0};
+    uint32_t counts[15] = {0};
+    uint32_t total = 0;
     if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        for (int i = 0; i < g_ap_count; i++) {
-            if (g_aps[i].in_use && g_aps[i].channel >= 1 && g_aps[i].channel <= 13) {
-                channel_count[g_aps[i].channel]++;
-            }
-        }
+        m = g_motion;
+        memcpy(counts, g_agg.channel_counts, sizeof(counts));
+        total = g_agg.total;
         xSemaphoreGive(g_ap_mutex);
     }
+    bool fresh = m.fix_ms && now - m.fix_ms < CAD_FIX_MAX_AGE_MS;
+    uint32_t speed = fresh ? m.speed_cms : 0;
+    int16_t heading = fresh ? m.heading_deg : -1;
+
+    bool adaptive;
+    uint16_t min_ms, max_ms, spacing_m;
+    uint32_t epoch;
+    cad_state_t c;
+    if (xSemaphoreTake(g_cadence_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) return p->interval_ms;
+    adaptive = g_cadence.enabled;
+    min_ms = g_cadence.min_ms;
+    max_ms = g_cadence.max_ms;
+    spacing_m = g_cadence.spacing_m;
+    epoch = g_cadence.epoch;
+    c = g_cadence.st;
+    xSemaphoreGive(g_cadence_mutex);
+
+    speed_band_t band = speed_band(speed, fresh);
+    cad_stats_t tally = {0};
+    cad_decision_t logs[3];
+    int n_logs = 0;
+    uint32_t pause;
+
+    uint32_t travelled = m.odometer_m - c.last_odometer_m;
+    c.last_odometer_m = m.odometer_m;
+    if (swept) {
+        tally.sweeps = 1;
+        tally.time_ms = elapsed_ms;
+        tally.distance_m = travelled;
+        tally.new_aps = new_aps;
+        uint32_t y = new_aps * 100;
+        c.yield_x100 = c.yield_x100 ? (c.yield_x100 * 3 + y) / 4 : y;
+    }
 
-    off += snprintf(buf + off, sizeof(buf) - off, "[");
-    bool first = true;
-    for (int ch = 1; ch <= 13; ch++) {
-        if (!first) off += snprintf(buf + off, sizeof(buf) - off, ",");
-        first = false;
-        off += snprintf(buf + off, sizeof(buf) - off,
-                        "{\"ch\":%d,\"count\":%d}", ch, channel_count[ch]);
+    if (!adaptive || !swept) {
+        if (!adaptive) {
+            c.interval_ms = 0;
+            c.next_mask = 0;
+        }
+        pause = adaptive && c.interval_ms ? c.interval_ms : p->interval_ms;
+    } else {
+        // Interval target
+        cad_reason_t reason = fresh ? CAD_R_SPEED : CAD_R_NO_FIX;
+        uint32_t target;
+        if (!fresh)                        target = p->interval_ms;
+        else if (speed < CAD_PARKED_CMS)   target = max_ms;
+        else                               target = (uint32_t)spacing_m * 100000 / speed;
+        if (c.yield_x100 >= CAD_YIELD_HI_X100) {
+            target = target * 3 / 4;
+            reason = CAD_R_YIELD_HIGH;
+        } else if (c.yield_x100 <= CAD_YIELD_LO_X100) {
+            target = target * 3 / 2;
+            reason = CAD_R_YIELD_LOW;
+        }
+        if (target < min_ms) target = min_ms;
+        if (target > max_ms) target = max_ms;
+
+        uint32_t cur = c.interval_ms;
+        bool changed = false;
+        if (!cur) {
+            c.interval_ms = target;
+            changed = true;
+        } else if (target * 100 < cur * (100 - CAD_HYST_PCT) || target * 100 > cur * (100 + CAD_HYST_PCT)) {
+            c.interval_ms = target > cur * 2 ? cur * 2 : target;
+            changed = true;
+        }
+
+        // Channel coverage, with its own hysteresis band
+        bool was_fast = c.fast;
+        if (!c.fast && fresh && speed >= CAD_FAST_ON_CMS) c.fast = true;
+        if (c.fast && (!fresh || speed <= CAD_FAST_OFF_CMS)) c.fast = false;
+        if (c.fast && heading >= 0 && c.last_heading >= 0) {
+            int diff = abs(heading - c.last_heading) % 360;
+            if (diff > 180) diff = 360 - diff;
+            if (diff > CAD_TURN_DEG) c.turn_pending = true;
+        }
+        if (heading >= 0) c.last_heading = heading;
+
+        uint16_t mask = 0;
+        bool turn = c.turn_pending;
+        if (c.fast && !turn && ++c.restricted % CAD_FULL_EVERY != 0) {
+            mask = cadence_fast_mask(counts, total, p->channel_mask);
+        } else {
+            c.restricted = 0;
+            c.turn_pending = false;
+        }
+        c.next_mask = mask;
+
+        if (changed)           logs[n_logs++] = cadence_decision(reason, speed, heading, &c);
+        if (turn)              logs[n_logs++] = cadence_decision(CAD_R_TURN, speed, heading, &c);
+        if (c.fast != was_fast) {
+            logs[n_logs++] = cadence_decision(c.fast ? CAD_R_FAST : CAD_R_FULL, speed, heading, &c);
+        }
+        pause = c.interval_ms;
     }
-    off += snprintf(buf + off, sizeof(buf) - off, "]");
+    if (swept) tally.time_ms += pause;
+
+    // A settings change or stats reset in between makes this decision stale;
+    // drop it and let the next sweep decide from the new settings.
+    if (xSemaphoreTake(g_cadence_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        if (g_cadence.epoch == epoch) {
+            g_cadence.st = c;
+            cad_stats_t *st = &g_cadence.stats[adaptive][band];
+            st->sweeps += tally.sweeps;
+            st->time_ms += tally.time_ms;
+            st->distance_m += tally.distance_m;
+            st->new_aps += tally.new_aps;
+            for (int i = 0; i < n_logs; i++) cadence_log(&logs[i]);
+        }
+        xSemaphoreGive(g_cadence_mutex);
+    }
+    return pause;
+}
 
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, buf, off);
+// ========================= SPATIAL GRID ===========================
+// Coverage heatmap kept on the device. The phone posts its GPS fixes
+// (POST /api/gps/fix, or lat/lon/acc on the dashboard poll) and every scan
+// batch merged while a fresh, accurate fix is held is folded into the
+// fixed-size cell containing it. Cells are GRID_CELL_E7 (0.001 deg, ~110 m
+// north-south) squares in a bounded open-addressing table; when a probe
+// window is full the least recently updated cell in it is replaced, so the
+// table follows the current route. All grid state is under g_ap_mutex.
+
+#define GRID_CELLS          256     // power of two
+#define GRID_PROBE          8
+#define GRID_CELL_E7        10000   // cell size in 1e-7 degrees
+#define GRID_HLL_P          4
+#define GRID_FIX_MAX_AGE_MS 15000
+#define GRID_FIX_MAX_ACC_M  100     // coarser fixes (network fallback) are not binned
+
+typedef enum {
+    GRID_AUTH_OPEN = 0,
+    GRID_AUTH_WEP,
+    GRID_AUTH_WPA,              // WPA/WPA2 personal
+    GRID_AUTH_WPA3,             // WPA3 and WPA2/WPA3 transition
+    GRID_AUTH_ENTERPRISE,
+    GRID_AUTH_OTHER,
+    GRID_AUTH_COUNT
+} grid_auth_t;
+
+static const char *const k_grid_auth_names[GRID_AUTH_COUNT] = {
+    "open", "wep", "wpa", "wpa3", "enterprise", "other"
+};
+
+typedef struct {
+    int32_t  lat_idx;           // floor(lat_e7 / GRID_CELL_E7)
+    int32_t  lon_idx;
+    uint32_t last_ms;
+    uint16_t samples;           // scan batches merged in this cell
+    int8_t   best_rssi;
+    bool     in_use;
+    uint8_t  aps[1 << GRID_HLL_P];          // distinct BSSIDs (HLL registers)
+    uint16_t auth[GRID_AUTH_COUNT];         // observations per auth class
+} grid_cell_t;
+
+typedef struct {
+    int32_t  lat_e7;
+    int32_t  lon_e7;
+    uint32_t at_ms;             // device time the fix was taken
+    uint16_t acc_m;
+    bool     valid;
+} gps_fix_t;
+
+static grid_cell_t g_grid[GRID_CELLS];
+static gps_fix_t g_gps_fix;
+static uint32_t g_grid_evictions;
+
+static grid_auth_t grid_auth_class(uint8_t authmode) {
+    switch (authmode) {
+        case WIFI_AUTH_OPEN:            return GRID_AUTH_OPEN;
+        case WIFI_AUTH_WEP:             return GRID_AUTH_WEP;
+        case WIFI_AUTH_WPA_PSK:
+        case WIFI_AUTH_WPA2_PSK:
+        case WIFI_AUTH_WPA_WPA2_PSK:    return GRID_AUTH_WPA;
+        case WIFI_AUTH_WPA3_PSK:
+        case WIFI_AUTH_WPA2_WPA3_PSK:   return GRID_AUTH_WPA3;
+        case WIFI_AUTH_WPA2_ENTERPRISE: return GRID_AUTH_ENTERPRISE;
+        default:                        return GRID_AUTH_OTHER;
+    }
 }
 
-static esp_err_t handler_api_wifi_status(httpd_req_t *req) {
-    wifi_config_t cfg = {0};
-    esp_wifi_get_config(WIFI_IF_STA, &cfg);
+// Floor division, so cells do not straddle the equator / meridian.
+static int32_t grid_index(int32_t e7) {
+    return e7 >= 0 ? e7 / GRID_CELL_E7 : -((-e7 + GRID_CELL_E7 - 1) / GRID_CELL_E7);
+}
 
-    char buf[256];
-    snprintf(buf, sizeof(buf),
-             "{\"connected\":%s,\"ssid\":\"%s\",\"ip\":\"%s\"}",
-             g_sta_connected ? "true" : "false",
-             g_sta_ssid[0] ? g_sta_ssid : (char *)cfg.sta.ssid,
-             g_sta_ip);
+// Cell for the current fix, creating it if needed; NULL when there is no
+// usable fix. Caller holds g_ap_mutex.
+static grid_cell_t *grid_cell_for_fix(uint32_t now) {
+    const gps_fix_t *fix = &g_gps_fix;
+    if (!fix->valid || fix->acc_m > GRID_FIX_MAX_ACC_M ||
+        now - fix->at_ms > GRID_FIX_MAX_AGE_MS) {
+        return NULL;
+    }
 
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
+    int32_t lat_idx = grid_index(fix->lat_e7);
+    int32_t lon_idx = grid_index(fix->lon_e7);
+    uint32_t h = hll_fmix32((uint32_t)lat_idx * 0x9e3779b1u ^ (uint32_t)lon_idx);
+
+    grid_cell_t *victim = NULL;
+    for (int i = 0; i < GRID_PROBE; i++) {
+        grid_cell_t *c = &g_grid[(h + i) & (GRID_CELLS - 1)];
+        if (c->in_use && c->lat_idx == lat_idx && c->lon_idx == lon_idx) return c;
+        if (!c->in_use) {
+            if (!victim || victim->in_use) victim = c;
+        } else if (!victim || (victim->in_use && now - c->last_ms > now - victim->last_ms)) {
+            victim = c;
+        }
+    }
+
+    if (victim->in_use) g_grid_evictions++;
+    memset(victim, 0, sizeof(*victim));
+    victim->in_use = true;
+    victim->lat_idx = lat_idx;
+    victim->lon_idx = lon_idx;
+    victim->best_rssi = -128;
+    return victim;
 }
 
-static esp_err_t handler_api_wifi_scan(httpd_req_t *req) {
-    wifi_scan_config_t scan_cfg = {
-        .ssid        = NULL,
-        .bssid       = NULL,
-        .channel     = 0,
-        .show_hidden = true,
-        .scan_type   = WIFI_SCAN_TYPE_ACTIVE,
-    };
+static void grid_add(grid_cell_t *cell, const wifi_ap_record_t *r) {
+    hll_add(cell->aps, GRID_HLL_P, hll_hash(r->bssid));
+    if (r->rssi > cell->best_rssi) cell->best_rssi = r->rssi;
+    uint16_t *n = &cell->auth[grid_auth_class((uint8_t)r->authmode)];
+    if (*n < UINT16_MAX) (*n)++;
+}
 
-    esp_wifi_set_promiscuous(false);
-    esp_err_t err = esp_wifi_scan_start(&scan_cfg, true);
-    esp_wifi_set_promiscuous(true);
+static void gps_fix_set(int32_t lat_e7, int32_t lon_e7, uint32_t acc_m, uint32_t age_ms,
+                        int32_t speed_cms, int16_t heading_deg) {
+    uint32_t now = now_ms();
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) return;
+    g_gps_fix.lat_e7 = lat_e7;
+    g_gps_fix.lon_e7 = lon_e7;
+    g_gps_fix.acc_m  = (uint16_t)(acc_m > UINT16_MAX ? UINT16_MAX : acc_m);
+    g_gps_fix.at_ms  = now - age_ms;
+    g_gps_fix.valid  = true;
+    motion_note_fix(lat_e7, lon_e7, g_gps_fix.acc_m, g_gps_fix.at_ms, speed_cms, heading_deg);
+    xSemaphoreGive(g_ap_mutex);
+}
+
+// Parses "?<key>=<decimal degrees>" into 1e-7 degrees.
+static bool query_coord_e7(httpd_req_t *req, const char *key, int32_t limit_deg, int32_t *out) {
+    char query[QUERY_MAX];
+    char val[24];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) return false;
+    if (httpd_query_key_value(query, key, val, sizeof(val)) != ESP_OK) return false;
+
+    char *end;
+    double deg = strtod(val, &end);
+    if (end == val || deg < -limit_deg || deg > limit_deg) return false;
+    *out = (int32_t)lround(deg * 1e7);
+    return true;
+}
+
+// Records lat/lon/acc[/fix_age_ms/speed/heading] from the query if present;
+// speed in m/s and heading in degrees as the browser reports them. Returns
+// false when no valid fix was supplied.
+static bool gps_fix_from_query(httpd_req_t *req) {
+    int32_t lat, lon;
+    if (!query_coord_e7(req, "lat", 90, &lat) || !query_coord_e7(req, "lon", 180, &lon)) {
+        return false;
+    }
+    char query[QUERY_MAX];
+    char val[16];
+    uint32_t acc = UINT16_MAX, fix_age_ms = 0;
+    int32_t speed_cms = -1;
+    int16_t heading = -1;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "acc", val, sizeof(val)) == ESP_OK) {
+            acc = (uint32_t)strtoul(val, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "fix_age_ms", val, sizeof(val)) == ESP_OK) {
+            fix_age_ms = (uint32_t)strtoul(val, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "speed", val, sizeof(val)) == ESP_OK) {
+            double v = strtod(val, NULL);
+            if (v >= 0 && v * 100 <= CAD_MAX_SPEED_CMS) speed_cms = (int32_t)lround(v * 100);
+        }
+        if (httpd_query_key_value(query, "heading", val, sizeof(val)) == ESP_OK) {
+            double v = strtod(val, NULL);
+            if (v >= 0 && v < 360) heading = (int16_t)v;
+        }
+    }
+    gps_fix_set(lat, lon, acc, fix_age_ms, speed_cms, heading);
+    return true;
+}
+
+// Folds one scan record into g_aps. Must be called with g_ap_mutex held.
+static void merge_scan_record(const wifi_ap_record_t *r, uint32_t now) {
+    unique_note(r->bssid, r->primary, r->authmode);
+
+    int idx = find_ap_by_bssid(r->bssid);
+
+    g_ap_merges++;
+    if (idx < 0) {
+        idx = profile_evict_slot();
+        g_ap_inserts++;
+        ap_info_t *dst = &g_aps[idx];
+        if (dst->in_use) {
+            agg_account(idx, -1);
+            radio_leave(idx);
+            recent_unlink(idx);
+            if (!dst->ssid[0]) hidden_unwatch(dst->bssid);
+        }
+        memset(dst, 0, sizeof(*dst));
+        dst->returning = seen_probe(r->bssid, true);
+
+        dst->in_use = true;
+        memcpy(dst->bssid, r->bssid, 6);
+        sanitize_ssid(dst->ssid, r->ssid, sizeof(dst->ssid));
+
+        dst->rssi          = r->rssi;
+        dst->rssi_min      = r->rssi;
+        dst->rssi_max      = r->rssi;
+        dst->channel       = r->primary;
+        dst->authmode      = (uint8_t)r->authmode;
+        dst->first_seen_ms = now;
+        dst->last_seen_ms  = now;
+        dst->seen_count    = 1;
+        ap_merge_caps(dst, r);
+        dst->classification = classify_ap(dst);
+        agg_account(idx, +1);
+        radio_join(idx);
+        recent_push_front(idx);
+        if (!dst->ssid[0]) hidden_watch(idx);
+
+        if (g_ap_count < MAX_APS) {
+            g_ap_count++;
+        }
+    } else {
+        ap_info_t *dst = &g_aps[idx];
+        bool regroup = dst->channel != r->primary;
+        agg_account(idx, -1);
+        if (regroup) radio_leave(idx);
+        dst->rssi = r->rssi;
+        if (r->rssi < dst->rssi_min) dst->rssi_min = r->rssi;
+        if (r->rssi > dst->rssi_max) dst->rssi_max = r->rssi;
+        dst->channel       = r->primary;
+        dst->authmode      = (uint8_t)r->authmode;
+        dst->last_seen_ms  = now;
+        if (dst->seen_count < 0xFFFF) dst->seen_count++;
+        ap_merge_caps(dst, r);
+
+        dst->classification = classify_ap(dst);
+        agg_account(idx, +1);
+        if (regroup) radio_join(idx);
+        else         radio_touch(idx);
+        recent_unlink(idx);
+        recent_push_front(idx);
+        if (!dst->ssid[0]) hidden_watch(idx);
+    }
+    if (idx >= g_ap_count) {
+        g_ap_count = idx + 1;
+    }
+    g_ap_changes++;
+}
+
+// ========================= WARM START SNAPSHOT ====================
+// A reboot mid-drive used to start from an empty table. The AP table is
+// written to its own NVS partition through the ap_snap encoding: one blob
+// per chunk of SNAP_CHUNK_SLOTS slots with what identifies its APs, and one
+// small "vol" blob with what changes on every sighting (RSSI, seen count,
+// age) for the whole table. A chunk is only rewritten when its hash differs
+// from what flash holds, which takes an insert, eviction, rename or a new
+// channel, auth or caps in it; re-seen APs only change the vol blob, so a
+// parked or circling device rewrites next to no chunks. Nothing is written
+// while the table is unchanged since the last save. A small header with the
+// hashes and counters is written last.
+//
+// A chunk and its vol section are packed under the same hold of g_ap_mutex,
+// so their records pair up; a chunk whose bytes are unchanged has the same
+// records in the same order. At boot snap_restore() loads the chunks that
+// match the header, rebuilds the derived state (aggregates, indexes,
+// radios, recency list) and moves the clock past the snapshot time.
+// Downtime itself is unknown, so ages restart from the moment the snapshot
+// was taken.
+
+#define SNAP_PARTITION      "snap"
+#define SNAP_NAMESPACE      "aps"
+#define SNAP_VERSION        2
+#define SNAP_CHUNK_SLOTS    AP_SNAP_CHUNK_SLOTS
+#define SNAP_CHUNKS         (MAX_APS / SNAP_CHUNK_SLOTS)
+#define SNAP_INTERVAL_MS    60000
+#define SNAP_REBOOT_GAP_MS  1000
+
+typedef struct {
+    uint8_t  version;
+    uint8_t  chunks;
+    uint16_t max_aps;
+    uint32_t now_ms;
+    uint32_t generation;
+    uint32_t ap_count;
+    uint32_t insert_index;
+    uint32_t total_scans;
+    uint32_t successful_scans;
+    uint32_t failed_scans;
+    uint32_t vol_hash;
+    uint32_t chunk_hash[SNAP_CHUNKS];   // 0 = empty chunk
+} snap_hdr_t;
+
+static struct {
+    uint32_t chunk_hash[SNAP_CHUNKS];   // what flash holds
+    uint32_t vol_hash;
+    uint32_t saved_changes;             // g_ap_changes covered by flash
+    uint32_t bytes;                     // packed size of the last snapshot
+    uint32_t write_bytes;               // bytes actually rewritten last time
+    uint32_t write_chunks;
+    uint32_t write_us;
+    uint32_t restore_us;
+    uint32_t restored_aps;
+    uint32_t saves;
+    uint32_t skipped;                   // table unchanged since the last save
+    uint32_t last_save_ms;
+    esp_err_t last_err;
+    bool     ready;
+    volatile bool save_req;
+} g_snap;
+
+static uint8_t g_snap_buf[SNAP_CHUNK_SLOTS * AP_SNAP_REC_MAX];
+static uint8_t g_snap_vol[SNAP_CHUNKS * AP_SNAP_VOL_SECTION];
+static int16_t g_snap_order[MAX_APS];
+
+// Packs the in-use slots of one chunk into buf and their sighting state
+// into vol. Caller holds g_ap_mutex.
+static size_t snap_pack_chunk(int chunk, uint8_t *buf, uint8_t *vol, uint32_t now) {
+    ap_snap_writer_t w;
+    ap_snap_begin(&w, buf, vol, now);
+    for (int slot = chunk * SNAP_CHUNK_SLOTS; slot < (chunk + 1) * SNAP_CHUNK_SLOTS; slot++) {
+        const ap_info_t *ap = &g_aps[slot];
+        if (!ap->in_use) continue;
+        ap_snap_entry_t e = {
+            .slot          = (uint8_t)(slot % SNAP_CHUNK_SLOTS),
+            .channel       = ap->channel,
+            .authmode      = ap->authmode,
+            .caps          = ap->caps,
+            .beacon_int    = ap->beacon_int,
+            .first_seen_ms = ap->first_seen_ms,
+            .returning     = ap->returning,
+            .resolved      = ap->ssid_resolved,
+            .rssi          = ap->rssi,
+            .rssi_min      = ap->rssi_min,
+            .rssi_max      = ap->rssi_max,
+            .seen_count    = ap->seen_count,
+            .last_seen_ms  = ap->last_seen_ms,
+        };
+        memcpy(e.bssid, ap->bssid, 6);
+        memcpy(e.ssid, ap->ssid, sizeof(e.ssid));
+        memcpy(e.country, ap->country, 2);
+        ap_snap_put(&w, &e);
+    }
+    return w.len;
+}
+
+// Unpacks one verified chunk into g_aps. vol is the chunk's vol section, or
+// NULL if the vol blob was lost. Caller holds g_ap_mutex.
+static int snap_unpack_chunk(int chunk, const uint8_t *buf, size_t len,
+                             const uint8_t *vol, uint32_t now) {
+    int restored = 0;
+    ap_snap_reader_t rd;
+    ap_snap_entry_t e;
+    ap_snap_reader_init(&rd, buf, len, vol, now);
+    while (ap_snap_next(&rd, &e)) {
+        // A slot reused between packing two chunks can leave a BSSID twice.
+        int slot = chunk * SNAP_CHUNK_SLOTS + e.slot;
+        if (g_aps[slot].in_use || find_ap_by_bssid(e.bssid) >= 0) continue;
+
+        ap_info_t *ap = &g_aps[slot];
+        memset(ap, 0, sizeof(*ap));
+        ap->in_use        = true;
+        memcpy(ap->bssid, e.bssid, 6);
+        memcpy(ap->ssid, e.ssid, sizeof(ap->ssid));
+        ap->rssi          = e.rssi;
+        ap->rssi_min      = e.rssi_min;
+        ap->rssi_max      = e.rssi_max;
+        ap->channel       = e.channel;
+        ap->authmode      = e.authmode;
+        ap->seen_count    = e.seen_count;
+        ap->first_seen_ms = e.first_seen_ms;
+        ap->last_seen_ms  = e.last_seen_ms;
+        ap->caps          = e.caps;
+        memcpy(ap->country, e.country, 2);
+        ap->beacon_int    = e.beacon_int;
+        ap->returning     = e.returning;
+        ap->ssid_resolved = e.resolved;
+        ap->recent_prev   = ap->recent_next = -1;
+        ap->classification = classify_ap(ap);
+
+        agg_account(slot, +1);
+        radio_join(slot);
+        if (!ap->ssid[0]) hidden_watch(slot);
+        if (slot >= g_ap_count) g_ap_count = slot + 1;
+        restored++;
+    }
+    return restored;
+}
+
+// Called from app_main before wifi_init() and start_webserver().
+static void snap_restore(void) {
+    int64_t start = esp_timer_get_time();
 
+    esp_err_t err = nvs_flash_init_partition(SNAP_PARTITION);
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase_partition(SNAP_PARTITION);
+        err = nvs_flash_init_partition(SNAP_PARTITION);
+    }
     if (err != ESP_OK) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "scan failed");
-        return err;
+        g_snap.last_err = err;
+        ESP_LOGW(TAG, "Snapshot partition unavailable: %s", esp_err_to_name(err));
+        return;
     }
+    g_snap.ready = true;
 
-    uint16_t num = 0;
-    esp_wifi_scan_get_ap_num(&num);
-    if (num == 0) {
-        httpd_resp_set_type(req, "application/json");
-        return httpd_resp_send(req, "[]", HTTPD_RESP_USE_STRLEN);
+    nvs_handle_t h;
+    if (nvs_open_from_partition(SNAP_PARTITION, SNAP_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return;
+
+    snap_hdr_t hdr;
+    size_t len = sizeof(hdr);
+    if (nvs_get_blob(h, "hdr", &hdr, &len) != ESP_OK || len != sizeof(hdr) ||
+        hdr.version != SNAP_VERSION || hdr.chunks != SNAP_CHUNKS || hdr.max_aps != MAX_APS) {
+        nvs_close(h);
+        return;
+    }
+
+    g_now_offset_ms = hdr.now_ms + SNAP_REBOOT_GAP_MS - (uint32_t)(esp_timer_get_time() / 1000ULL);
+
+    // A lost vol blob only costs the RSSI, seen counts and ages.
+    const uint8_t *vol_sec[SNAP_CHUNKS] = {0};
+    size_t vol_len = sizeof(g_snap_vol);
+    if (nvs_get_blob(h, "vol", g_snap_vol, &vol_len) == ESP_OK &&
+        ap_snap_hash(g_snap_vol, vol_len) == hdr.vol_hash &&
+        ap_snap_vol_split(g_snap_vol, vol_len, vol_sec, SNAP_CHUNKS)) {
+        g_snap.vol_hash = hdr.vol_hash;
+        g_snap.bytes += vol_len;
+    } else {
+        memset(vol_sec, 0, sizeof(vol_sec));
     }
 
-    wifi_ap_record_t *records = calloc(num, sizeof(wifi_ap_record_t));
-    if (!records) {
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "oom");
-        return ESP_ERR_NO_MEM;
-    }
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        nvs_close(h);
+        return;
+    }
+
+    int restored = 0;
+    for (int c = 0; c < SNAP_CHUNKS; c++) {
+        if (!hdr.chunk_hash[c]) continue;
+        char key[8];
+        snprintf(key, sizeof(key), "c%02d", c);
+        len = sizeof(g_snap_buf);
+        if (nvs_get_blob(h, key, g_snap_buf, &len) != ESP_OK ||
+            ap_snap_hash(g_snap_buf, len) != hdr.chunk_hash[c]) {
+            continue;   // torn write; that chunk is lost, the rest is fine
+        }
+        restored += snap_unpack_chunk(c, g_snap_buf, len, vol_sec[c], hdr.now_ms);
+        g_snap.chunk_hash[c] = hdr.chunk_hash[c];
+        g_snap.bytes += len;
+    }
+
+    // Rebuild the recency list oldest first.
+    int n = 0;
+    for (int i = 0; i < g_ap_count; i++) {
+        if (!g_aps[i].in_use) continue;
+        int j = n++;
+        while (j > 0 && g_aps[g_snap_order[j - 1]].last_seen_ms > g_aps[i].last_seen_ms) {
+            g_snap_order[j] = g_snap_order[j - 1];
+            j--;
+        }
+        g_snap_order[j] = (int16_t)i;
+    }
+    for (int i = 0; i < n; i++) recent_push_front(g_snap_order[i]);
+
+    if (hdr.ap_count > (uint32_t)g_ap_count && hdr.ap_count <= MAX_APS) g_ap_count = (int)hdr.ap_count;
+    g_ap_insert_index    = hdr.insert_index;
+    g_ap_generation      = hdr.generation + 1;   // clients resync
+    g_stats.total_scans      = hdr.total_scans;
+    g_stats.successful_scans = hdr.successful_scans;
+    g_stats.failed_scans     = hdr.failed_scans;
+    g_snap.saved_changes     = g_ap_changes;     // flash matches the table
+    xSemaphoreGive(g_ap_mutex);
+    nvs_close(h);
+
+    g_snap.restored_aps = restored;
+    g_snap.restore_us = (uint32_t)(esp_timer_get_time() - start);
+    ESP_LOGI(TAG, "Warm start: %d APs from %lu byte snapshot in %lu us",
+             restored, (unsigned long)g_snap.bytes, (unsigned long)g_snap.restore_us);
+}
+
+// Writes one blob unless flash already holds the same bytes; an empty blob
+// removes the key.
+static esp_err_t snap_write_blob(nvs_handle_t h, const char *key, const uint8_t *buf,
+                                 size_t len, uint32_t hash, uint32_t *held) {
+    if (hash == *held) return ESP_OK;
+    esp_err_t err;
+    if (len) {
+        err = nvs_set_blob(h, key, buf, len);
+    } else {
+        err = nvs_erase_key(h, key);
+        if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+    }
+    if (err == ESP_OK) {
+        *held = hash;
+        g_snap.write_bytes += len;
+    }
+    return err;
+}
+
+// From wardrive_task every SNAP_INTERVAL_MS, or sooner on request. Skipped
+// while the table is unchanged; otherwise only the blobs whose bytes
+// changed are rewritten.
+static void snap_save(void) {
+    uint32_t now = now_ms();
+    if (!g_snap.ready) return;
+    if (!g_snap.save_req && now - g_snap.last_save_ms < SNAP_INTERVAL_MS) return;
+    g_snap.save_req = false;
+    g_snap.last_save_ms = now;
+    if (g_ap_changes == g_snap.saved_changes) {
+        g_snap.skipped++;
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    nvs_handle_t h;
+    esp_err_t err = nvs_open_from_partition(SNAP_PARTITION, SNAP_NAMESPACE, NVS_READWRITE, &h);
+    if (err != ESP_OK) {
+        g_snap.last_err = err;
+        return;
+    }
+
+    snap_hdr_t hdr = {
+        .version = SNAP_VERSION,
+        .chunks  = SNAP_CHUNKS,
+        .max_aps = MAX_APS,
+    };
+    uint32_t total = 0, chunks = 0, changes = 0;
+    size_t vol_len = 0;
+    g_snap.write_bytes = 0;
+
+    for (int c = 0; c < SNAP_CHUNKS && err == ESP_OK; c++) {
+        if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+        if (c == 0) {
+            changes              = g_ap_changes;
+            hdr.now_ms           = now_ms();
+            hdr.generation       = g_ap_generation;
+            hdr.ap_count         = g_ap_count;
+            hdr.insert_index     = g_ap_insert_index;
+            hdr.total_scans      = g_stats.total_scans;
+            hdr.successful_scans = g_stats.successful_scans;
+            hdr.failed_scans     = g_stats.failed_scans;
+        }
+        size_t len = snap_pack_chunk(c, g_snap_buf, g_snap_vol + vol_len, hdr.now_ms);
+        xSemaphoreGive(g_ap_mutex);
+        vol_len += ap_snap_vol_size(g_snap_vol + vol_len);
+
+        uint32_t hash = ap_snap_hash(g_snap_buf, len);
+        hdr.chunk_hash[c] = hash;
+        total += len;
+        if (hash == g_snap.chunk_hash[c]) continue;
+
+        char key[8];
+        snprintf(key, sizeof(key), "c%02d", c);
+        err = snap_write_blob(h, key, g_snap_buf, len, hash, &g_snap.chunk_hash[c]);
+        if (err == ESP_OK) chunks++;
+    }
+
+    if (err == ESP_OK) {
+        hdr.vol_hash = ap_snap_hash(g_snap_vol, vol_len);
+        total += vol_len;
+        err = snap_write_blob(h, "vol", g_snap_vol, vol_len, hdr.vol_hash, &g_snap.vol_hash);
+    }
+    if (err == ESP_OK) err = nvs_set_blob(h, "hdr", &hdr, sizeof(hdr));
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+
+    g_snap.last_err = err;
+    if (err != ESP_OK) {
+        // Unknown what made it to flash; rewrite everything next time.
+        memset(g_snap.chunk_hash, 0xFF, sizeof(g_snap.chunk_hash));
+        g_snap.vol_hash = 0xFFFFFFFF;
+        ESP_LOGW(TAG, "Snapshot save failed: %s", esp_err_to_name(err));
+        return;
+    }
+    g_snap.saved_changes = changes;
+    g_snap.bytes        = total;
+    g_snap.write_chunks = chunks;
+    g_snap.write_us     = (uint32_t)(esp_timer_get_time() - start);
+    g_snap.saves++;
+}
+
+// Records are popped from the driver one at a time straight into the merge,
+// so a scan costs no heap allocation regardless of how many APs it found.
+static void update_ap_list_from_scan(void) {
+    uint16_t num = 0;
+    esp_wifi_scan_get_ap_num(&num);
+
+    if (num == 0) {
+        ESP_LOGW(TAG, "No APs found in scan");
+        return;
+    }
+
+    uint32_t now = now_ms();
+    int merged = 0;
+    int32_t held = (int32_t)(num * sizeof(wifi_ap_record_t));
+    mem_note(MEM_SCAN_RECORDS, held);
+
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        grid_cell_t *cell = grid_cell_for_fix(now);
+        wifi_ap_record_t r;
+        while (esp_wifi_scan_get_ap_record(&r) == ESP_OK) {
+            merge_scan_record(&r, now);
+            if (cell) grid_add(cell, &r);
+            merged++;
+        }
+        if (cell) {
+            cell->last_ms = now;
+            if (cell->samples < UINT16_MAX) cell->samples++;
+        }
+        hidden_apply_locked();
+
+        xSemaphoreGive(g_ap_mutex);
+        ESP_LOGI(TAG, "AP list updated: %d total APs, %d in this scan", g_ap_count, merged);
+    } else {
+        esp_wifi_clear_ap_list();
+    }
+    mem_note(MEM_SCAN_RECORDS, -held);
+}
+
+// ========================= SAFE SCAN WRAPPER ===========================
+
+// A full sweep keeps the radio off the SoftAP channel for well over a second,
+// which connected phones see as a stall. SCAN_MODE_SLICED splits the sweep
+// into groups of slice_channels, lets the driver hop home for home_dwell_ms
+// between channels inside a group, and parks on the home channel for
+// slice_gap_ms between groups.
+
+#define SCAN_CHANNEL_MAX        13
+#define SCAN_SLICE_DEFAULT      3
+#define SCAN_SLICE_GAP_MS       300
+#define SCAN_HOME_DWELL_MS      60
+#define SCAN_EWMA_SHIFT         3     // EWMA weight 1/8
+
+typedef enum {
+    SCAN_MODE_FULL = 0,
+    SCAN_MODE_SLICED,
+    SCAN_MODE_COUNT
+} scan_mode_t;
+
+typedef struct {
+    scan_mode_t mode;
+    uint8_t     slice_channels;
+    uint16_t    slice_gap_ms;
+    uint8_t     home_dwell_ms;
+} scan_sched_t;
+
+typedef struct {
+    uint32_t sweeps;
+    uint32_t last_sweep_ms;     // first slice start to last slice end
+    uint32_t avg_sweep_ms;
+    uint32_t max_away_ms;       // longest single esp_wifi_scan_start()
+    uint32_t rtt_samples;       // UI round trips reported by clients
+    uint32_t rtt_avg_ms;
+    uint32_t rtt_max_ms;
+} scan_mode_metrics_t;
+
+static scan_sched_t g_scan_sched = {
+    .mode           = SCAN_MODE_SLICED,
+    .slice_channels = SCAN_SLICE_DEFAULT,
+    .slice_gap_ms   = SCAN_SLICE_GAP_MS,
+    .home_dwell_ms  = SCAN_HOME_DWELL_MS,
+};
+static scan_mode_metrics_t g_scan_metrics[SCAN_MODE_COUNT];
+
+static const char *scan_mode_str(scan_mode_t mode) {
+    return mode == SCAN_MODE_SLICED ? "sliced" : "full";
+}
+
+static uint32_t ewma_u32(uint32_t avg, uint32_t sample, uint32_t n) {
+    if (n <= 1) return sample;
+    return avg - (avg >> SCAN_EWMA_SHIFT) + (sample >> SCAN_EWMA_SHIFT);
+}
+
+// Called with the round trip a client measured for its previous request.
+static void scan_metrics_note_rtt(uint32_t rtt_ms) {
+    scan_mode_metrics_t *m = &g_scan_metrics[g_scan_sched.mode];
+    m->rtt_samples++;
+    m->rtt_avg_ms = ewma_u32(m->rtt_avg_ms, rtt_ms, m->rtt_samples);
+    if (rtt_ms > m->rtt_max_ms) m->rtt_max_ms = rtt_ms;
+}
+
+// Microseconds the sniffer was off for scans; wraps, consumers use deltas.
+static volatile uint32_t g_scan_off_us = 0;
+
+// Held from esp_wifi_scan_start() until the driver's record list has been
+// drained, so background sweeps, /api/scan/once and /api/wifi/scan never
+// start a scan over one in progress or pop each other's records.
+static SemaphoreHandle_t g_scan_mutex = NULL;
+#define SCAN_LOCK_WAIT_MS  15000    // covers a full sliced sweep
+
+// channel_mask uses bit N for channel N; 0 scans every channel.
+// Caller holds g_scan_mutex until the results are drained.
+static esp_err_t safe_scan_start(uint16_t channel_mask, uint8_t home_dwell_ms)
+{
+    int64_t t0 = esp_timer_get_time();
+    scan_profile_t prof = profile_active();
+
+    // Temporarily disable promiscuous mode during scan
+    esp_wifi_set_promiscuous(false);
+
+    wifi_scan_config_t scan_cfg = {
+        .ssid = NULL,
+        .bssid = NULL,
+        .channel = 0,
+        .show_hidden = true,
+        .scan_type = prof.passive ? WIFI_SCAN_TYPE_PASSIVE : WIFI_SCAN_TYPE_ACTIVE,
+        .home_chan_dwell_time = home_dwell_ms,
+        .channel_bitmap.ghz_2_channels = channel_mask,
+    };
+    if (prof.passive) {
+        scan_cfg.scan_time.passive = prof.dwell_ms;
+    } else {
+        scan_cfg.scan_time.active.min = prof.dwell_ms;
+        scan_cfg.scan_time.active.max = prof.dwell_ms;
+    }
+
+    esp_err_t err = esp_wifi_scan_start(&scan_cfg, true);
+    
+    // Re-enable promiscuous mode after scan completes
+    esp_wifi_set_promiscuous(true);
+
+    g_scan_off_us += (uint32_t)(esp_timer_get_time() - t0);
+    return err;
+}
+
+// Runs one complete sweep in the configured mode, merging results after each
+// slice. Returns the first error seen, or ESP_ERR_TIMEOUT if another sweep
+// held the scanner too long; a sweep aborted because wardriving was switched
+// off mid-way is not counted in the metrics.
+static esp_err_t scan_run_sweep(bool background) {
+    if (xSemaphoreTake(g_scan_mutex, pdMS_TO_TICKS(SCAN_LOCK_WAIT_MS)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    scan_sched_t sched = g_scan_sched;
+    uint16_t channels = (background && cadence_channels()) ? cadence_channels()
+                                                           : profile_active().channel_mask;
+    channels &= ((1u << SCAN_CHANNEL_MAX) - 1) << 1;
+    scan_mode_metrics_t *m = &g_scan_metrics[sched.mode];
+    uint8_t slice = sched.mode == SCAN_MODE_SLICED ? sched.slice_channels : SCAN_CHANNEL_MAX;
+    uint8_t dwell = sched.mode == SCAN_MODE_SLICED ? sched.home_dwell_ms : 0;
+    esp_err_t first_err = ESP_OK;
+    uint32_t start = now_ms();
+    bool aborted = false;
+
+    for (int ch = 1; ch <= SCAN_CHANNEL_MAX; ch += slice) {
+        if (background && !g_wardrive_on) {
+            aborted = true;
+            break;
+        }
+
+        uint16_t mask = 0;
+        if (slice < SCAN_CHANNEL_MAX) {
+            for (int c = ch; c < ch + slice && c <= SCAN_CHANNEL_MAX; c++) mask |= 1u << c;
+            if (channels) {
+                mask &= channels;
+                if (!mask) continue;    // nothing in this slice for the profile
+            }
+        } else {
+            mask = channels;
+        }
+
+        uint32_t t0 = now_ms();
+        esp_err_t err = safe_scan_start(mask, dwell);
+        uint32_t away = now_ms() - t0;
+        if (away > m->max_away_ms) m->max_away_ms = away;
+
+        if (err == ESP_OK) {
+            update_ap_list_from_scan();
+        } else if (first_err == ESP_OK) {
+            first_err = err;
+        }
+
+        if (ch + slice <= SCAN_CHANNEL_MAX) {
+            vTaskDelay(pdMS_TO_TICKS(sched.slice_gap_ms));
+        }
+    }
+
+    if (!aborted) {
+        m->sweeps++;
+        m->last_sweep_ms = now_ms() - start;
+        m->avg_sweep_ms = ewma_u32(m->avg_sweep_ms, m->last_sweep_ms, m->sweeps);
+    }
+    xSemaphoreGive(g_scan_mutex);
+    return first_err;
+}
+
+static esp_err_t send_scan_busy(httpd_req_t *req) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", "2");
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"error\":\"scan in progress\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+
+// ========================= AIRTIME =========================
+// The sniffer adds each frame's estimated on-air time (preamble plus payload
+// at the received PHY rate) to per-channel, per-category counters. Once a
+// second stats_task turns the deltas into utilization: busy time divided by
+// the time the sniffer was actually listening on that channel. Only the
+// channel the radio is parked on can be observed; scans run with the
+// sniffer off and are subtracted from the listening time.
+
+#define AIRTIME_CHANNELS   (SCAN_CHANNEL_MAX + 1)   // index 0 = unknown
+#define AIRTIME_STALE_MS   10000
+#define STATS_PERIOD_MS    1000
+
+typedef enum {
+    AIR_MGMT = 0,
+    AIR_CTRL,
+    AIR_DATA,
+    AIR_CATS
+} air_cat_t;
+
+typedef struct {
+    uint64_t busy_us[AIR_CATS];
+    uint64_t observed_us;
+    uint32_t frames;
+    uint16_t last_pct_x10;      // utilization over the last second
+    uint16_t avg_pct_x10;       // EWMA, weight 1/8
+    uint32_t last_observed_ms;
+} airtime_channel_t;
+
+// Written only by the sniffer callback; wrap-safe deltas are taken by stats_task.
+static DRAM_ATTR uint32_t g_air_busy_us[AIRTIME_CHANNELS][AIR_CATS];
+static DRAM_ATTR uint32_t g_air_frames[AIRTIME_CHANNELS];
+
+static airtime_channel_t g_airtime[AIRTIME_CHANNELS];
+static portMUX_TYPE      g_airtime_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// PHY rates in 100 kbit/s. Legacy codes follow rx_ctrl.rate (4 is unused);
+// HT is MCS 0-7 at 20 MHz with long GI.
+static const DRAM_ATTR uint16_t k_legacy_rate_100k[16] = {
+    10, 20, 55, 110, 10, 20, 55, 110, 480, 240, 120, 60, 540, 360, 180, 90
+};
+static const DRAM_ATTR uint16_t k_ht_rate_100k[8] = {
+    65, 130, 195, 260, 390, 520, 585, 650
+};
+
+static inline IRAM_ATTR void airtime_account(const wifi_pkt_rx_ctrl_t *rx, wifi_promiscuous_pkt_type_t type) {
+    if (type > WIFI_PKT_DATA) return;
+
+    uint32_t rate, preamble;
+    if (rx->sig_mode == 0) {
+        rate = k_legacy_rate_100k[rx->rate & 0x0F];
+        preamble = rx->rate < 4 ? 192 : rx->rate < 8 ? 96 : 20;
+    } else {
+        rate = k_ht_rate_100k[rx->mcs & 0x07];
+        if (rx->cwb) rate <<= 1;
+        if (rx->sgi) rate += rate / 9;
+        preamble = 36;
+    }
+
+    uint8_t ch = rx->channel <= SCAN_CHANNEL_MAX ? rx->channel : 0;
+    uint32_t us = preamble + ((uint32_t)rx->sig_len * 80) / rate;
+    __atomic_fetch_add(&g_air_busy_us[ch][type], us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_air_frames[ch], 1, __ATOMIC_RELAXED);
+}
+
+// Copies the per-channel stats for readers outside stats_task.
+static void airtime_snapshot(airtime_channel_t out[AIRTIME_CHANNELS]) {
+    taskENTER_CRITICAL(&g_airtime_mux);
+    memcpy(out, g_airtime, sizeof(g_airtime));
+    taskEXIT_CRITICAL(&g_airtime_mux);
+}
+
+// Utilization of one channel in tenths of a percent, or -1 if the sniffer
+// has not listened there recently.
+static int airtime_util_x10(const airtime_channel_t *a, uint32_t now) {
+    if (!a->last_observed_ms || now - a->last_observed_ms > AIRTIME_STALE_MS) return -1;
+    return a->avg_pct_x10;
+}
+
+static void airtime_sample(uint32_t elapsed_us) {
+    static uint32_t prev_busy[AIRTIME_CHANNELS][AIR_CATS];
+    static uint32_t prev_frames[AIRTIME_CHANNELS];
+    static uint32_t prev_scan_off_us;
+
+    uint32_t scan_off = g_scan_off_us;
+    uint32_t off_us = scan_off - prev_scan_off_us;
+    prev_scan_off_us = scan_off;
+    uint32_t listen_us = off_us < elapsed_us ? elapsed_us - off_us : 0;
+
+    uint8_t home = 0;
+    wifi_second_chan_t second;
+    if (esp_wifi_get_channel(&home, &second) != ESP_OK || home > SCAN_CHANNEL_MAX) home = 0;
+
+    uint32_t now = now_ms();
+    taskENTER_CRITICAL(&g_airtime_mux);
+    for (int ch = 0; ch < AIRTIME_CHANNELS; ch++) {
+        airtime_channel_t *a = &g_airtime[ch];
+        uint32_t busy = 0;
+        for (int c = 0; c < AIR_CATS; c++) {
+            uint32_t cur = __atomic_load_n(&g_air_busy_us[ch][c], __ATOMIC_RELAXED);
+            uint32_t d = cur - prev_busy[ch][c];
+            prev_busy[ch][c] = cur;
+            a->busy_us[c] += d;
+            busy += d;
+        }
+        uint32_t frames = __atomic_load_n(&g_air_frames[ch], __ATOMIC_RELAXED);
+        a->frames += frames - prev_frames[ch];
+        prev_frames[ch] = frames;
+
+        if (ch == home && ch != 0 && listen_us > 0) {
+            uint32_t pct = (uint32_t)(((uint64_t)busy * 1000) / listen_us);
+            if (pct > 1000) pct = 1000;
+            a->avg_pct_x10 = a->last_observed_ms && now - a->last_observed_ms <= AIRTIME_STALE_MS
+                           ? (uint16_t)(a->avg_pct_x10 - (a->avg_pct_x10 >> 3) + (pct >> 3))
+                           : (uint16_t)pct;
+            a->last_pct_x10 = (uint16_t)pct;
+            a->observed_us += listen_us;
+            a->last_observed_ms = now;
+        }
+    }
+    taskEXIT_CRITICAL(&g_airtime_mux);
+}
+
+// ========================= FRAME STATS =========================
+// Every sniffed frame bumps a counter indexed by type/subtype and channel.
+// The table is statically allocated (DRAM, safe to touch from the sniffer
+// callback) and updated with relaxed atomics; stats_task folds it into a
+// per-second ring so the UI can chart beacon density, probe storms and
+// frame rates over the last FRAME_HIST_SECONDS.
+
+#define FRAME_KINDS          48      // 3 types x 16 subtypes; extension frames ignored
+#define FRAME_HIST_SECONDS   120
+
+static DRAM_ATTR uint32_t g_frame_counts[FRAME_KINDS][AIRTIME_CHANNELS];
+
+typedef struct {
+    uint16_t per_sec[FRAME_HIST_SECONDS][FRAME_KINDS];
+    uint32_t seq;                       // seconds written so far
+    uint32_t end_ms;                    // time of the newest bucket
+    uint32_t channel_rate[AIRTIME_CHANNELS];   // frames in the last second
+} frame_hist_t;
+
+static frame_hist_t g_frame_hist;
+static portMUX_TYPE g_frame_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline IRAM_ATTR void frame_stats_count(uint8_t fc, uint8_t channel) {
+    uint8_t type = (fc >> 2) & 0x03;
+    if (type == 3) return;
+    uint8_t ch = channel <= SCAN_CHANNEL_MAX ? channel : 0;
+    __atomic_fetch_add(&g_frame_counts[(type << 4) | (fc >> 4)][ch], 1, __ATOMIC_RELAXED);
+}
+
+static const char *frame_kind_name(int kind) {
+    static const char *const mgmt[16] = {
+        "assoc_req", "assoc_resp", "reassoc_req", "reassoc_resp", "probe_req",
+        "probe_resp", "timing_adv", NULL, "beacon", "atim", "disassoc", "auth",
+        "deauth", "action", "action_noack", NULL
+    };
+    static const char *const ctrl[16] = {
+        NULL, NULL, "trigger", NULL, "bf_report_poll", "ndp_announce", NULL,
+        "control_wrapper", "block_ack_req", "block_ack", "ps_poll", "rts", "cts",
+        "ack", "cf_end", "cf_end_ack"
+    };
+    static const char *const data[16] = {
+        "data", NULL, NULL, NULL, "null", NULL, NULL, NULL, "qos_data", NULL,
+        NULL, NULL, "qos_null", NULL, NULL, NULL
+    };
+    const char *const *names = kind < 16 ? mgmt : kind < 32 ? ctrl : data;
+    return names[kind & 0x0F];
+}
+
+static const char *frame_type_name(int kind) {
+    return kind < 16 ? "mgmt" : kind < 32 ? "ctrl" : "data";
+}
+
+static void frame_stats_sample(void) {
+    static uint32_t prev_kind[FRAME_KINDS];
+    static uint32_t prev_ch[AIRTIME_CHANNELS];
+    uint32_t ch_total[AIRTIME_CHANNELS] = {0};
+    uint16_t bucket[FRAME_KINDS];
+
+    for (int k = 0; k < FRAME_KINDS; k++) {
+        uint32_t total = 0;
+        for (int ch = 0; ch < AIRTIME_CHANNELS; ch++) {
+            uint32_t v = __atomic_load_n(&g_frame_counts[k][ch], __ATOMIC_RELAXED);
+            total += v;
+            ch_total[ch] += v;
+        }
+        uint32_t d = total - prev_kind[k];
+        prev_kind[k] = total;
+        bucket[k] = d > UINT16_MAX ? UINT16_MAX : (uint16_t)d;
+    }
+
+    taskENTER_CRITICAL(&g_frame_mux);
+    frame_hist_t *h = &g_frame_hist;
+    memcpy(h->per_sec[h->seq % FRAME_HIST_SECONDS], bucket, sizeof(bucket));
+    h->seq++;
+    h->end_ms = now_ms();
+    for (int ch = 0; ch < AIRTIME_CHANNELS; ch++) {
+        h->channel_rate[ch] = ch_total[ch] - prev_ch[ch];
+        prev_ch[ch] = ch_total[ch];
+    }
+    taskEXIT_CRITICAL(&g_frame_mux);
+}
+
+// Copies the newest `seconds` buckets of one frame kind, oldest first, for
+// history ending at sequence end_seq. Returns false if they were overwritten.
+static bool frame_hist_series(int kind, uint32_t end_seq, int seconds, uint16_t *out) {
+    bool ok;
+    taskENTER_CRITICAL(&g_frame_mux);
+    ok = g_frame_hist.seq - end_seq + seconds <= FRAME_HIST_SECONDS;
+    if (ok) {
+        for (int i = 0; i < seconds; i++) {
+            uint32_t seq = end_seq - seconds + i;
+            out[i] = g_frame_hist.per_sec[seq % FRAME_HIST_SECONDS][kind];
+        }
+    }
+    taskEXIT_CRITICAL(&g_frame_mux);
+    return ok;
+}
+
+// ========================= TASK STATS =============================
+// Per-task CPU share and stack headroom from FreeRTOS run-time stats
+// (needs CONFIG_FREERTOS_USE_TRACE_FACILITY and
+// CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS), sampled every TASK_SAMPLE_MS by
+// stats_task. Each sample also lands in a short history ring together with
+// heap and scan activity, so CPU or heap spikes can be lined up with scans.
+
+#define TASK_MAX            24
+#define TASK_SAMPLE_MS      5000
+#define TASK_HISTORY        60      // 5 minutes
+
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+#define TASK_RUNTIME_STATS  1
+#else
+#define TASK_RUNTIME_STATS  0
+#endif
+
+typedef struct {
+    TaskHandle_t handle;
+    char     name[configMAX_TASK_NAME_LEN];
+    uint32_t last_runtime;
+    uint32_t stack_free_min;        // bytes
+    uint16_t cpu_x10;               // share of the last sample period
+    uint8_t  prio;
+    uint8_t  state;
+    bool     seen;
+} task_acct_t;
+
+typedef struct {
+    uint32_t t_ms;
+    uint32_t free_heap;
+    uint32_t largest_block;
+    uint16_t busy_x10;              // 100% minus idle
+    uint16_t top_x10;
+    char     top[configMAX_TASK_NAME_LEN];
+    uint8_t  scans;                 // scans started in the period
+    uint8_t  scan_off_pct;          // share of the period spent off-channel
+} task_sample_t;
+
+// Published by stats_task, guarded by g_task_mutex.
+static task_acct_t g_task_acct[TASK_MAX];
+static uint16_t g_task_busy_x10;
+static struct {
+    task_sample_t s[TASK_HISTORY];
+    uint16_t head;                  // next write
+    uint16_t count;
+} g_task_hist;
+static SemaphoreHandle_t g_task_mutex = NULL;
+
+static const char *task_state_str(uint8_t state) {
+    switch (state) {
+        case eRunning:   return "running";
+        case eReady:     return "ready";
+        case eBlocked:   return "blocked";
+        case eSuspended: return "suspended";
+        case eDeleted:   return "deleted";
+        default:         return "unknown";
+    }
+}
+
+static void task_stats_sample(void) {
+    static uint32_t last_total;
+    static uint32_t last_scans;
+    static uint32_t last_off_us;
+    static uint32_t last_ms;
+
+    task_sample_t smp = {0};
+    smp.t_ms = now_ms();
+    smp.free_heap = esp_get_free_heap_size();
+    smp.largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    uint32_t scans = g_stats.total_scans;
+    uint32_t off_us = g_scan_off_us;
+    uint32_t period_ms = smp.t_ms - last_ms;
+    smp.scans = (uint8_t)((scans - last_scans) > 255 ? 255 : scans - last_scans);
+    if (last_ms && period_ms) {
+        uint32_t pct = (off_us - last_off_us) / 10 / period_ms;
+        smp.scan_off_pct = (uint8_t)(pct > 100 ? 100 : pct);
+    }
+    last_scans = scans;
+    last_off_us = off_us;
+    last_ms = smp.t_ms;
+
+#if TASK_RUNTIME_STATS
+    static TaskStatus_t status[TASK_MAX];
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t n = uxTaskGetSystemState(status, TASK_MAX, &total);
+    uint32_t dt = (uint32_t)total - last_total;
+    last_total = (uint32_t)total;
+    uint32_t idle_x10 = 0;
+
+    // Accounting runs on stats_task's own table; readers get a copy.
+    static task_acct_t work[TASK_MAX];
+    for (int i = 0; i < TASK_MAX; i++) work[i].seen = false;
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *t = &status[i];
+        task_acct_t *a = NULL;
+        task_acct_t *free_slot = NULL;
+        for (int j = 0; j < TASK_MAX; j++) {
+            if (work[j].handle == t->xHandle) { a = &work[j]; break; }
+            if (!work[j].handle && !free_slot) free_slot = &work[j];
+        }
+        if (!a) {
+            if (!free_slot) continue;
+            a = free_slot;
+            memset(a, 0, sizeof(*a));
+            a->handle = t->xHandle;
+            a->last_runtime = (uint32_t)t->ulRunTimeCounter;
+            strncpy(a->name, t->pcTaskName, sizeof(a->name) - 1);
+        }
+        uint32_t ran = (uint32_t)t->ulRunTimeCounter - a->last_runtime;
+        a->last_runtime = (uint32_t)t->ulRunTimeCounter;
+        a->cpu_x10 = dt ? (uint16_t)((uint64_t)ran * 1000 / dt) : 0;
+        a->stack_free_min = t->usStackHighWaterMark * sizeof(StackType_t);
+        a->prio = (uint8_t)t->uxCurrentPriority;
+        a->state = (uint8_t)t->eCurrentState;
+        a->seen = true;
+
+        if (strncmp(a->name, "IDLE", 4) == 0) {
+            idle_x10 += a->cpu_x10;
+        } else if (a->cpu_x10 > smp.top_x10) {
+            smp.top_x10 = a->cpu_x10;
+            memcpy(smp.top, a->name, sizeof(smp.top));
+        }
+    }
+    for (int i = 0; i < TASK_MAX; i++) {
+        if (work[i].handle && !work[i].seen) work[i].handle = NULL;
+    }
+    smp.busy_x10 = (uint16_t)(idle_x10 >= 1000 ? 0 : 1000 - idle_x10);
+    if (xSemaphoreTake(g_task_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        memcpy(g_task_acct, work, sizeof(g_task_acct));
+        if (dt) g_task_busy_x10 = smp.busy_x10;
+        xSemaphoreGive(g_task_mutex);
+    }
+    if (!dt) return;                // first call only primes the counters
+#else
+    (void)last_total;
+#endif
+
+    if (xSemaphoreTake(g_task_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        g_task_hist.s[g_task_hist.head] = smp;
+        g_task_hist.head = (g_task_hist.head + 1) % TASK_HISTORY;
+        if (g_task_hist.count < TASK_HISTORY) g_task_hist.count++;
+        xSemaphoreGive(g_task_mutex);
+    }
+}
+
+// ========================= STATS TASK =========================
+
+static void stats_task(void *arg) {
+    TickType_t last_wake = xTaskGetTickCount();
+    int64_t last_us = esp_timer_get_time();
+    uint32_t ticks = 0;
+
+    while (1) {
+        xTaskDelayUntil(&last_wake, pdMS_TO_TICKS(STATS_PERIOD_MS));
+        int64_t now_us = esp_timer_get_time();
+        airtime_sample((uint32_t)(now_us - last_us));
+        frame_stats_sample();
+        client_load_sample();
+        hidden_apply();
+        if (++ticks % (TASK_SAMPLE_MS / STATS_PERIOD_MS) == 0) task_stats_sample();
+        last_us = now_us;
+    }
+}
+
+
+// ========================= RESPONSE STREAM =========================
+
+#define STREAM_BUF_SIZE   2048
+#define STREAM_COPY_BATCH 8
+#define RESP_POOL_BUFS    3
+#define RESP_POOL_WAIT_MS 3000
+
+// Response buffers are reserved at boot and leased per request instead of
+// malloc'd, so handlers cannot fragment the heap. When all are out, API
+// workers wait for one to come back (up to RESP_POOL_WAIT_MS). The httpd task
+// serves every connection, so there it fails fast with 503 + Retry-After,
+// like api_dispatch does when the workers are busy.
+typedef struct {
+    uint32_t leases;
+    uint32_t in_use;
+    uint32_t high_water;
+    uint32_t waits;
+    uint32_t timeouts;
+    uint32_t rejected;      // pool empty on the httpd task
+} resp_pool_stats_t;
+
+static bool on_api_worker(void);
+
+static char              g_resp_pool[RESP_POOL_BUFS][STREAM_BUF_SIZE];
+static bool              g_resp_pool_busy[RESP_POOL_BUFS];
+static SemaphoreHandle_t g_resp_pool_sem  = NULL;
+static SemaphoreHandle_t g_resp_pool_lock = NULL;
+static resp_pool_stats_t g_resp_pool_stats = {0};
+
+static void resp_pool_init(void) {
+    g_resp_pool_sem  = xSemaphoreCreateCounting(RESP_POOL_BUFS, RESP_POOL_BUFS);
+    g_resp_pool_lock = xSemaphoreCreateMutex();
+}
+
+// Bumps one g_resp_pool_stats counter under g_resp_pool_lock.
+static void resp_pool_count(uint32_t *counter) {
+    xSemaphoreTake(g_resp_pool_lock, portMAX_DELAY);
+    (*counter)++;
+    xSemaphoreGive(g_resp_pool_lock);
+}
+
+static char *resp_buf_lease(void) {
+    if (xSemaphoreTake(g_resp_pool_sem, 0) != pdTRUE) {
+        if (!on_api_worker()) {
+            resp_pool_count(&g_resp_pool_stats.rejected);
+            return NULL;
+        }
+        resp_pool_count(&g_resp_pool_stats.waits);
+        if (xSemaphoreTake(g_resp_pool_sem, pdMS_TO_TICKS(RESP_POOL_WAIT_MS)) != pdTRUE) {
+            resp_pool_count(&g_resp_pool_stats.timeouts);
+            return NULL;
+        }
+    }
+
+    char *buf = NULL;
+    xSemaphoreTake(g_resp_pool_lock, portMAX_DELAY);
+    for (int i = 0; i < RESP_POOL_BUFS; i++) {
+        if (!g_resp_pool_busy[i]) {
+            g_resp_pool_busy[i] = true;
+            buf = g_resp_pool[i];
+            break;
+        }
+    }
+    g_resp_pool_stats.leases++;
+    g_resp_pool_stats.in_use++;
+    if (g_resp_pool_stats.in_use > g_resp_pool_stats.high_water) {
+        g_resp_pool_stats.high_water = g_resp_pool_stats.in_use;
+    }
+    xSemaphoreGive(g_resp_pool_lock);
+    return buf;
+}
+
+static void resp_buf_release(char *buf) {
+    if (!buf) return;
+    xSemaphoreTake(g_resp_pool_lock, portMAX_DELAY);
+    for (int i = 0; i < RESP_POOL_BUFS; i++) {
+        if (g_resp_pool[i] == buf) {
+            g_resp_pool_busy[i] = false;
+            g_resp_pool_stats.in_use--;
+            break;
+        }
+    }
+    xSemaphoreGive(g_resp_pool_lock);
+    xSemaphoreGive(g_resp_pool_sem);
+}
+
+// Accumulates a response in a pooled buffer and sends it as HTTP chunks, so
+// large bodies never need a full-size allocation.
+typedef struct {
+    httpd_req_t *req;
+    char        *buf;
+    size_t       cap;
+    size_t       off;
+    esp_err_t    err;
+} resp_stream_t;
+
+// Leases a buffer for the response; answers 503 and returns false if the
+// pool stays exhausted.
+static bool stream_begin(resp_stream_t *rs, httpd_req_t *req) {
+    memset(rs, 0, sizeof(*rs));
+    rs->req = req;
+    rs->buf = resp_buf_lease();
+    rs->cap = STREAM_BUF_SIZE;
+    if (!rs->buf) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, "{\"error\":\"busy\"}", HTTPD_RESP_USE_STRLEN);
+        return false;
+    }
+    return true;
+}
+
+static void stream_flush(resp_stream_t *rs) {
+    if (rs->off > 0 && rs->err == ESP_OK) {
+        rs->err = httpd_resp_send_chunk(rs->req, rs->buf, rs->off);
+    }
+    rs->off = 0;
+}
+
+// Makes sure at least `need` bytes are free, flushing if necessary.
+static void stream_reserve(resp_stream_t *rs, size_t need) {
+    if (rs->cap - rs->off < need) stream_flush(rs);
+}
+
+static void stream_printf(resp_stream_t *rs, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(rs->buf + rs->off, rs->cap - rs->off, fmt, ap);
+    va_end(ap);
+
+    if (n >= 0 && (size_t)n >= rs->cap - rs->off) {
+        stream_flush(rs);
+        va_start(ap, fmt);
+        n = vsnprintf(rs->buf, rs->cap, fmt, ap);
+        va_end(ap);
+    }
+    if (n > 0) {
+        rs->off += ((size_t)n < rs->cap - rs->off) ? (size_t)n : rs->cap - rs->off - 1;
+    }
+}
+
+// Terminates the chunked response and returns the buffer to the pool.
+static esp_err_t stream_end(resp_stream_t *rs) {
+    stream_flush(rs);
+    if (rs->err == ESP_OK) {
+        rs->err = httpd_resp_send_chunk(rs->req, NULL, 0);
+    }
+    resp_buf_release(rs->buf);
+    rs->buf = NULL;
+    return rs->err;
+}
+
+// Copies up to `max` live records starting at *slot into out[], advancing
+// *slot. Lets handlers format the table without holding g_ap_mutex while
+// they write to the socket.
+static int ap_copy_batch(int *slot, ap_info_t *out, int max) {
+    int n = 0;
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        *slot = MAX_APS;
+        return 0;
+    }
+    while (*slot < g_ap_count && n < max) {
+        if (g_aps[*slot].in_use) out[n++] = g_aps[*slot];
+        (*slot)++;
+    }
+    xSemaphoreGive(g_ap_mutex);
+    return n;
+}
+
+// ========================= CSV EXPORT =========================
+
+// per_radio keeps only the first BSSID of each physical radio.
+static void stream_csv_export(resp_stream_t *rs, bool per_radio) {
+    stream_printf(rs,
+                  "SSID,BSSID,RSSI,RSSI_MIN,RSSI_MAX,Channel,Auth,Seen_Count,First_Seen_MS,Last_Seen_MS,Radio\n");
+
+    uint32_t radio_seen[RADIO_GROUPS / 32] = {0};
+    ap_info_t batch[STREAM_COPY_BATCH];
+    int slot = 0;
+    int n;
+    while ((n = ap_copy_batch(&slot, batch, STREAM_COPY_BATCH)) > 0) {
+        for (int i = 0; i < n; i++) {
+            ap_info_t *ap = &batch[i];
+
+            if (per_radio && ap->radio >= 0) {
+                uint32_t bit = 1u << (ap->radio & 31);
+                if (radio_seen[ap->radio >> 5] & bit) continue;
+                radio_seen[ap->radio >> 5] |= bit;
+            }
+
+            char bssid_str[18];
+            mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
+
+            const char *ssid_display = ap->ssid[0] ? ap->ssid : "<hidden>";
+
+            stream_printf(rs,
+                          "\"%s\",%s,%d,%d,%d,%u,%s,%u,%lu,%lu,%d\n",
+                          ssid_display,
+                          bssid_str,
+                          (int)ap->rssi,
+                          (int)ap->rssi_min,
+                          (int)ap->rssi_max,
+                          (unsigned)ap->channel,
+                          auth_mode_to_str(ap->authmode),
+                          (unsigned)ap->seen_count,
+                          (unsigned long)ap->first_seen_ms,
+                          (unsigned long)ap->last_seen_ms,
+                          (int)ap->radio);
+        }
+    }
+}
+
+// ========================= SECURITY ANALYSIS FUNCTIONS =========================
+
+static void analyze_security(uint32_t window_ms) {
+    ap_aggregates_t agg;
+    agg_snapshot(&agg, window_ms);
+
+    memset(&g_security_stats, 0, sizeof(g_security_stats));
+    g_security_stats.open_count = agg.auth_counts[WIFI_AUTH_OPEN];
+    g_security_stats.wep_count  = agg.auth_counts[WIFI_AUTH_WEP];
+    g_security_stats.wpa_count  = agg.auth_counts[WIFI_AUTH_WPA_PSK];
+    g_security_stats.wpa2_count = agg.auth_counts[WIFI_AUTH_WPA2_PSK] +
+                                  agg.auth_counts[WIFI_AUTH_WPA_WPA2_PSK];
+    g_security_stats.wpa3_count = agg.auth_counts[WIFI_AUTH_WPA3_PSK] +
+                                  agg.auth_counts[WIFI_AUTH_WPA2_WPA3_PSK];
+    g_security_stats.hidden_count      = agg.hidden_count;
+    g_security_stats.hidden_resolved   = agg.hidden_resolved_count;
+    g_security_stats.weak_signal_count = agg.weak_signal_count;
+
+    for (int ch = 1; ch <= 13; ch++) {
+        if (agg.channel_counts[ch] >= CHANNEL_CONFLICT_APS) {
+            g_security_stats.channel_conflicts++;
+        }
+    }
+}
+
+static void get_channel_congestion(channel_analysis_t *results, int *count, uint32_t window_ms) {
+    ap_aggregates_t agg;
+    agg_snapshot(&agg, window_ms);
+    *count = 0;
+
+    uint32_t max_aps = 1;
+    for (int ch = 1; ch <= 13; ch++) {
+        if (agg.channel_counts[ch] > max_aps) {
+            max_aps = agg.channel_counts[ch];
+        }
+    }
+
+    airtime_channel_t air[AIRTIME_CHANNELS];
+    airtime_snapshot(air);
+    uint32_t now = now_ms();
+
+    for (int ch = 1; ch <= 13; ch++) {
+        results[*count].channel = ch;
+        results[*count].ap_count = agg.channel_counts[ch];
+        results[*count].radio_count = agg.radio_channel_counts[ch];
+        results[*count].congestion_score = agg.channel_counts[ch] * 100.0f / max_aps;
+        results[*count].airtime_x10 = (int16_t)airtime_util_x10(&air[ch], now);
+        results[*count].loaded_aps = 0;
+        results[*count].clients = 0;
+        results[*count].load = 0;
+        (*count)++;
+    }
+
+    taskENTER_CRITICAL(&g_clients_mux);
+    for (int i = 0; i < CLIENT_SLOTS; i++) {
+        const client_slot_t *c = &g_clients[i];
+        if (!c->in_use || c->load < 0 || c->channel < 1 || c->channel > 13) continue;
+        channel_analysis_t *a = &results[c->channel - 1];
+        a->loaded_aps++;
+        a->clients += c->clients;
+        a->load += c->load;
+    }
+    taskEXIT_CRITICAL(&g_clients_mux);
+}
+
+#define ROGUE_MAX_HITS 64
+
+typedef enum {
+    ROGUE_EVIL_TWIN = 0,
+    ROGUE_GENERIC_OPEN,
+    ROGUE_CLONED_BSSID
+} rogue_reason_t;
+
+static const char *rogue_reason_str(rogue_reason_t reason) {
+    switch (reason) {
+        case ROGUE_EVIL_TWIN:    return "Duplicate SSID - Possible Evil Twin";
+        case ROGUE_GENERIC_OPEN: return "Open network with generic name";
+        case ROGUE_CLONED_BSSID: return "Beacon timing shows two transmitters - Cloned BSSID";
+        default:                 return "Unknown";
+    }
+}
+
+typedef struct {
+    int16_t slot;
+    uint8_t reason;
+    uint8_t confidence;     // 0-100
+    int8_t  timing;         // beacon-timing confidence, -1 = not tracked
+} rogue_hit_t;
+
+// Same SSID on another BSSID is normal for multi-AP deployments; discount
+// pairs that look like one vendor's managed network.
+static uint8_t evil_twin_confidence(const ap_info_t *a, const ap_info_t *b) {
+    int conf = 60;
+    if (memcmp(a->bssid, b->bssid, 3) == 0) conf -= 30;
+    if ((a->caps & b->caps & AP_CAP_AKM_8021X) != 0) conf -= 20;
+    if (a->authmode != b->authmode) conf += 25;
+    return (uint8_t)(conf < 10 ? 10 : conf > 100 ? 100 : conf);
+}
+
+// Flags suspicious slots under the mutex; the caller formats them afterwards.
+static int detect_rogue_aps(rogue_hit_t *hits, int max_hits) {
+    int count = 0;
+
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        for (int i = 0; i < g_ap_count && count < max_hits; i++) {
+            ap_info_t *ap = &g_aps[i];
+            if (!ap->in_use) continue;
+
+            bool is_suspicious = false;
+            rogue_reason_t reason = ROGUE_EVIL_TWIN;
+            uint8_t confidence = 0;
+
+            for (int j = i + 1; j < g_ap_count; j++) {
+                if (g_aps[j].in_use &&
+                    strlen(ap->ssid) > 0 &&
+                    (ap->radio < 0 || ap->radio != g_aps[j].radio) &&
+                    strcmp(ap->ssid, g_aps[j].ssid) == 0 &&
+                    !mac_equal(ap->bssid, g_aps[j].bssid)) {
+                    is_suspicious = true;
+                    reason = ROGUE_EVIL_TWIN;
+                    confidence = evil_twin_confidence(ap, &g_aps[j]);
+                    break;
+                }
+            }
+
+            if (ap->authmode == WIFI_AUTH_OPEN && strlen(ap->ssid) > 0) {
+                const char *common_names[] = {
+                    "Free WiFi", "Public WiFi", "Guest", "Airport WiFi", "Hotel WiFi"
+                };
+                for (int k = 0; k < 5; k++) {
+                    if (strcasecmp(ap->ssid, common_names[k]) == 0) {
+                        is_suspicious = true;
+                        reason = ROGUE_GENERIC_OPEN;
+                        confidence = 30;
+                        break;
+                    }
+                }
+            }
+
+            // Timing evidence outranks the name-based heuristics.
+            beacon_track_t bt;
+            int timing = -1;
+            if (beacon_track_lookup(ap->bssid, &bt)) {
+                int conf = timing = beacon_track_confidence(&bt);
+                if (conf >= BT_FLAG_CONFIDENCE) {
+                    is_suspicious = true;
+                    reason = ROGUE_CLONED_BSSID;
+                    confidence = (uint8_t)conf;
+                }
+            }
+
+            if (is_suspicious) {
+                hits[count].slot       = i;
+                hits[count].reason     = reason;
+                hits[count].confidence = confidence;
+                hits[count].timing     = (int8_t)timing;
+                count++;
+            }
+        }
+
+        xSemaphoreGive(g_ap_mutex);
+    }
+
+    return count;
+}
+
+static void stream_rogue_aps(resp_stream_t *rs) {
+    rogue_hit_t hits[ROGUE_MAX_HITS];
+    int count = detect_rogue_aps(hits, ROGUE_MAX_HITS);
+
+    stream_printf(rs, "[");
+    bool first = true;
+
+    for (int i = 0; i < count; i++) {
+        ap_info_t ap;
+        if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) break;
+        ap = g_aps[hits[i].slot];
+        xSemaphoreGive(g_ap_mutex);
+        if (!ap.in_use) continue;
+
+        char bssid_str[18];
+        mac_to_str(ap.bssid, bssid_str, sizeof(bssid_str));
+
+        char timing[8] = "null";
+        if (hits[i].timing >= 0) snprintf(timing, sizeof(timing), "%d", hits[i].timing);
+
+        stream_printf(rs,
+                      "%s{\"ssid\":\"%s\",\"bssid\":\"%s\","
+                      "\"reason\":\"%s\",\"confidence\":%u,\"timing_confidence\":%s,"
+                      "\"rssi\":%d,\"channel\":%u}",
+                      first ? "" : ",",
+                      ap.ssid[0] ? ap.ssid : "<hidden>",
+                      bssid_str,
+                      rogue_reason_str(hits[i].reason),
+                      (unsigned)hits[i].confidence,
+                      timing,
+                      (int)ap.rssi,
+                      (unsigned)ap.channel);
+        first = false;
+    }
+
+    stream_printf(rs, "]");
+}
+
+static void stream_vuln(resp_stream_t *rs, bool *first, const ap_info_t *ap,
+                        const char *vulnerability, const char *severity) {
+    char bssid_str[18];
+    mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
+
+    stream_printf(rs,
+                  "%s{\"ssid\":\"%s\",\"bssid\":\"%s\",\"vulnerability\":\"%s\","
+                  "\"severity\":\"%s\",\"auth\":\"%s\",\"rssi\":%d,\"channel\":%u,\"caps\":%lu}",
+                  *first ? "" : ",",
+                  ap->ssid[0] ? ap->ssid : "<hidden>",
+                  bssid_str,
+                  vulnerability,
+                  severity,
+                  auth_mode_to_str(ap->authmode),
+                  (int)ap->rssi,
+                  (unsigned)ap->channel,
+                  (unsigned long)ap->caps);
+    *first = false;
+}
+
+// One entry per finding, so an AP can appear more than once. Cipher and WPS
+// findings work from scan data alone; AKM/PMF findings need a sniffed beacon
+// (AP_CAP_IE_PARSED).
+static void stream_vulnerable_networks(resp_stream_t *rs) {
+    stream_printf(rs, "[");
+
+    bool first = true;
+    ap_info_t batch[STREAM_COPY_BATCH];
+    int slot = 0;
+    int n;
+
+    while ((n = ap_copy_batch(&slot, batch, STREAM_COPY_BATCH)) > 0) {
+        for (int i = 0; i < n; i++) {
+            const ap_info_t *ap = &batch[i];
+            uint32_t caps = ap->caps;
+
+            if (ap->authmode == WIFI_AUTH_WEP) {
+                stream_vuln(rs, &first, ap, "WEP encryption (deprecated, easily cracked)", "CRITICAL");
+            } else if (ap->authmode == WIFI_AUTH_WPA_PSK) {
+                stream_vuln(rs, &first, ap, "WPA1 encryption (deprecated, vulnerable)", "HIGH");
+            } else if (ap->authmode == WIFI_AUTH_OPEN && !(caps & AP_CAP_AKM_OWE)) {
+                stream_vuln(rs, &first, ap, "No encryption (unprotected network)", "HIGH");
+            }
+
+            if (ap->authmode == WIFI_AUTH_OPEN || ap->authmode == WIFI_AUTH_WEP) continue;
+
+            if ((caps & AP_CAP_PAIR_TKIP) &&
+                !(caps & (AP_CAP_PAIR_CCMP | AP_CAP_PAIR_GCMP))) {
+                stream_vuln(rs, &first, ap, "TKIP-only pairwise cipher", "HIGH");
+            } else if (caps & AP_CAP_GROUP_TKIP) {
+                stream_vuln(rs, &first, ap, "TKIP group cipher (WPA/WPA2 mixed mode)", "MEDIUM");
+            }
+            if (caps & AP_CAP_WPS) {
+                stream_vuln(rs, &first, ap, "WPS enabled (PIN brute-force risk)", "MEDIUM");
+            }
+            if ((caps & AP_CAP_AKM_SAE) && (caps & AP_CAP_AKM_PSK)) {
+                stream_vuln(rs, &first, ap, "WPA3 transition mode (downgradable to WPA2-PSK)", "MEDIUM");
+            }
+            if ((caps & AP_CAP_IE_PARSED) && (caps & AP_CAP_RSN) &&
+                !(caps & AP_CAP_PMF_CAPABLE)) {
+                stream_vuln(rs, &first, ap, "PMF disabled (deauth/disassoc can be spoofed)", "LOW");
+            }
+        }
+    }
+
+    stream_printf(rs, "]");
+}
+
+// ========================= PACKET INJECTION FUNCTIONS =========================
+
+static void craft_deauth_frame(uint8_t *frame, const uint8_t *target_mac, const uint8_t *ap_mac) {
+    frame[0] = 0xC0;
+    frame[1] = 0x00;
+
+    frame[2] = 0x00;
+    frame[3] = 0x00;
+
+    memcpy(&frame[4],  target_mac, 6);
+    memcpy(&frame[10], ap_mac,     6);
+    memcpy(&frame[16], ap_mac,     6);
+
+    frame[22] = 0x00;
+    frame[23] = 0x00;
+
+    frame[24] = 0x07;
+    frame[25] = 0x00;
+}
+
+static void craft_disassoc_frame(uint8_t *frame, const uint8_t *target_mac, const uint8_t *ap_mac) {
+    frame[0] = 0xA0;
+    frame[1] = 0x00;
+
+    frame[2] = 0x00;
+    frame[3] = 0x00;
+
+    memcpy(&frame[4],  target_mac, 6);
+    memcpy(&frame[10], ap_mac,     6);
+    memcpy(&frame[16], ap_mac,     6);
+
+    frame[22] = 0x00;
+    frame[23] = 0x00;
+
+    frame[24] = 0x08;
+    frame[25] = 0x00;
+}
+
+static void craft_probe_request(uint8_t *frame, size_t *len, const char *ssid) {
+    int idx = 0;
+
+    frame[idx++] = 0x40;
+    frame[idx++] = 0x00;
+
+    frame[idx++] = 0x00;
+    frame[idx++] = 0x00;
+
+    memset(&frame[idx], 0xFF, 6);
+    idx += 6;
+
+    frame[idx++] = 0x02;
+    for (int i = 1; i < 6; i++) {
+        frame[idx++] = esp_random() & 0xFF;
+    }
+
+    memset(&frame[idx], 0xFF, 6);
+    idx += 6;
+
+    frame[idx++] = 0x00;
+    frame[idx++] = 0x00;
+
+    frame[idx++] = 0x00;
+    uint8_t ssid_len = (uint8_t)strlen(ssid);
+    frame[idx++] = ssid_len;
+    memcpy(&frame[idx], ssid, ssid_len);
+    idx += ssid_len;
+
+    *len = idx;
+}
+
+// ========================= AP QUERY =========================
+
+#define AP_PAGE_DEFAULT 50
+#define AP_PAGE_MAX     100
+
+typedef enum {
+    AP_SORT_LAST_SEEN = 0,
+    AP_SORT_RSSI,
+    AP_SORT_SEEN_COUNT
+} ap_sort_t;
+
+// Filters, ordering and cursor for /api/aps. Results are ordered by sort key
+// descending, ties broken by slot; the cursor is the (key, slot) of the last
+// record on the previous page.
+typedef struct {
+    int       auth;              // -1 = any
+    int       channel;           // 0 = any
+    int       cls;               // -1 = any
+    int       min_rssi;          // -128 = any
+    char      ssid_prefix[33];
+    uint32_t  since_ms;          // ap_changed_ms() must be newer; 0 = any
+    ap_sort_t sort;
+    int       limit;
+    bool      has_cursor;
+    int64_t   cursor_key;
+    int       cursor_slot;
+} ap_query_t;
+
+typedef struct {
+    int64_t key;
+    int16_t slot;
+} ap_hit_t;
+
+typedef struct {
+    int      count;              // hits on this page
+    uint32_t total;              // all matches, ignoring the cursor
+    uint32_t remaining;          // matches after the cursor
+} ap_query_result_t;
+
+static void url_decode(char *s) {
+    char *o = s;
+    while (*s) {
+        if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2])) {
+            char hex[3] = { s[1], s[2], 0 };
+            *o++ = (char)strtol(hex, NULL, 16);
+            s += 3;
+        } else if (*s == '+') {
+            *o++ = ' ';
+            s++;
+        } else {
+            *o++ = *s++;
+        }
+    }
+    *o = '\0';
+}
+
+static bool query_int(const char *query, const char *key, int *out) {
+    char val[16];
+    if (httpd_query_key_value(query, key, val, sizeof(val)) != ESP_OK) return false;
+    *out = atoi(val);
+    return true;
+}
+
+static void ap_query_parse(httpd_req_t *req, ap_query_t *q) {
+    memset(q, 0, sizeof(*q));
+    q->auth     = -1;
+    q->cls      = -1;
+    q->min_rssi = -128;
+    q->limit    = AP_PAGE_DEFAULT;
+
+    char query[QUERY_MAX];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) return;
+
+    int v;
+    if (query_int(query, "auth", &v) && v >= 0 && v < 16)     q->auth = v;
+    if (query_int(query, "channel", &v) && v > 0 && v <= 14)  q->channel = v;
+    if (query_int(query, "class", &v) && v >= 0 && v < 8)     q->cls = v;
+    if (query_int(query, "min_rssi", &v))                     q->min_rssi = v;
+    if (query_int(query, "limit", &v) && v > 0)
+        q->limit = v > AP_PAGE_MAX ? AP_PAGE_MAX : v;
+
+    char val[48];
+    if (httpd_query_key_value(query, "since", val, sizeof(val)) == ESP_OK) {
+        q->since_ms = (uint32_t)strtoul(val, NULL, 10);
+    }
+    if (httpd_query_key_value(query, "ssid", val, sizeof(val)) == ESP_OK) {
+        url_decode(val);
+        strncpy(q->ssid_prefix, val, sizeof(q->ssid_prefix) - 1);
+    }
+    if (httpd_query_key_value(query, "sort", val, sizeof(val)) == ESP_OK) {
+        if (strcmp(val, "rssi") == 0)            q->sort = AP_SORT_RSSI;
+        else if (strcmp(val, "seen_count") == 0) q->sort = AP_SORT_SEEN_COUNT;
+    }
+    if (httpd_query_key_value(query, "cursor", val, sizeof(val)) == ESP_OK) {
+        char *dot = strchr(val, '.');
+        if (dot) {
+            *dot = '\0';
+            q->cursor_key  = strtoll(val, NULL, 10);
+            q->cursor_slot = atoi(dot + 1);
+            q->has_cursor  = true;
+        }
+    }
+}
+
+static int64_t ap_sort_key(const ap_info_t *ap, ap_sort_t sort) {
+    switch (sort) {
+        case AP_SORT_RSSI:       return ap->rssi;
+        case AP_SORT_SEEN_COUNT: return ap->seen_count;
+        default:                 return ap->last_seen_ms;
+    }
+}
+
+static bool hit_before(int64_t ka, int sa, int64_t kb, int sb) {
+    return ka > kb || (ka == kb && sa < sb);
+}
+
+// When anything about the AP last changed: a sighting or an in-place update.
+static inline uint32_t ap_changed_ms(const ap_info_t *ap) {
+    return ap->modified_ms > ap->last_seen_ms ? ap->modified_ms : ap->last_seen_ms;
+}
+
+static bool ap_query_match(const ap_query_t *q, const ap_info_t *ap) {
+    if (q->auth >= 0 && ap->authmode != q->auth) return false;
+    if (q->channel > 0 && ap->channel != q->channel) return false;
+    if (q->cls >= 0 && (int)ap->classification != q->cls) return false;
+    if (ap->rssi < q->min_rssi) return false;
+    if (q->since_ms && ap_changed_ms(ap) <= q->since_ms) return false;
+    if (q->ssid_prefix[0] &&
+        strncasecmp(ap->ssid, q->ssid_prefix, strlen(q->ssid_prefix)) != 0) return false;
+    return true;
+}
+
+// Keeps hits[] as the best `limit` candidates in page order.
+static void ap_query_consider(const ap_query_t *q, int slot, ap_hit_t *hits,
+                              ap_query_result_t *res) {
+    const ap_info_t *ap = &g_aps[slot];
+    if (!ap_query_match(q, ap)) return;
+    res->total++;
+
+    int64_t key = ap_sort_key(ap, q->sort);
+    if (q->has_cursor && !hit_before(q->cursor_key, q->cursor_slot, key, slot)) return;
+    res->remaining++;
+
+    int pos = res->count;
+    if (pos == q->limit) {
+        if (!hit_before(key, slot, hits[pos - 1].key, hits[pos - 1].slot)) return;
+        pos--;
+    } else {
+        res->count++;
+    }
+    while (pos > 0 && hit_before(key, slot, hits[pos - 1].key, hits[pos - 1].slot)) {
+        hits[pos] = hits[pos - 1];
+        pos--;
+    }
+    hits[pos].key  = key;
+    hits[pos].slot = slot;
+}
+
+// Channel/auth/class filters are answered by ANDing the slot bitmaps; a bare
+// "since" filter walks the recency list instead, to the end only when an AP
+// further back was changed in place after "since". Only the candidates that
+// survive are touched. Must be called with g_ap_mutex held.
+static void ap_query_run(const ap_query_t *q, ap_hit_t *hits, ap_query_result_t *res) {
+    memset(res, 0, sizeof(*res));
+
+    if (q->since_ms && q->auth < 0 && q->channel == 0 && q->cls < 0) {
+        bool modified = g_ap_modified_ms > q->since_ms;
+        for (int i = g_recent_head; i >= 0; i = g_aps[i].recent_next) {
+            if (!modified && g_aps[i].last_seen_ms <= q->since_ms) break;
+            ap_query_consider(q, i, hits, res);
+        }
+        return;
+    }
+
+    for (int w = 0; w < MAX_APS / 32; w++) {
+        uint32_t m = g_idx.live.w[w];
+        if (q->auth >= 0)   m &= g_idx.auth[q->auth].w[w];
+        if (q->channel > 0) m &= g_idx.channel[q->channel].w[w];
+        if (q->cls >= 0)    m &= g_idx.cls[q->cls].w[w];
+        while (m) {
+            int bit = __builtin_ctz(m);
+            m &= m - 1;
+            ap_query_consider(q, w * 32 + bit, hits, res);
+        }
+    }
+}
+
+static size_t append_ap_json(char *buf, size_t len, size_t off, const ap_info_t *ap, uint32_t now) {
+    char bssid_str[18];
+    mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
+
+    uint32_t age = now - ap->last_seen_ms;
+
+    char load_json[64];
+    uint16_t clients = 0, fps_x10 = 0;
+    int load = client_load_get(ap->bssid, &clients, &fps_x10);
+    if (load < 0) {
+        snprintf(load_json, sizeof(load_json), "\"clients\":null,\"data_fps\":null,\"load\":null");
+    } else {
+        snprintf(load_json, sizeof(load_json), "\"clients\":%u,\"data_fps\":%u.%u,\"load\":%d",
+                 clients, fps_x10 / 10, fps_x10 % 10, load);
+    }
+
+    return off + snprintf(buf + off, len - off,
+                          "{\"ssid\":\"%s\",\"bssid\":\"%s\",\"rssi\":%d,"
+                          "\"rssi_min\":%d,\"rssi_max\":%d,\"channel\":%u,"
+                          "\"auth\":%u,\"auth_str\":\"%s\",\"seen\":%u,"
+                          "\"first_seen\":%lu,\"last_seen\":%lu,\"modified\":%lu,\"age_ms\":%lu,"
+                          "\"caps\":%lu,\"country\":\"%s\",\"beacon_int\":%u,\"radio\":%d,"
+                          "\"returning\":%s,\"ssid_resolved\":%s,%s}",
+                          ap->ssid[0] ? ap->ssid : "<hidden>",
+                          bssid_str,
+                          (int)ap->rssi,
+                          (int)ap->rssi_min,
+                          (int)ap->rssi_max,
+                          (unsigned)ap->channel,
+                          (unsigned)ap->authmode,
+                          auth_mode_to_str(ap->authmode),
+                          (unsigned)ap->seen_count,
+                          (unsigned long)ap->first_seen_ms,
+                          (unsigned long)ap->last_seen_ms,
+                          (unsigned long)ap_changed_ms(ap),
+                          (unsigned long)age,
+                          (unsigned long)ap->caps,
+                          ap->country,
+                          (unsigned)ap->beacon_int,
+                          (int)ap->radio,
+                          ap->returning ? "true" : "false",
+                          ap->ssid_resolved ? "true" : "false",
+                          load_json);
+}
+
+// Serializes the selected slots without holding g_ap_mutex across socket
+// writes: records are copied out a few at a time and formatted unlocked.
+static void stream_ap_hits(resp_stream_t *rs, const ap_hit_t *hits, int count, uint32_t now) {
+    ap_info_t batch[STREAM_COPY_BATCH];
+    bool first = true;
+
+    for (int i = 0; i < count; i += STREAM_COPY_BATCH) {
+        int n = 0;
+        if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) break;
+        for (int j = i; j < count && n < STREAM_COPY_BATCH; j++) {
+            if (g_aps[hits[j].slot].in_use) batch[n++] = g_aps[hits[j].slot];
+        }
+        xSemaphoreGive(g_ap_mutex);
+
+        for (int j = 0; j < n; j++) {
+            stream_reserve(rs, 512);
+            if (!first) rs->buf[rs->off++] = ',';
+            first = false;
+            rs->off = append_ap_json(rs->buf, rs->cap, rs->off, &batch[j], now);
+        }
+    }
+}
+
+static void stream_cursor(char *out, size_t len, const ap_hit_t *last) {
+    snprintf(out, len, "%lld.%d", (long long)last->key, (int)last->slot);
+}
+
+// ========================= HTML UI =========================
+
+// GET /api/aps?auth=&channel=&class=&min_rssi=&ssid=&since=&sort=&limit=&cursor=
+// Returns one page as a JSON array. X-Total-Count carries the number of
+// matches and X-Next-Cursor (when present) fetches the following page.
+static esp_err_t handler_api_aps(httpd_req_t *req) {
+    ap_query_t q;
+    ap_query_parse(req, &q);
+
+    ap_hit_t hits[AP_PAGE_MAX];
+    ap_query_result_t res = {0};
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        ap_query_run(&q, hits, &res);
+        xSemaphoreGive(g_ap_mutex);
+    }
+
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+
+    char total_hdr[12];
+    char cursor_hdr[32];
+    snprintf(total_hdr, sizeof(total_hdr), "%lu", (unsigned long)res.total);
+    httpd_resp_set_hdr(req, "X-Total-Count", total_hdr);
+    if (res.count > 0 && res.remaining > (uint32_t)res.count) {
+        stream_cursor(cursor_hdr, sizeof(cursor_hdr), &hits[res.count - 1]);
+        httpd_resp_set_hdr(req, "X-Next-Cursor", cursor_hdr);
+    }
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "[");
+    stream_ap_hits(&rs, hits, res.count, now_ms());
+    stream_printf(&rs, "]");
+
+    return stream_end(&rs);
+}
+
+// Streamed in sections so the object can grow without a fixed-size buffer
+// that would silently cut it into invalid JSON.
+static void stream_state_json(resp_stream_t *rs) {
+    g_stats.uptime_sec   = (uint32_t)(esp_timer_get_time() / 1000000ULL);
+    g_stats.free_heap    = esp_get_free_heap_size();
+    g_stats.min_free_heap = esp_get_minimum_free_heap_size();
+
+    stream_printf(rs,
+                  "{\"wardrive\":%s,\"ap_count\":%d,\"radio_count\":%lu,"
+                  "\"unique_aps\":%lu,\"unique_err_pct\":%d.%d,\"returning_aps\":%lu,\"total_scans\":%lu,"
+                  "\"successful_scans\":%lu,\"failed_scans\":%lu,",
+                  g_wardrive_on ? "true" : "false",
+                  g_ap_count,
+                  (unsigned long)g_agg.radio_total,
+                  (unsigned long)unique_estimate(g_unique.total, HLL_P_TOTAL),
+                  hll_err_x10(HLL_P_TOTAL) / 10, hll_err_x10(HLL_P_TOTAL) % 10,
+                  (unsigned long)g_agg.returning_count,
+                  (unsigned long)g_stats.total_scans,
+                  (unsigned long)g_stats.successful_scans,
+                  (unsigned long)g_stats.failed_scans);
+    stream_printf(rs,
+                  "\"uptime_sec\":%lu,\"free_heap\":%lu,\"min_free_heap\":%lu,"
+                  "\"packets_sent\":%lu,\"handshake_listening\":%s,\"handshake_captured\":%lu,",
+                  (unsigned long)g_stats.uptime_sec,
+                  (unsigned long)g_stats.free_heap,
+                  (unsigned long)g_stats.min_free_heap,
+                  (unsigned long)g_packet_stats.packets_sent,
+                  g_packet_stats.handshake_listening ? "true" : "false",
+                  (unsigned long)g_packet_stats.handshake_captured);
+    resp_pool_stats_t pool;
+    xSemaphoreTake(g_resp_pool_lock, portMAX_DELAY);
+    pool = g_resp_pool_stats;
+    xSemaphoreGive(g_resp_pool_lock);
+    stream_printf(rs,
+                  "\"resp_pool\":{\"size\":%d,\"in_use\":%lu,\"high_water\":%lu,"
+                  "\"leases\":%lu,\"waits\":%lu,\"timeouts\":%lu,\"rejected\":%lu},",
+                  RESP_POOL_BUFS,
+                  (unsigned long)pool.in_use,
+                  (unsigned long)pool.high_water,
+                  (unsigned long)pool.leases,
+                  (unsigned long)pool.waits,
+                  (unsigned long)pool.timeouts,
+                  (unsigned long)pool.rejected);
+    stream_printf(rs,
+                  "\"dns\":{\"queries\":%lu,\"answered_a\":%lu,\"answered_empty\":%lu,\"dropped\":%lu,"
+                  "\"send_failed\":%lu,\"max_burst\":%lu},",
+                  (unsigned long)g_dns_stats.queries,
+                  (unsigned long)g_dns_stats.answered_a,
+                  (unsigned long)g_dns_stats.answered_empty,
+                  (unsigned long)g_dns_stats.dropped,
+                  (unsigned long)g_dns_stats.send_failed,
+                  (unsigned long)g_dns_stats.max_burst);
+    stream_printf(rs,
+                  "\"httpd\":{\"dispatched\":%lu,\"async\":%lu,\"busy\":%lu,\"rate_limited\":%lu},"
+                  "\"snapshot\":{\"bytes\":%lu,\"write_us\":%lu,\"restore_us\":%lu,\"restored_aps\":%lu}}",
+                  (unsigned long)g_httpd_stats.dispatched,
+                  (unsigned long)g_httpd_stats.async_dispatched,
+                  (unsigned long)g_httpd_stats.async_busy,
+                  (unsigned long)g_httpd_stats.rate_limited,
+                  (unsigned long)g_snap.bytes,
+                  (unsigned long)g_snap.write_us,
+                  (unsigned long)g_snap.restore_us,
+                  (unsigned long)g_snap.restored_aps);
+}
+
+static esp_err_t handler_api_state(httpd_req_t *req) {
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+    stream_state_json(&rs);
+    return stream_end(&rs);
+}
+
+static esp_err_t handler_api_channels(httpd_req_t *req) {
+    char buf[2048];
+    size_t off = 0;
+    ap_aggregates_t agg;
+    agg_snapshot(&agg, query_window_ms(req));
+
+    off += snprintf(buf + off, sizeof(buf) - off, "[");
+    bool first = true;
+    for (int ch = 1; ch <= 13; ch++) {
+        if (!first) off += snprintf(buf + off, sizeof(buf) - off, ",");
+        first = false;
+        off += snprintf(buf + off, sizeof(buf) - off,
+                        "{\"ch\":%d,\"count\":%lu}", ch, (unsigned long)agg.channel_counts[ch]);
+    }
+    off += snprintf(buf + off, sizeof(buf) - off, "]");
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, buf, off);
+}
+
+static void build_wifi_status_json(char *buf, size_t len) {
+    wifi_config_t cfg = {0};
+    esp_wifi_get_config(WIFI_IF_STA, &cfg);
+
+    snprintf(buf, len,
+             "{\"connected\":%s,\"ssid\":\"%s\",\"ip\":\"%s\"}",
+             g_sta_connected ? "true" : "false",
+             g_sta_ssid[0] ? g_sta_ssid : (char *)cfg.sta.ssid,
+             g_sta_ip);
+}
+
+static esp_err_t handler_api_wifi_status(httpd_req_t *req) {
+    char buf[256];
+    build_wifi_status_json(buf, sizeof(buf));
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
+}
+
+// GET /api/dashboard?since=<modified ms>
+// Everything the dashboard polls for in one streamed response: device state,
+// uplink status and the APs seen or changed (e.g. a hidden SSID resolved)
+// after `since`, newest sighting first. If the delta
+// does not fit one page, "next" holds a cursor for
+// /api/aps?since=<since>&cursor=<next>. "gen" changes when the table is
+// cleared, telling the client to drop its cursor.
+static esp_err_t handler_api_dashboard(httpd_req_t *req) {
+    // The phone piggybacks its latest GPS fix for the coverage grid.
+    gps_fix_from_query(req);
+
+    ap_query_t q = {
+        .auth     = -1,
+        .cls      = -1,
+        .min_rssi = -128,
+        .since_ms = query_u32(req, "since", 0),
+        .sort     = AP_SORT_LAST_SEEN,
+        .limit    = AP_PAGE_MAX,
+    };
+
+    ap_hit_t hits[AP_PAGE_MAX];
+    ap_query_result_t res = {0};
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        ap_query_run(&q, hits, &res);
+        xSemaphoreGive(g_ap_mutex);
+    }
+    uint32_t now = now_ms();
+
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "{\"now_ms\":%lu,\"gen\":%lu,\"state\":",
+                  (unsigned long)now, (unsigned long)g_ap_generation);
+    stream_state_json(&rs);
+
+    stream_reserve(&rs, 256);
+    stream_printf(&rs, ",\"wifi\":");
+    build_wifi_status_json(rs.buf + rs.off, rs.cap - rs.off);
+    rs.off += strlen(rs.buf + rs.off);
+
+    stream_printf(&rs, ",\"total\":%lu,\"aps\":[", (unsigned long)res.total);
+    stream_ap_hits(&rs, hits, res.count, now);
+    stream_printf(&rs, "]");
+
+    if (res.count > 0 && res.remaining > (uint32_t)res.count) {
+        char cursor[32];
+        stream_cursor(cursor, sizeof(cursor), &hits[res.count - 1]);
+        stream_printf(&rs, ",\"next\":\"%s\"}", cursor);
+    } else {
+        stream_printf(&rs, ",\"next\":null}");
+    }
+
+    return stream_end(&rs);
+}
+
+static esp_err_t handler_api_wifi_scan(httpd_req_t *req) {
+    if (xSemaphoreTake(g_scan_mutex, pdMS_TO_TICKS(SCAN_LOCK_WAIT_MS)) != pdTRUE) {
+        return send_scan_busy(req);
+    }
+    esp_err_t err = safe_scan_start(0, 0);
+
+    if (err != ESP_OK) {
+        xSemaphoreGive(g_scan_mutex);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "scan failed");
+        return err;
+    }
+
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) {
+        esp_wifi_clear_ap_list();
+        xSemaphoreGive(g_scan_mutex);
+        return ESP_OK;
+    }
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "[");
+    bool first = true;
+
+    wifi_ap_record_t r;
+    while (esp_wifi_scan_get_ap_record(&r) == ESP_OK) {
+        char bssid[18];
+        mac_to_str(r.bssid, bssid, sizeof(bssid));
+
+        stream_printf(&rs,
+                      "%s{\"ssid\":\"%s\",\"bssid\":\"%s\",\"rssi\":%d,\"channel\":%u,\"auth\":%u}",
+                      first ? "" : ",",
+                      r.ssid[0] ? (char *)r.ssid : "<hidden>",
+                      bssid,
+                      (int)r.rssi,
+                      (unsigned)r.primary,
+                      (unsigned)r.authmode);
+        first = false;
+    }
+    xSemaphoreGive(g_scan_mutex);
+
+    stream_printf(&rs, "]");
+    return stream_end(&rs);
+}
+
+static esp_err_t handler_api_wifi_connect(httpd_req_t *req) {
+    char body[256];
+    int received = httpd_req_recv(req, body, sizeof(body) - 1);
+    if (received <= 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "no body");
+        return ESP_FAIL;
+    }
+    body[received] = '\0';
+
+    wifi_config_t sta_cfg = {0};
+
+    if (!parse_json_string(body, "ssid", (char *)sta_cfg.sta.ssid, sizeof(sta_cfg.sta.ssid))) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ssid missing");
+        return ESP_FAIL;
+    }
+    parse_json_string(body, "password", (char *)sta_cfg.sta.password, sizeof(sta_cfg.sta.password));
+    sta_cfg.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+
+    strncpy(g_sta_ssid, (char *)sta_cfg.sta.ssid, sizeof(g_sta_ssid) - 1);
+    g_sta_ssid[sizeof(g_sta_ssid) - 1] = '\0';
+    g_sta_connected = false;
+    g_sta_ip[0] = '\0';
+
+    esp_wifi_disconnect();
+    esp_wifi_set_config(WIFI_IF_STA, &sta_cfg);
+    esp_wifi_connect();
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"status\":\"connecting\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+typedef struct {
+    char   *buf;
+    size_t  len;
+    size_t  cap;
+} http_buf_t;
+
+static esp_err_t http_collect_handler(esp_http_client_event_t *evt) {
+    http_buf_t *hb = (http_buf_t *)evt->user_data;
+    if (!hb) return ESP_OK;
+
+    if (evt->event_id == HTTP_EVENT_ON_DATA && evt->data && evt->data_len > 0) {
+        size_t to_copy = evt->data_len;
+        if (hb->len + to_copy >= hb->cap) {
+            to_copy = hb->cap - hb->len - 1;
+        }
+        if (to_copy > 0) {
+            memcpy(hb->buf + hb->len, evt->data, to_copy);
+            hb->len += to_copy;
+            hb->buf[hb->len] = '\0';
+        }
+    }
+    return ESP_OK;
+}
+
+// ========================= NETWORK GEOLOCATION =========================
+// Lookups run on their own task so a slow uplink never stalls the httpd task.
+// The handler answers from the cache immediately; a stale or missing entry
+// wakes the task, and requests arriving while a lookup is in flight simply
+// share its result. An uplink change bumps the cache generation; a lookup
+// that started before it is thrown away and run again on the new uplink.
+// Override GEO_LOOKUP_URL at build time to point at a local stand-in server.
+
+#ifndef GEO_LOOKUP_URL
+#define GEO_LOOKUP_URL "http://ip-api.com/json/?fields=status,message,lat,lon,city,country,query"
+#endif
+#define GEO_CACHE_TTL_MS   (10 * 60 * 1000)
+#define GEO_RETRY_MS       30000
+#define GEO_HTTP_TIMEOUT_MS 5000
+#define GEO_BODY_MAX       512
+
+typedef struct {
+    char      body[GEO_BODY_MAX];
+    size_t    len;
+    bool      valid;
+    bool      pending;
+    uint32_t  fetched_ms;
+    uint32_t  last_attempt_ms;
+    bool      last_failed;
+    uint32_t  generation;       // bumped by geo_invalidate()
+    uint32_t  lookups;
+    uint32_t  coalesced;
+    uint32_t  failures;
+    uint32_t  discarded;        // finished after an invalidation
+} geo_cache_t;
+
+static geo_cache_t       g_geo       = {0};
+static SemaphoreHandle_t g_geo_mutex = NULL;
+static TaskHandle_t      g_geo_task  = NULL;
+
+// Requests a refresh unless one is already queued. Caller holds g_geo_mutex.
+static void geo_request_refresh_locked(void) {
+    if (g_geo.pending) {
+        g_geo.coalesced++;
+        return;
+    }
+    g_geo.pending = true;
+    if (g_geo_task) xTaskNotifyGive(g_geo_task);
+}
+
+// Drops the cached fix (the uplink changed) and fetches a new one.
+static void geo_invalidate(void) {
+    if (!g_geo_mutex) return;
+    xSemaphoreTake(g_geo_mutex, portMAX_DELAY);
+    g_geo.generation++;
+    g_geo.valid = false;
+    g_geo.last_failed = false;
+    geo_request_refresh_locked();
+    xSemaphoreGive(g_geo_mutex);
+}
+
+static void geo_task(void *arg) {
+    static char body[GEO_BODY_MAX];
+    bool rerun = false;
+
+    while (1) {
+        // A rerun already covers the notification the invalidation sent.
+        ulTaskNotifyTake(pdTRUE, rerun ? 0 : portMAX_DELAY);
+        rerun = false;
+
+        xSemaphoreTake(g_geo_mutex, portMAX_DELAY);
+        uint32_t generation = g_geo.generation;
+        bool connected = g_sta_connected;
+        if (!connected) g_geo.pending = false;
+        xSemaphoreGive(g_geo_mutex);
+        if (!connected) continue;
+
+        http_buf_t hb = {.buf = body, .len = 0, .cap = sizeof(body)};
+        body[0] = '\0';
+
+        esp_http_client_config_t cfg = {
+            .url = GEO_LOOKUP_URL,
+            .event_handler = http_collect_handler,
+            .user_data = &hb,
+            .timeout_ms = GEO_HTTP_TIMEOUT_MS,
+        };
+
+        esp_err_t err = ESP_FAIL;
+        int status = 0;
+        esp_http_client_handle_t client = esp_http_client_init(&cfg);
+        if (client) {
+            err = esp_http_client_perform(client);
+            status = esp_http_client_get_status_code(client);
+            esp_http_client_cleanup(client);
+        }
+        bool ok = err == ESP_OK && status == 200 && hb.len > 0 && body[0] == '{';
+
+        xSemaphoreTake(g_geo_mutex, portMAX_DELAY);
+        if (generation != g_geo.generation) {
+            // The uplink changed mid-lookup; neither result nor failure applies.
+            g_geo.discarded++;
+            xSemaphoreGive(g_geo_mutex);
+            rerun = true;
+            continue;
+        }
+        g_geo.lookups++;
+        g_geo.last_attempt_ms = now_ms();
+        g_geo.last_failed = !ok;
+        if (ok) {
+            memcpy(g_geo.body, body, hb.len + 1);
+            g_geo.len = hb.len;
+            g_geo.valid = true;
+            g_geo.fetched_ms = g_geo.last_attempt_ms;
+        } else {
+            g_geo.failures++;
+            ESP_LOGW(TAG, "Geo lookup failed: %s (HTTP %d)", esp_err_to_name(err), status);
+        }
+        g_geo.pending = false;
+        xSemaphoreGive(g_geo_mutex);
+    }
+}
+
+// Returns the cached lookup with "age_ms" and "stale" spliced in, 202 while
+// the first lookup is still running, or 502 if the last attempt failed.
+static esp_err_t handler_api_gps_network(httpd_req_t *req) {
+    char buf[GEO_BODY_MAX + 64];
+    uint32_t now = now_ms();
+
+    xSemaphoreTake(g_geo_mutex, portMAX_DELAY);
+    bool stale = !g_geo.valid || now - g_geo.fetched_ms > GEO_CACHE_TTL_MS;
+    if (stale && g_sta_connected &&
+        (!g_geo.last_failed || now - g_geo.last_attempt_ms > GEO_RETRY_MS)) {
+        geo_request_refresh_locked();
+    }
+    bool valid = g_geo.valid;
+    bool failed = g_geo.last_failed && !g_geo.pending;
+    if (valid) {
+        snprintf(buf, sizeof(buf), "{\"age_ms\":%lu,\"stale\":%s,%s",
+                 (unsigned long)(now - g_geo.fetched_ms),
+                 stale ? "true" : "false",
+                 g_geo.body + 1);
+    }
+    xSemaphoreGive(g_geo_mutex);
+
+    httpd_resp_set_type(req, "application/json");
+    if (valid) {
+        return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
+    }
+    if (!g_sta_connected) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "{\"error\":\"sta not connected\"}", HTTPD_RESP_USE_STRLEN);
+    }
+    if (failed) {
+        httpd_resp_set_status(req, "502 Bad Gateway");
+        return httpd_resp_send(req, "{\"error\":\"geo lookup failed\"}", HTTPD_RESP_USE_STRLEN);
+    }
+    httpd_resp_set_status(req, "202 Accepted");
+    return httpd_resp_send(req, "{\"pending\":true}", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handler_api_clear(httpd_req_t *req) {
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        memset(g_aps, 0, sizeof(g_aps));
+        ap_agg_clear(&g_agg, &g_idx);
+        memset(g_radios, 0, sizeof(g_radios));
+        taskENTER_CRITICAL(&g_hidden_mux);
+        memset(g_hidden, 0, sizeof(g_hidden));
+        g_hidden_waiting = g_hidden_found = 0;
+        taskEXIT_CRITICAL(&g_hidden_mux);
+        g_recent_head = g_recent_tail = -1;
+        g_ap_modified_ms = 0;
+        g_ap_generation++;
+        g_ap_changes++;
+        g_ap_count = 0;
+        g_ap_insert_index = 0;
+        xSemaphoreGive(g_ap_mutex);
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"status\":\"ok\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handler_api_scan_once(httpd_req_t *req) {
+    esp_err_t err = scan_run_sweep(false);
+    if (err == ESP_ERR_TIMEOUT) return send_scan_busy(req);
+
+    g_stats.total_scans++;
+    if (err == ESP_OK) {
+        g_stats.successful_scans++;
+    } else {
+        g_stats.failed_scans++;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"status\":\"ok\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+
+static esp_err_t handler_api_export_csv(httpd_req_t *req) {
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+
+    httpd_resp_set_type(req, "text/csv");
+    httpd_resp_set_hdr(req, "Content-Disposition",
+                       "attachment; filename=wardrive.csv");
+    stream_csv_export(&rs, query_u32(req, "per_radio", 0) != 0);
+    return stream_end(&rs);
+}
+
+static esp_err_t handler_api_security_analysis(httpd_req_t *req) {
+    uint32_t window_ms = query_window_ms(req);
+    analyze_security(window_ms);
+    char buf[1024];
+    snprintf(buf, sizeof(buf),
+             "{\"window_sec\":%lu,\"wep_count\":%lu,\"wpa_count\":%lu,\"wpa2_count\":%lu,"
+             "\"wpa3_count\":%lu,\"open_count\":%lu,\"hidden_count\":%lu,"
+             "\"hidden_resolved\":%lu,\"weak_signal_count\":%lu,\"channel_conflicts\":%lu}",
+             (unsigned long)(window_ms / 1000),
+             (unsigned long)g_security_stats.wep_count,
+             (unsigned long)g_security_stats.wpa_count,
+             (unsigned long)g_security_stats.wpa2_count,
+             (unsigned long)g_security_stats.wpa3_count,
+             (unsigned long)g_security_stats.open_count,
+             (unsigned long)g_security_stats.hidden_count,
+             (unsigned long)g_security_stats.hidden_resolved,
+             (unsigned long)g_security_stats.weak_signal_count,
+             (unsigned long)g_security_stats.channel_conflicts);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handler_api_channel_congestion(httpd_req_t *req) {
+    channel_analysis_t analysis[13];
+    int count = 0;
+    get_channel_congestion(analysis, &count, query_window_ms(req));
+
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "[");
+
+    for (int i = 0; i < count; i++) {
+        stream_printf(&rs,
+                      "%s{\"channel\":%u,\"ap_count\":%lu,\"radio_count\":%lu,"
+                      "\"congestion\":%.1f,\"airtime_pct\":",
+                      i > 0 ? "," : "",
+                      (unsigned)analysis[i].channel,
+                      (unsigned long)analysis[i].ap_count,
+                      (unsigned long)analysis[i].radio_count,
+                      analysis[i].congestion_score);
+        if (analysis[i].airtime_x10 < 0) {
+            stream_printf(&rs, "null");
+        } else {
+            stream_printf(&rs, "%d.%d", analysis[i].airtime_x10 / 10, analysis[i].airtime_x10 % 10);
+        }
+        if (analysis[i].loaded_aps == 0) {
+            stream_printf(&rs, ",\"loaded_aps\":0,\"clients\":null,\"load\":null}");
+        } else {
+            stream_printf(&rs, ",\"loaded_aps\":%u,\"clients\":%lu,\"load\":%lu}",
+                          analysis[i].loaded_aps,
+                          (unsigned long)analysis[i].clients,
+                          (unsigned long)analysis[i].load);
+        }
+    }
+
+    stream_printf(&rs, "]");
+    return stream_end(&rs);
+}
+
+// GET /api/airtime: cumulative busy time per channel and category plus the
+// measured utilization (null for channels the sniffer has not listened on
+// in the last AIRTIME_STALE_MS).
+static esp_err_t handler_api_airtime(httpd_req_t *req) {
+    airtime_channel_t air[AIRTIME_CHANNELS];
+    airtime_snapshot(air);
+    uint32_t now = now_ms();
+
+    uint8_t home = 0;
+    wifi_second_chan_t second;
+    esp_wifi_get_channel(&home, &second);
+
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "{\"home_channel\":%u,\"channels\":[", home);
+    for (int ch = 1; ch < AIRTIME_CHANNELS; ch++) {
+        const airtime_channel_t *a = &air[ch];
+        int util = airtime_util_x10(a, now);
+        stream_printf(&rs,
+                      "%s{\"channel\":%d,\"observed_ms\":%llu,\"frames\":%lu,"
+                      "\"mgmt_ms\":%llu,\"ctrl_ms\":%llu,\"data_ms\":%llu,",
+                      ch > 1 ? "," : "", ch,
+                      (unsigned long long)(a->observed_us / 1000),
+                      (unsigned long)a->frames,
+                      (unsigned long long)(a->busy_us[AIR_MGMT] / 1000),
+                      (unsigned long long)(a->busy_us[AIR_CTRL] / 1000),
+                      (unsigned long long)(a->busy_us[AIR_DATA] / 1000));
+        if (util < 0) {
+            stream_printf(&rs, "\"util_pct\":null,\"last_pct\":null}");
+        } else {
+            stream_printf(&rs, "\"util_pct\":%d.%d,\"last_pct\":%d.%d}",
+                          util / 10, util % 10, a->last_pct_x10 / 10, a->last_pct_x10 % 10);
+        }
+    }
+    stream_printf(&rs, "]}");
+    return stream_end(&rs);
+}
+
+// GET /api/frames: cumulative counts per frame kind (non-zero kinds only),
+// split by channel, plus the total frame rate per channel over the last
+// second.
+static esp_err_t handler_api_frames(httpd_req_t *req) {
+    uint32_t rate[AIRTIME_CHANNELS];
+    uint32_t end_ms;
+    taskENTER_CRITICAL(&g_frame_mux);
+    memcpy(rate, g_frame_hist.channel_rate, sizeof(rate));
+    end_ms = g_frame_hist.end_ms;
+    taskEXIT_CRITICAL(&g_frame_mux);
+
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "{\"sample_ms\":%lu,\"channel_rate\":[", (unsigned long)end_ms);
+    for (int ch = 1; ch < AIRTIME_CHANNELS; ch++) {
+        stream_printf(&rs, "%s%lu", ch > 1 ? "," : "", (unsigned long)rate[ch]);
+    }
+    stream_printf(&rs, "],\"kinds\":[");
+
+    bool first = true;
+    for (int k = 0; k < FRAME_KINDS; k++) {
+        uint32_t counts[AIRTIME_CHANNELS];
+        uint32_t total = 0;
+        for (int ch = 0; ch < AIRTIME_CHANNELS; ch++) {
+            counts[ch] = __atomic_load_n(&g_frame_counts[k][ch], __ATOMIC_RELAXED);
+            total += counts[ch];
+        }
+        if (!total) continue;
+
+        const char *name = frame_kind_name(k);
+        stream_printf(&rs, "%s{\"type\":\"%s\",\"subtype\":%d,\"name\":%s%s%s,\"total\":%lu,\"per_channel\":[",
+                      first ? "" : ",", frame_type_name(k), k & 0x0F,
+                      name ? "\"" : "", name ? name : "null", name ? "\"" : "",
+                      (unsigned long)total);
+        for (int ch = 1; ch < AIRTIME_CHANNELS; ch++) {
+            stream_printf(&rs, "%s%lu", ch > 1 ? "," : "", (unsigned long)counts[ch]);
+        }
+        stream_printf(&rs, "]}");
+        first = false;
+    }
+    stream_printf(&rs, "]}");
+    return stream_end(&rs);
+}
+
+// GET /api/frames/history?seconds=N&type=mgmt|ctrl|data
+// Per-second counts, oldest first, for every frame kind seen in the window.
+static esp_err_t handler_api_frames_history(httpd_req_t *req) {
+    uint32_t seconds = query_u32(req, "seconds", 60);
+    if (seconds < 1) seconds = 1;
+    if (seconds > FRAME_HIST_SECONDS) seconds = FRAME_HIST_SECONDS;
+
+    char query[64], type[8] = "";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "type", type, sizeof(type));
+    }
+
+    uint32_t end_seq, end_ms;
+    taskENTER_CRITICAL(&g_frame_mux);
+    end_seq = g_frame_hist.seq;
+    end_ms  = g_frame_hist.end_ms;
+    taskEXIT_CRITICAL(&g_frame_mux);
+    if (seconds > end_seq) seconds = end_seq;
+
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "{\"end_ms\":%lu,\"seconds\":%lu,\"series\":[",
+                  (unsigned long)end_ms, (unsigned long)seconds);
+
+    uint16_t values[FRAME_HIST_SECONDS];
+    bool first = true;
+    for (int k = 0; k < FRAME_KINDS && seconds; k++) {
+        if (type[0] && strcmp(type, frame_type_name(k)) != 0) continue;
+        if (!frame_hist_series(k, end_seq, seconds, values)) break;
+
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < seconds; i++) sum += values[i];
+        if (!sum) continue;
+
+        const char *name = frame_kind_name(k);
+        stream_printf(&rs, "%s{\"type\":\"%s\",\"subtype\":%d,\"name\":%s%s%s,\"values\":[",
+                      first ? "" : ",", frame_type_name(k), k & 0x0F,
+                      name ? "\"" : "", name ? name : "null", name ? "\"" : "");
+        for (uint32_t i = 0; i < seconds; i++) {
+            stream_printf(&rs, "%s%u", i ? "," : "", values[i]);
+        }
+        stream_printf(&rs, "]}");
+        first = false;
+    }
+    stream_printf(&rs, "]}");
+    return stream_end(&rs);
+}
+
+static esp_err_t handler_api_rogue_detection(httpd_req_t *req) {
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+
+    httpd_resp_set_type(req, "application/json");
+    stream_rogue_aps(&rs);
+    return stream_end(&rs);
+}
+
+// GET /api/security/beacon_timing: raw per-BSSID tracker state behind the
+// cloned-BSSID verdicts.
+static esp_err_t handler_api_beacon_timing(httpd_req_t *req) {
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "[");
+    bool first = true;
+    for (int i = 0; i < BT_TRACK_SIZE; i++) {
+        beacon_track_t t;
+        taskENTER_CRITICAL(&g_beacon_track_mux);
+        t = g_beacon_track[i];
+        taskEXIT_CRITICAL(&g_beacon_track_mux);
+        if (!t.total) continue;
+
+        char bssid_str[18];
+        mac_to_str(t.bssid, bssid_str, sizeof(bssid_str));
+        char conf[8] = "null";
+        int c = beacon_track_confidence(&t);
+        if (c >= 0) snprintf(conf, sizeof(conf), "%d", c);
+        stream_printf(&rs,
+                      "%s{\"bssid\":\"%s\",\"beacons\":%lu,\"window\":%u,\"tsf_back\":%u,"
+                      "\"tsf_skew\":%u,\"seq_back\":%u,\"jitter\":%u,\"rssi_jump\":%u,"
+                      "\"confidence\":%s}",
+                      first ? "" : ",", bssid_str, (unsigned long)t.total, t.beacons,
+                      t.tsf_back, t.tsf_skew, t.seq_back, t.jitter, t.rssi_jump, conf);
+        first = false;
+    }
+    stream_printf(&rs, "]");
+    return stream_end(&rs);
+}
+
+static esp_err_t handler_api_vulnerabilities(httpd_req_t *req) {
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+
+    httpd_resp_set_type(req, "application/json");
+    stream_vulnerable_networks(&rs);
+    return stream_end(&rs);
+}
+
+static esp_err_t handler_api_classifications(httpd_req_t *req) {
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "[");
+
+    bool first = true;
+    ap_info_t batch[STREAM_COPY_BATCH];
+    int slot = 0;
+    int n;
+    while ((n = ap_copy_batch(&slot, batch, STREAM_COPY_BATCH)) > 0) {
+        for (int i = 0; i < n; i++) {
+            ap_info_t *ap = &batch[i];
+
+            char bssid_str[18];
+            mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
+
+            stream_printf(&rs,
+                          "%s{\"ssid\":\"%s\",\"bssid\":\"%s\","
+                          "\"class_id\":%d,\"class_name\":\"%s\",\"class_detail\":\"%s\","
+                          "\"rssi\":%d,\"channel\":%u}",
+                          first ? "" : ",",
+                          ap->ssid[0] ? ap->ssid : "<hidden>",
+                          bssid_str,
+                          ap->classification,
+                          ap_class_name(ap->classification),
+                          ap_class_detail(ap->classification),
+                          (int)ap->rssi,
+                          (unsigned)ap->channel);
+            first = false;
+        }
+    }
+
+    stream_printf(&rs, "]");
+    return stream_end(&rs);
+}
+
+static esp_err_t handler_api_deauth(httpd_req_t *req) {
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "[");
+
+    bool first = true;
+    for (int i = 0; i < 32; i++) {
+        deauth_event_t *ev = &g_deauth_log[i];
+        if (!ev->count) continue;
+
+        char src[18], dst[18];
+        mac_to_str(ev->src, src, sizeof(src));
+        mac_to_str(ev->dst, dst, sizeof(dst));
+
+        stream_printf(&rs,
+                      "%s{\"src\":\"%s\",\"dst\":\"%s\",\"count\":%" PRIu32 ","
+                      "\"last_ms\":%" PRIu32 "}",
+                      first ? "" : ",",
+                      src, dst, ev->count, ev->last_time_ms);
+        first = false;
+    }
+
+    stream_printf(&rs, "]");
+    return stream_end(&rs);
+}
+
+static esp_err_t handler_api_packets_send(httpd_req_t *req) {
+    char buf[512];
+    int len = httpd_req_recv(req, buf, sizeof(buf) - 1);
+    if (len <= 0) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    buf[len] = 0;
+
+    char *bssid_str    = strstr(buf, "\"bssid\"");
+    char *type_str     = strstr(buf, "\"type\"");
+    char *count_str    = strstr(buf, "\"count\"");
+    char *interval_str = strstr(buf, "\"interval\"");
+
+    if (!bssid_str || !type_str || !count_str) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    char *bssid_val = strchr(bssid_str, ':');
+    if (!bssid_val) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    bssid_val++;
+    while (*bssid_val && (*bssid_val == ' ' || *bssid_val == '\"')) bssid_val++;
+    char bssid[18];
+    strncpy(bssid, bssid_val, 17);
+    bssid[17] = 0;
+    char *end = strchr(bssid, '\"');
+    if (end) *end = 0;
+
+    char *type_val = strchr(type_str, ':');
+    if (!type_val) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    type_val++;
+    while (*type_val && (*type_val == ' ' || *type_val == '\"')) type_val++;
+    char packet_type[16];
+    strncpy(packet_type, type_val, 15);
+    packet_type[15] = 0;
+    end = strchr(packet_type, '\"');
+    if (end) *end = 0;
+
+    char *count_val = strchr(count_str, ':');
+    if (!count_val) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    int count = atoi(count_val + 1);
+
+    int interval = 100;
+    if (interval_str) {
+        char *interval_val = strchr(interval_str, ':');
+        if (interval_val) {
+            interval = atoi(interval_val + 1);
+        }
+    }
+
+    ESP_LOGI(TAG, "Packet send request: %s to %s, count=%d, interval=%d",
+             packet_type, bssid, count, interval);
+
+    uint8_t target_mac[6];
+    str_to_mac(bssid, target_mac);
+
+    uint8_t broadcast[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+
+    // Try to move to the AP's channel for frame types that require being on-channel
+    uint8_t original_primary;
+    wifi_second_chan_t original_second;
+    esp_wifi_get_channel(&original_primary, &original_second);
+
+    uint8_t target_channel = 0;
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(250)) == pdTRUE) {
+        for (int i = 0; i < g_ap_count; i++) {
+            ap_info_t *ap = &g_aps[i];
+            if (ap->in_use && mac_equal(ap->bssid, target_mac)) {
+                target_channel = ap->channel;
+                break;
+            }
+        }
+        xSemaphoreGive(g_ap_mutex);
+    }
+
+    if (target_channel > 0 && target_channel <= 14 && strcmp(packet_type, "probe") != 0) {
+        esp_err_t ch_err = esp_wifi_set_channel(target_channel, WIFI_SECOND_CHAN_NONE);
+        if (ch_err == ESP_OK) {
+            ESP_LOGI(TAG, "Switched to channel %u for injection", (unsigned)target_channel);
+        } else {
+            ESP_LOGW(TAG, "Failed to switch channel to %u: %s", (unsigned)target_channel, esp_err_to_name(ch_err));
+        }
+    }
+
+    wifi_mode_t old_mode;
+    esp_wifi_get_mode(&old_mode);
+    bool changed_mode = false;
+    if (old_mode == WIFI_MODE_AP) {
+        if (esp_wifi_set_mode(WIFI_MODE_APSTA) == ESP_OK) {
+            changed_mode = true;
+        }
+    }
+
+    uint8_t frame[128];
+    size_t frame_len = 26;
+    int sent = 0;
+    int failed = 0;
+    esp_err_t last_err = ESP_OK;
+
+    for (int i = 0; i < count && i < 100; i++) {
+        if (strcmp(packet_type, "deauth") == 0) {
+            craft_deauth_frame(frame, broadcast, target_mac);
+            frame_len = 26;
+        } else if (strcmp(packet_type, "disassoc") == 0) {
+            craft_disassoc_frame(frame, broadcast, target_mac);
+            frame_len = 26;
+        } else if (strcmp(packet_type, "probe") == 0) {
+            craft_probe_request(frame, &frame_len, "test_probe");
+        }
+
+        esp_err_t err = esp_wifi_80211_tx(WIFI_IF_STA, frame, frame_len, false);
+        if (err == ESP_ERR_WIFI_IF) {
+            err = esp_wifi_80211_tx(WIFI_IF_AP, frame, frame_len, false);
+        }
+
+        if (err == ESP_OK) {
+            sent++;
+            g_packet_stats.packets_sent++;
+        } else {
+            failed++;
+            last_err = err;
+            ESP_LOGW(TAG, "Packet TX failed (%s) on try %d", esp_err_to_name(err), i);
+        }
+
+        if (i < count - 1) {
+            vTaskDelay(pdMS_TO_TICKS(interval));
+        }
+    }
+
+    if (changed_mode) {
+        esp_wifi_set_mode(old_mode);
+    }
+
+    if (target_channel > 0 && target_channel != original_primary) {
+        esp_wifi_set_channel(original_primary, original_second);
+        ESP_LOGI(TAG, "Restored channel to %u", (unsigned)original_primary);
+    }
+
+    char response[192];
+    if (failed == 0) {
+        snprintf(response, sizeof(response), "{\"status\":\"ok\",\"sent\":%d}", sent);
+    } else {
+        snprintf(response, sizeof(response),
+                 "{\"status\":\"partial\",\"sent\":%d,\"failed\":%d,\"error\":\"%s\"}",
+                 sent, failed, esp_err_to_name(last_err));
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handler_api_handshake_start(httpd_req_t *req) {
+    g_packet_stats.handshake_listening = true;
+    g_packet_stats.handshake_captured = 0;
+    update_promiscuous_filter();
+
+    ESP_LOGI(TAG, "Handshake capture enabled");
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"status\":\"listening\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handler_api_handshake_stop(httpd_req_t *req) {
+    g_packet_stats.handshake_listening = false;
+    update_promiscuous_filter();
+
+    ESP_LOGI(TAG, "Handshake capture disabled");
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"status\":\"stopped\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handler_api_handshake_status(httpd_req_t *req) {
+    char buf[128];
+    snprintf(buf, sizeof(buf),
+             "{\"listening\":%s,\"captured\":%lu}",
+             g_packet_stats.handshake_listening ? "true" : "false",
+             (unsigned long)g_packet_stats.handshake_captured);
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
+}
+
+// ======================= WARDRIVE ON/OFF ==========================
+
+static esp_err_t handler_api_wardrive_on(httpd_req_t *req) {
+    g_wardrive_on = true;
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"status\":\"on\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handler_api_wardrive_off(httpd_req_t *req) {
+    g_wardrive_on = false;
+    g_seen_state.save_req = true;   // persist the session's BSSIDs now
+    g_snap.save_req = true;
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"status\":\"off\"}", HTTPD_RESP_USE_STRLEN);
+}
+
+// ======================= SCAN MODE ==========================
+
+static esp_err_t send_scan_mode(httpd_req_t *req) {
+    char buf[640];
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"mode\":\"%s\",\"slice_channels\":%u,\"slice_gap_ms\":%u,"
+                     "\"home_dwell_ms\":%u,\"metrics\":{",
+                     scan_mode_str(g_scan_sched.mode),
+                     g_scan_sched.slice_channels,
+                     g_scan_sched.slice_gap_ms,
+                     g_scan_sched.home_dwell_ms);
+    for (int i = 0; i < SCAN_MODE_COUNT && n > 0 && n < (int)sizeof(buf); i++) {
+        const scan_mode_metrics_t *m = &g_scan_metrics[i];
+        n += snprintf(buf + n, sizeof(buf) - n,
+                      "%s\"%s\":{\"sweeps\":%lu,\"last_sweep_ms\":%lu,\"avg_sweep_ms\":%lu,"
+                      "\"max_away_ms\":%lu,\"rtt_samples\":%lu,\"rtt_avg_ms\":%lu,\"rtt_max_ms\":%lu}",
+                      i ? "," : "", scan_mode_str((scan_mode_t)i),
+                      (unsigned long)m->sweeps,
+                      (unsigned long)m->last_sweep_ms,
+                      (unsigned long)m->avg_sweep_ms,
+                      (unsigned long)m->max_away_ms,
+                      (unsigned long)m->rtt_samples,
+                      (unsigned long)m->rtt_avg_ms,
+                      (unsigned long)m->rtt_max_ms);
+    }
+    if (n > 0 && n < (int)sizeof(buf) - 2) {
+        n += snprintf(buf + n, sizeof(buf) - n, "}}");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handler_api_scan_mode_get(httpd_req_t *req) {
+    return send_scan_mode(req);
+}
 
-    uint16_t actual = num;
-    err = esp_wifi_scan_get_ap_records(&actual, records);
-    if (err != ESP_OK) {
-        free(records);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "scan read failed");
-        return err;
+// POST /api/scan/mode?mode=full|sliced&slice=N&gap_ms=N&home_dwell_ms=N
+// Any parameter may be omitted; the new schedule applies from the next sweep.
+static esp_err_t handler_api_scan_mode_set(httpd_req_t *req) {
+    char query[128];
+    char mode[12] = {0};
+    scan_sched_t sched = g_scan_sched;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "mode", mode, sizeof(mode)) == ESP_OK) {
+        if (strcmp(mode, "full") == 0) {
+            sched.mode = SCAN_MODE_FULL;
+        } else if (strcmp(mode, "sliced") == 0) {
+            sched.mode = SCAN_MODE_SLICED;
+        } else {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "mode must be full or sliced");
+            return ESP_FAIL;
+        }
     }
 
-    char *json_buf = malloc(JSON_BUF_SIZE);
-    if (!json_buf) {
-        free(records);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "oom");
-        return ESP_ERR_NO_MEM;
+    uint32_t slice = query_u32(req, "slice", sched.slice_channels);
+    uint32_t gap   = query_u32(req, "gap_ms", sched.slice_gap_ms);
+    uint32_t dwell = query_u32(req, "home_dwell_ms", sched.home_dwell_ms);
+    if (slice < 1 || slice > SCAN_CHANNEL_MAX || gap > 5000 || dwell > 255) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "slice 1-13, gap_ms <= 5000, home_dwell_ms <= 255");
+        return ESP_FAIL;
     }
+    sched.slice_channels = (uint8_t)slice;
+    sched.slice_gap_ms   = (uint16_t)gap;
+    sched.home_dwell_ms  = (uint8_t)dwell;
+
+    g_scan_sched = sched;
+    ESP_LOGI(TAG, "Scan mode %s, slice %u, gap %u ms, home dwell %u ms",
+             scan_mode_str(sched.mode), sched.slice_channels, sched.slice_gap_ms, sched.home_dwell_ms);
+    return send_scan_mode(req);
+}
 
-    size_t off = 0;
-    off += snprintf(json_buf + off, JSON_BUF_SIZE - off, "[");
-    bool first = true;
-
-    for (int i = 0; i < actual && off < JSON_BUF_SIZE - 128; i++) {
-        wifi_ap_record_t *r = &records[i];
-        char bssid[18];
-        mac_to_str(r->bssid, bssid, sizeof(bssid));
+// ======================= SCAN PROFILES API ==========================
 
-        if (!first) off += snprintf(json_buf + off, JSON_BUF_SIZE - off, ",");
+static void stream_channel_list(resp_stream_t *rs, uint16_t mask) {
+    stream_printf(rs, "[");
+    bool first = true;
+    for (int ch = 1; ch <= SCAN_CHANNEL_MAX; ch++) {
+        if (mask && !(mask & (1u << ch))) continue;
+        stream_printf(rs, "%s%d", first ? "" : ",", ch);
         first = false;
-
-        off += snprintf(json_buf + off, JSON_BUF_SIZE - off,
-                        "{\"ssid\":\"%s\",\"bssid\":\"%s\",\"rssi\":%d,\"channel\":%u,\"auth\":%u}",
-                        r->ssid[0] ? (char *)r->ssid : "<hidden>",
-                        bssid,
-                        (int)r->rssi,
-                        (unsigned)r->primary,
-                        (unsigned)r->authmode);
     }
+    stream_printf(rs, "]");
+}
 
-    off += snprintf(json_buf + off, JSON_BUF_SIZE - off, "]");
-
+// GET /api/profiles: every profile with its settings and measured discovery
+// rate (new BSSIDs per minute of wardriving under it).
+static esp_err_t handler_api_profiles(httpd_req_t *req) {
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
     httpd_resp_set_type(req, "application/json");
-    esp_err_t resp_err = httpd_resp_send(req, json_buf, off);
 
-    free(json_buf);
-    free(records);
-
-    return resp_err;
+    scan_profile_t active = profile_active();
+    stream_printf(&rs, "{\"active\":\"%s\",\"profiles\":[", active.name);
+    for (int i = 0; i < g_profiles.count; i++) {
+        const scan_profile_t *p = &g_profiles.p[i];
+        const profile_stats_t *ps = &g_profile_stats[i];
+        stream_printf(&rs,
+                      "%s{\"name\":\"%s\",\"builtin\":%s,\"interval_ms\":%u,\"dwell_ms\":%u,"
+                      "\"scan\":\"%s\",\"channels\":",
+                      i ? "," : "", p->name, i < (int)PROFILE_BUILTIN ? "true" : "false",
+                      p->interval_ms, p->dwell_ms, p->passive ? "passive" : "active");
+        stream_channel_list(&rs, p->channel_mask);
+        stream_printf(&rs,
+                      ",\"sniff\":{\"ctrl\":%s,\"data\":%s},\"evict\":\"%s\","
+                      "\"stats\":{\"sweeps\":%lu,\"active_s\":%lu,\"new_aps\":%lu,\"records\":%lu,",
+                      (p->sniff & SNIFF_CTRL) ? "true" : "false",
+                      (p->sniff & SNIFF_DATA) ? "true" : "false",
+                      k_evict_names[p->evict < EVICT_COUNT ? p->evict : EVICT_FIFO],
+                      (unsigned long)ps->sweeps, (unsigned long)(ps->active_ms / 1000),
+                      (unsigned long)ps->new_aps, (unsigned long)ps->records);
+        if (ps->active_ms >= 1000) {
+            stream_printf(&rs, "\"new_per_min\":%.1f}}", ps->new_aps * 60000.0 / ps->active_ms);
+        } else {
+            stream_printf(&rs, "\"new_per_min\":null}}");
+        }
+    }
+    stream_printf(&rs, "]}");
+    return stream_end(&rs);
 }
 
-static esp_err_t handler_api_wifi_connect(httpd_req_t *req) {
-    char body[256];
-    int received = httpd_req_recv(req, body, sizeof(body) - 1);
-    if (received <= 0) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "no body");
+// POST /api/profiles?name=X[&interval_ms=N&dwell_ms=N&scan=active|passive
+//   &channels=1,6,11&ctrl=0|1&data=0|1&evict=fifo|lru][&activate=1]
+// Creates or updates profile X; omitted fields keep their current value (or
+// the "walk" defaults for a new profile). Updating the active profile
+// applies it immediately.
+static esp_err_t handler_api_profiles_set(httpd_req_t *req) {
+    char query[192], name[PROFILE_NAME_LEN] = {0}, val[96];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "name", name, sizeof(name)) != ESP_OK || !name[0]) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "name required (max 11 chars)");
         return ESP_FAIL;
     }
-    body[received] = '\0';
-
-    wifi_config_t sta_cfg = {0};
+    for (const char *c = name; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '-' && *c != '_') {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "name: letters, digits, - and _");
+            return ESP_FAIL;
+        }
+    }
 
-    if (!parse_json_string(body, "ssid", (char *)sta_cfg.sta.ssid, sizeof(sta_cfg.sta.ssid))) {
-        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ssid missing");
+    int idx = profile_find(name);
+    if (idx < 0 && g_profiles.count >= PROFILE_MAX) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "profile table full");
         return ESP_FAIL;
     }
-    parse_json_string(body, "password", (char *)sta_cfg.sta.password, sizeof(sta_cfg.sta.password));
-    sta_cfg.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
-
-    strncpy(g_sta_ssid, (char *)sta_cfg.sta.ssid, sizeof(g_sta_ssid) - 1);
-    g_sta_ssid[sizeof(g_sta_ssid) - 1] = '\0';
-    g_sta_connected = false;
-    g_sta_ip[0] = '\0';
-
-    esp_wifi_disconnect();
-    esp_wifi_set_config(WIFI_IF_STA, &sta_cfg);
-    esp_wifi_connect();
-
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, "{\"status\":\"connecting\"}", HTTPD_RESP_USE_STRLEN);
-}
-
-typedef struct {
-    char   *buf;
-    size_t  len;
-    size_t  cap;
-} http_buf_t;
+    scan_profile_t p = idx >= 0 ? g_profiles.p[idx] : k_builtin_profiles[0];
+    strncpy(p.name, name, sizeof(p.name) - 1);
 
-static esp_err_t http_collect_handler(esp_http_client_event_t *evt) {
-    http_buf_t *hb = (http_buf_t *)evt->user_data;
-    if (!hb) return ESP_OK;
+    uint32_t interval = query_u32(req, "interval_ms", p.interval_ms);
+    uint32_t dwell    = query_u32(req, "dwell_ms", p.dwell_ms);
+    if (interval < 500 || interval > 60000 || dwell < 10 || dwell > 1500) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "interval_ms 500-60000, dwell_ms 10-1500");
+        return ESP_FAIL;
+    }
+    p.interval_ms = (uint16_t)interval;
+    p.dwell_ms    = (uint16_t)dwell;
 
-    if (evt->event_id == HTTP_EVENT_ON_DATA && evt->data && evt->data_len > 0) {
-        size_t to_copy = evt->data_len;
-        if (hb->len + to_copy >= hb->cap) {
-            to_copy = hb->cap - hb->len - 1;
+    if (httpd_query_key_value(query, "scan", val, sizeof(val)) == ESP_OK) {
+        if (strcmp(val, "active") && strcmp(val, "passive")) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "scan must be active or passive");
+            return ESP_FAIL;
         }
-        if (to_copy > 0) {
-            memcpy(hb->buf + hb->len, evt->data, to_copy);
-            hb->len += to_copy;
-            hb->buf[hb->len] = '\0';
+        p.passive = strcmp(val, "passive") == 0;
+    }
+    if (httpd_query_key_value(query, "channels", val, sizeof(val)) == ESP_OK) {
+        // Browsers send the commas as %2C.
+        url_decode(val);
+        uint16_t mask = 0;
+        for (char *tok = strtok(val, ","); tok; tok = strtok(NULL, ",")) {
+            char *end;
+            long ch = strtol(tok, &end, 10);
+            if (!isdigit((unsigned char)tok[0]) || *end || ch < 1 || ch > SCAN_CHANNEL_MAX) {
+                mask = 0;
+                break;
+            }
+            mask |= 1u << ch;
+        }
+        if (!mask) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "channels: comma list of 1-13");
+            return ESP_FAIL;
         }
+        p.channel_mask = mask == (((1u << SCAN_CHANNEL_MAX) - 1) << 1) ? 0 : mask;
     }
-    return ESP_OK;
+    if (query_u32(req, "ctrl", (p.sniff & SNIFF_CTRL) != 0)) p.sniff |= SNIFF_CTRL;
+    else                                                     p.sniff &= ~SNIFF_CTRL;
+    if (query_u32(req, "data", (p.sniff & SNIFF_DATA) != 0)) p.sniff |= SNIFF_DATA;
+    else                                                     p.sniff &= ~SNIFF_DATA;
+    if (httpd_query_key_value(query, "evict", val, sizeof(val)) == ESP_OK) {
+        int e = 0;
+        while (e < EVICT_COUNT && strcmp(val, k_evict_names[e])) e++;
+        if (e == EVICT_COUNT) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "evict must be fifo or lru");
+            return ESP_FAIL;
+        }
+        p.evict = (uint8_t)e;
+    }
+
+    if (idx < 0) {
+        idx = g_profiles.count++;
+        memset(&g_profile_stats[idx], 0, sizeof(g_profile_stats[idx]));
+    }
+    g_profiles.p[idx] = p;
+    if (idx == g_profile_idx || query_u32(req, "activate", 0)) profile_activate(idx);
+    profile_save();
+    return handler_api_profiles(req);
 }
 
-static esp_err_t handler_api_gps_network(httpd_req_t *req) {
+// POST /api/profile?name=X switches the active profile without touching the
+// radio; the next sweep uses it.
+static esp_err_t handler_api_profile_activate(httpd_req_t *req) {
+    char query[64], name[PROFILE_NAME_LEN] = {0};
+    int idx = -1;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "name", name, sizeof(name)) == ESP_OK) {
+        idx = profile_find(name);
+    }
+    if (idx < 0) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no such profile");
+        return ESP_FAIL;
+    }
+    profile_activate(idx);
+    profile_save();
+    return handler_api_profiles(req);
+}
 
-    // === FIX: check STA connection without using undefined macros ===
-    if (!g_sta_connected) {
-        httpd_resp_set_status(req, "503 Service Unavailable");
-        httpd_resp_set_type(req, "application/json");
-        return httpd_resp_send(req, "{\"error\":\"sta not connected\"}", HTTPD_RESP_USE_STRLEN);
+// POST /api/profiles/delete?name=X. Built-in profiles cannot be deleted;
+// deleting the active profile falls back to "walk".
+static esp_err_t handler_api_profiles_delete(httpd_req_t *req) {
+    char query[64], name[PROFILE_NAME_LEN] = {0};
+    int idx = -1;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "name", name, sizeof(name)) == ESP_OK) {
+        idx = profile_find(name);
+    }
+    if (idx < 0) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no such profile");
+        return ESP_FAIL;
+    }
+    if (idx < (int)PROFILE_BUILTIN) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "built-in profile");
+        return ESP_FAIL;
     }
 
-    char body[512] = {0};
-    http_buf_t hb = {.buf = body, .len = 0, .cap = sizeof(body)};
+    int active = g_profile_idx;
+    int tail = g_profiles.count - 1 - idx;
+    memmove(&g_profiles.p[idx], &g_profiles.p[idx + 1], tail * sizeof(g_profiles.p[0]));
+    memmove(&g_profile_stats[idx], &g_profile_stats[idx + 1], tail * sizeof(g_profile_stats[0]));
+    g_profiles.count--;
+    if (active == idx)     profile_activate(0);
+    else if (active > idx) profile_activate(active - 1);
+    profile_save();
+    return handler_api_profiles(req);
+}
 
-    esp_http_client_config_t cfg = {
-        .url = "http://ip-api.com/json/?fields=status,message,lat,lon,city,country,query",
-        .event_handler = http_collect_handler,
-        .user_data = &hb,
-    };
+// ======================= MOTION CADENCE API ==========================
 
-    esp_http_client_handle_t client = esp_http_client_init(&cfg);
-    if (!client) {
-        httpd_resp_set_status(req, "500 Internal Server Error");
-        return httpd_resp_send(req, "{\"error\":\"http init failed\"}", HTTPD_RESP_USE_STRLEN);
+static void stream_cadence_stats(resp_stream_t *rs, const cad_stats_t st[SPEED_BANDS]) {
+    cad_stats_t sum = {0};
+    stream_printf(rs, "{");
+    for (int b = 0; b < SPEED_BANDS; b++) {
+        sum.sweeps += st[b].sweeps;
+        sum.time_ms += st[b].time_ms;
+        sum.distance_m += st[b].distance_m;
+        sum.new_aps += st[b].new_aps;
     }
-
-    esp_err_t err = esp_http_client_perform(client);
-    int status = esp_http_client_get_status_code(client);
-    esp_http_client_cleanup(client);
-
-    // === FIX: replace undefined HTTPD_502_BAD_GATEWAY ===
-    if (err != ESP_OK || status != 200 || hb.len == 0) {
-        httpd_resp_set_status(req, "502 Bad Gateway");
-        httpd_resp_set_type(req, "application/json");
-        return httpd_resp_send(req, "{\"error\":\"geo lookup failed\"}", HTTPD_RESP_USE_STRLEN);
+    for (int b = 0; b <= SPEED_BANDS; b++) {
+        const cad_stats_t *c = b < SPEED_BANDS ? &st[b] : &sum;
+        stream_printf(rs, "%s\"%s\":{\"sweeps\":%lu,\"minutes\":%.1f,\"km\":%.2f,\"new_aps\":%lu,",
+                      b ? "," : "", b < SPEED_BANDS ? k_speed_band_names[b] : "total",
+                      (unsigned long)c->sweeps, c->time_ms / 60000.0, c->distance_m / 1000.0,
+                      (unsigned long)c->new_aps);
+        if (c->distance_m >= 100) {
+            stream_printf(rs, "\"new_per_km\":%.1f}", c->new_aps * 1000.0 / c->distance_m);
+        } else {
+            stream_printf(rs, "\"new_per_km\":null}");
+        }
     }
-
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, hb.buf, hb.len);
+    stream_printf(rs, "}");
 }
 
-static esp_err_t handler_api_clear(httpd_req_t *req) {
+// GET /api/cadence: current decision, motion estimate, decision log (oldest
+// first) and discovery per km by speed band for adaptive vs fixed cadence.
+static esp_err_t handler_api_cadence(httpd_req_t *req) {
+    cad_decision_t log[CAD_LOG];
+    cad_stats_t stats[2][SPEED_BANDS] = {0};
+    uint32_t now = now_ms();
+    motion_t m = {0};
     if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        memset(g_aps, 0, sizeof(g_aps));
-        g_ap_count = 0;
-        g_ap_insert_index = 0;
+        m = g_motion;
         xSemaphoreGive(g_ap_mutex);
     }
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, "{\"status\":\"ok\"}", HTTPD_RESP_USE_STRLEN);
-}
-
-static esp_err_t handler_api_scan_once(httpd_req_t *req) {
-    g_stats.total_scans++;
 
-    if (safe_scan_start() == ESP_OK) {
-        g_stats.successful_scans++;
-        update_ap_list_from_scan();
-    } else {
-        g_stats.failed_scans++;
+    bool enabled = false, fast = false;
+    uint16_t min_ms = 0, max_ms = 0, spacing_m = 0, next_mask = 0, log_count = 0;
+    uint32_t interval_ms = 0, yield_x100 = 0;
+    if (xSemaphoreTake(g_cadence_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        enabled = g_cadence.enabled;
+        fast = g_cadence.st.fast;
+        min_ms = g_cadence.min_ms;
+        max_ms = g_cadence.max_ms;
+        spacing_m = g_cadence.spacing_m;
+        next_mask = g_cadence.st.next_mask;
+        interval_ms = g_cadence.st.interval_ms;
+        yield_x100 = g_cadence.st.yield_x100;
+        log_count = g_cadence.log_count;
+        uint16_t start = (g_cadence.log_head + CAD_LOG - log_count) % CAD_LOG;
+        for (int i = 0; i < log_count; i++) log[i] = g_cadence.log[(start + i) % CAD_LOG];
+        memcpy(stats, g_cadence.stats, sizeof(stats));
+        xSemaphoreGive(g_cadence_mutex);
     }
 
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
     httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, "{\"status\":\"ok\"}", HTTPD_RESP_USE_STRLEN);
-}
 
+    scan_profile_t prof = profile_active();
+    bool fresh = m.fix_ms && now - m.fix_ms < CAD_FIX_MAX_AGE_MS;
+    stream_printf(&rs,
+                  "{\"enabled\":%s,\"min_ms\":%u,\"max_ms\":%u,\"spacing_m\":%u,"
+                  "\"interval_ms\":%lu,\"fast\":%s,\"yield_per_sweep\":%.2f,\"channels\":",
+                  enabled ? "true" : "false", min_ms, max_ms, spacing_m,
+                  (unsigned long)(enabled && interval_ms ? interval_ms : prof.interval_ms),
+                  fast ? "true" : "false", yield_x100 / 100.0);
+    stream_channel_list(&rs, enabled && next_mask ? next_mask : prof.channel_mask);
+
+    stream_printf(&rs, ",\"motion\":{\"band\":\"%s\",\"odometer_km\":%.2f,\"rejected\":%lu",
+                  k_speed_band_names[speed_band(m.speed_cms, fresh)],
+                  m.odometer_m / 1000.0, (unsigned long)m.rejected);
+    if (fresh) {
+        stream_printf(&rs, ",\"speed_kmh\":%.1f,\"speed_source\":\"%s\",\"fix_age_ms\":%lu",
+                      m.speed_cms * 0.036, m.speed_reported ? "gps" : "derived",
+                      (unsigned long)(now - m.fix_ms));
+        if (m.heading_deg >= 0) stream_printf(&rs, ",\"heading\":%d", m.heading_deg);
+    }
+    stream_printf(&rs, "},\"log\":[");
+
+    for (int i = 0; i < log_count; i++) {
+        const cad_decision_t *d = &log[i];
+        stream_printf(&rs,
+                      "%s{\"age_s\":%lu,\"reason\":\"%s\",\"speed_kmh\":%.1f,\"heading\":%d,"
+                      "\"yield\":%.2f,\"interval_ms\":%u,\"channels\":",
+                      i ? "," : "", (unsigned long)((now - d->t_ms) / 1000),
+                      k_cad_reason_names[d->reason < CAD_R_COUNT ? d->reason : CAD_R_SPEED],
+                      d->speed_cms * 0.036, d->heading_deg, d->yield_x100 / 100.0,
+                      d->interval_ms);
+        stream_channel_list(&rs, d->channel_mask ? d->channel_mask : prof.channel_mask);
+        stream_printf(&rs, "}");
+    }
+
+    stream_printf(&rs, "],\"per_km\":{\"adaptive\":");
+    stream_cadence_stats(&rs, stats[1]);
+    stream_printf(&rs, ",\"fixed\":");
+    stream_cadence_stats(&rs, stats[0]);
+    stream_printf(&rs, "}}");
+    return stream_end(&rs);
+}
 
-static esp_err_t handler_api_export_csv(httpd_req_t *req) {
-    char *csv_buf = malloc(JSON_BUF_SIZE);
-    if (!csv_buf) {
-        httpd_resp_send_500(req);
+// POST /api/cadence?enabled=0|1&min_ms=N&max_ms=N&spacing_m=N[&reset=1]
+// Disabled means the active profile's fixed interval and channel set.
+static esp_err_t handler_api_cadence_set(httpd_req_t *req) {
+    uint32_t enabled = query_u32(req, "enabled", g_cadence.enabled);
+    uint32_t min_ms  = query_u32(req, "min_ms", g_cadence.min_ms);
+    uint32_t max_ms  = query_u32(req, "max_ms", g_cadence.max_ms);
+    uint32_t spacing = query_u32(req, "spacing_m", g_cadence.spacing_m);
+    if (min_ms < 250 || max_ms > 60000 || min_ms > max_ms || spacing < 10 || spacing > 1000) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                            "250 <= min_ms <= max_ms <= 60000, spacing_m 10-1000");
         return ESP_FAIL;
     }
-    build_csv_export(csv_buf, JSON_BUF_SIZE);
 
-    httpd_resp_set_type(req, "text/csv");
-    httpd_resp_set_hdr(req, "Content-Disposition",
-                       "attachment; filename=wardrive.csv");
-    esp_err_t ret = httpd_resp_send(req, csv_buf, strlen(csv_buf));
-    free(csv_buf);
-    return ret;
+    bool reset = query_u32(req, "reset", 0) != 0;
+    if (xSemaphoreTake(g_cadence_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "cadence busy");
+        return ESP_FAIL;
+    }
+    g_cadence.enabled   = enabled != 0;
+    g_cadence.min_ms    = (uint16_t)min_ms;
+    g_cadence.max_ms    = (uint16_t)max_ms;
+    g_cadence.spacing_m = (uint16_t)spacing;
+    g_cadence.st.interval_ms = 0;   // re-decide from scratch on the next sweep
+    g_cadence.epoch++;
+    if (reset) {
+        memset(g_cadence.stats, 0, sizeof(g_cadence.stats));
+        g_cadence.log_count = 0;
+    }
+    xSemaphoreGive(g_cadence_mutex);
+    if (g_wardrive_task) xTaskNotifyGive(g_wardrive_task);
+    return handler_api_cadence(req);
 }
 
-static esp_err_t handler_api_security_analysis(httpd_req_t *req) {
-    analyze_security();
-    char buf[1024];
-    snprintf(buf, sizeof(buf),
-             "{\"wep_count\":%lu,\"wpa_count\":%lu,\"wpa2_count\":%lu,"
-             "\"wpa3_count\":%lu,\"open_count\":%lu,\"hidden_count\":%lu,"
-             "\"weak_signal_count\":%lu,\"channel_conflicts\":%lu}",
-             (unsigned long)g_security_stats.wep_count,
-             (unsigned long)g_security_stats.wpa_count,
-             (unsigned long)g_security_stats.wpa2_count,
-             (unsigned long)g_security_stats.wpa3_count,
-             (unsigned long)g_security_stats.open_count,
-             (unsigned long)g_security_stats.hidden_count,
-             (unsigned long)g_security_stats.weak_signal_count,
-             (unsigned long)g_security_stats.channel_conflicts);
+// ======================= UNIQUE AP ESTIMATES ==========================
 
+// GET /api/unique: session-wide distinct BSSID estimates. Channels and auth
+// modes with an empty sketch are omitted.
+static esp_err_t handler_api_unique(httpd_req_t *req) {
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
     httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
-}
 
-static esp_err_t handler_api_channel_congestion(httpd_req_t *req) {
-    channel_analysis_t analysis[13];
-    int count = 0;
-    get_channel_congestion(analysis, &count);
+    int err = hll_err_x10(HLL_P_TOTAL);
+    int sub_err = hll_err_x10(HLL_P_SUB);
+    stream_printf(&rs,
+                  "{\"total\":%lu,\"err_pct\":%d.%d,\"table_aps\":%d,\"sub_err_pct\":%d.%d,\"channels\":[",
+                  (unsigned long)unique_estimate(g_unique.total, HLL_P_TOTAL),
+                  err / 10, err % 10, g_ap_count, sub_err / 10, sub_err % 10);
 
-    char *buf = malloc(4096);
-    if (!buf) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+    bool first = true;
+    for (int ch = 1; ch < HLL_CHANNELS; ch++) {
+        uint32_t est = unique_estimate(g_unique.channel[ch], HLL_P_SUB);
+        if (!est) continue;
+        stream_printf(&rs, "%s{\"channel\":%d,\"est\":%lu}", first ? "" : ",", ch, (unsigned long)est);
+        first = false;
     }
 
-    size_t off = 0;
-    off += snprintf(buf + off, 4096 - off, "[");
-
-    for (int i = 0; i < count; i++) {
-        if (i > 0) off += snprintf(buf + off, 4096 - off, ",");
-        off += snprintf(buf + off, 4096 - off,
-                        "{\"channel\":%u,\"ap_count\":%lu,\"congestion\":%.1f}",
-                        (unsigned)analysis[i].channel,
-                        (unsigned long)analysis[i].ap_count,
-                        analysis[i].congestion_score);
+    stream_printf(&rs, "],\"auth\":[");
+    first = true;
+    for (int a = 0; a < HLL_AUTH_MAX; a++) {
+        uint32_t est = unique_estimate(g_unique.auth[a], HLL_P_SUB);
+        if (!est) continue;
+        stream_printf(&rs, "%s{\"auth\":\"%s\",\"est\":%lu}",
+                      first ? "" : ",", auth_mode_to_str((wifi_auth_mode_t)a), (unsigned long)est);
+        first = false;
     }
-
-    off += snprintf(buf + off, 4096 - off, "]");
-
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t ret = httpd_resp_send(req, buf, off);
-    free(buf);
-    return ret;
+    stream_printf(&rs, "]}");
+    return stream_end(&rs);
 }
 
-static esp_err_t handler_api_rogue_detection(httpd_req_t *req) {
-    char *buf = malloc(8192);
-    if (!buf) {
-        httpd_resp_send_500(req);
+// GET /api/unique/sketch: header followed by the raw registers. Copied in
+// chunks; registers only grow, so a torn copy is still a valid sketch.
+static esp_err_t handler_api_unique_sketch_get(httpd_req_t *req) {
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=unique.hll");
+    if (httpd_resp_send_chunk(req, (const char *)&k_unique_hdr, sizeof(k_unique_hdr)) != ESP_OK) {
         return ESP_FAIL;
     }
-    detect_rogue_aps(buf, 8192);
 
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t ret = httpd_resp_send(req, buf, strlen(buf));
-    free(buf);
-    return ret;
+    const uint8_t *regs = (const uint8_t *)&g_unique;
+    uint8_t chunk[256];
+    for (size_t off = 0; off < sizeof(g_unique); off += sizeof(chunk)) {
+        size_t n = sizeof(g_unique) - off;
+        if (n > sizeof(chunk)) n = sizeof(chunk);
+        taskENTER_CRITICAL(&g_unique_mux);
+        memcpy(chunk, regs + off, n);
+        taskEXIT_CRITICAL(&g_unique_mux);
+        if (httpd_resp_send_chunk(req, (const char *)chunk, n) != ESP_OK) return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
 }
 
-static esp_err_t handler_api_vulnerabilities(httpd_req_t *req) {
-    char *buf = malloc(8192);
-    if (!buf) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+static int recv_exact(httpd_req_t *req, uint8_t *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        int n = httpd_req_recv(req, (char *)buf + got, len - got);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) return -1;
+        got += n;
     }
-    get_vulnerable_networks(buf, 8192);
-
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t ret = httpd_resp_send(req, buf, strlen(buf));
-    free(buf);
-    return ret;
+    return 0;
 }
 
-static esp_err_t handler_api_classifications(httpd_req_t *req) {
-    char *buf = malloc(JSON_BUF_SIZE);
-    if (!buf) {
-        httpd_resp_send_500(req);
+// POST /api/unique/sketch[?replace=1]: body is a sketch from
+// GET /api/unique/sketch (any session or device). Merged by register-wise
+// max, or loaded over the current sketch with replace=1. The body is
+// received into a scratch sketch first, so a short or failed upload leaves
+// the live one untouched.
+static esp_err_t handler_api_unique_sketch_merge(httpd_req_t *req) {
+    if (req->content_len != sizeof(k_unique_hdr) + sizeof(g_unique)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "body must be one sketch from /api/unique/sketch");
         return ESP_FAIL;
     }
-    size_t off = 0;
-    off += snprintf(buf + off, JSON_BUF_SIZE - off, "[");
-
-    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        bool first = true;
-        for (int i = 0; i < g_ap_count && off < JSON_BUF_SIZE - 256; i++) {
-            ap_info_t *ap = &g_aps[i];
-            if (!ap->in_use) continue;
 
-            if (!first) off += snprintf(buf + off, JSON_BUF_SIZE - off, ",");
-            first = false;
+    unique_sketch_hdr_t hdr;
+    if (recv_exact(req, (uint8_t *)&hdr, sizeof(hdr)) != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "short body");
+        return ESP_FAIL;
+    }
+    if (memcmp(&hdr, &k_unique_hdr, sizeof(hdr)) != 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "sketch format mismatch");
+        return ESP_FAIL;
+    }
 
-            char bssid_str[18];
-            mac_to_str(ap->bssid, bssid_str, sizeof(bssid_str));
+    unique_sketch_t *in = mem_alloc(MEM_ANALYTICS, sizeof(*in));
+    if (!in) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "out of memory");
+        return ESP_FAIL;
+    }
+    if (recv_exact(req, (uint8_t *)in, sizeof(*in)) != 0) {
+        mem_free(MEM_ANALYTICS, in, sizeof(*in));
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "short body");
+        return ESP_FAIL;
+    }
 
-            off += snprintf(buf + off, JSON_BUF_SIZE - off,
-                            "{\"ssid\":\"%s\",\"bssid\":\"%s\","
-                            "\"class_id\":%d,\"class_name\":\"%s\",\"class_detail\":\"%s\"," 
-                            "\"rssi\":%d,\"channel\":%u}",
-                            ap->ssid[0] ? ap->ssid : "<hidden>",
-                            bssid_str,
-                            ap->classification,
-                            ap_class_name(ap->classification),
-                            ap_class_detail(ap->classification),
-                            (int)ap->rssi,
-                            (unsigned)ap->channel);
+    bool replace = query_u32(req, "replace", 0) != 0;
+    if (replace) {
+        taskENTER_CRITICAL(&g_unique_mux);
+        memcpy(&g_unique, in, sizeof(g_unique));
+        taskEXIT_CRITICAL(&g_unique_mux);
+    } else {
+        // Registers only grow, so merging a chunk at a time keeps each
+        // critical section short and every intermediate state valid.
+        uint8_t *regs = (uint8_t *)&g_unique;
+        const uint8_t *src = (const uint8_t *)in;
+        for (size_t off = 0; off < sizeof(g_unique); off += 256) {
+            size_t n = sizeof(g_unique) - off;
+            if (n > 256) n = 256;
+            taskENTER_CRITICAL(&g_unique_mux);
+            for (size_t i = 0; i < n; i++) {
+                if (regs[off + i] < src[off + i]) regs[off + i] = src[off + i];
+            }
+            taskEXIT_CRITICAL(&g_unique_mux);
         }
-        xSemaphoreGive(g_ap_mutex);
     }
+    mem_free(MEM_ANALYTICS, in, sizeof(*in));
 
-    off += snprintf(buf + off, JSON_BUF_SIZE - off, "]");
-
-    httpd_resp_set_type(req, "application/json");
-    esp_err_t r = httpd_resp_send(req, buf, off);
-    free(buf);
-    return r;
+    ESP_LOGI(TAG, "%s unique-AP sketch", replace ? "Loaded" : "Merged");
+    return handler_api_unique(req);
 }
 
-static esp_err_t handler_api_deauth(httpd_req_t *req) {
-    char *buf = malloc(4096);
-    if (!buf) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
-    size_t off = 0;
-    off += snprintf(buf + off, 4096 - off, "[");
-
-    bool first = true;
-    for (int i = 0; i < 32; i++) {
-        deauth_event_t *ev = &g_deauth_log[i];
-        if (!ev->count) continue;
-
-        char src[18], dst[18];
-        mac_to_str(ev->src, src, sizeof(src));
-        mac_to_str(ev->dst, dst, sizeof(dst));
+// POST /api/unique/reset: start a new session count. The AP table is not
+// touched (and /api/aps/clear leaves the sketches alone).
+static esp_err_t handler_api_unique_reset(httpd_req_t *req) {
+    taskENTER_CRITICAL(&g_unique_mux);
+    memset(&g_unique, 0, sizeof(g_unique));
+    taskEXIT_CRITICAL(&g_unique_mux);
+    return handler_api_unique(req);
+}
 
-        if (!first) off += snprintf(buf + off, 4096 - off, ",");
-        first = false;
+// ======================= SEEN-BEFORE FILTER API ==========================
 
-        off += snprintf(buf + off, 4096 - off,
-                        "{\"src\":\"%s\",\"dst\":\"%s\",\"count\":%" PRIu32 ","
-                        "\"last_ms\":%" PRIu32 "}",
-                        src, dst, ev->count, ev->last_time_ms);
+static esp_err_t send_seen_state(httpd_req_t *req) {
+    uint32_t set = 0;
+    uint32_t inserted = 0;
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        for (size_t i = 0; i < sizeof(g_seen.bits); i++) {
+            set += __builtin_popcount(g_seen.bits[i]);
+        }
+        inserted = g_seen.inserted;
+        xSemaphoreGive(g_ap_mutex);
     }
 
-    off += snprintf(buf + off, 4096 - off, "]");
+    // False-positive rate is (fraction of bits set) ^ probes.
+    float fill = (float)set / SEEN_BITS;
+    float fp = powf(fill, SEEN_PROBES) * 100.0f;
+
+    char buf[320];
+    snprintf(buf, sizeof(buf),
+             "{\"bssids\":%lu,\"from_flash\":%lu,\"returning_aps\":%lu,\"bits_set\":%lu,"
+             "\"fill_pct\":%.1f,\"false_pos_pct\":%.2f,\"saves\":%lu,\"last_save_ms\":%lu,"
+             "\"dirty\":%s,\"last_error\":\"%s\"}",
+             (unsigned long)inserted,
+             (unsigned long)g_seen_state.loaded,
+             (unsigned long)g_agg.returning_count,
+             (unsigned long)set,
+             fill * 100.0f, fp,
+             (unsigned long)g_seen_state.saves,
+             (unsigned long)g_seen_state.last_save_ms,
+             g_seen_state.dirty ? "true" : "false",
+             esp_err_to_name(g_seen_state.last_err));
 
     httpd_resp_set_type(req, "application/json");
-    esp_err_t ret = httpd_resp_send(req, buf, off);
-    free(buf);
-    return ret;
+    return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
 }
 
-static esp_err_t handler_api_packets_send(httpd_req_t *req) {
-    char buf[512];
-    int len = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (len <= 0) {
+static esp_err_t handler_api_seen(httpd_req_t *req) {
+    return send_seen_state(req);
+}
+
+// POST /api/seen/clear: forget every previous session. APs already in the
+// table keep their returning flag until they are evicted.
+static esp_err_t handler_api_seen_clear(httpd_req_t *req) {
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
-    buf[len] = 0;
+    memset(g_seen.bits, 0, sizeof(g_seen.bits));
+    g_seen.inserted = 0;
+    g_seen_state.loaded = 0;
+    g_seen_state.dirty = true;
+    g_seen_state.save_req = true;
+    xSemaphoreGive(g_ap_mutex);
+
+    ESP_LOGI(TAG, "Seen-before filter cleared");
+    return send_seen_state(req);
+}
 
-    char *bssid_str    = strstr(buf, "\"bssid\"");
-    char *type_str     = strstr(buf, "\"type\"");
-    char *count_str    = strstr(buf, "\"count\"");
-    char *interval_str = strstr(buf, "\"interval\"");
+// ======================= COVERAGE GRID API ==========================
 
-    if (!bssid_str || !type_str || !count_str) {
-        httpd_resp_send_500(req);
+// POST /api/gps/fix?lat=&lon=&acc=[&fix_age_ms=]: decimal degrees, accuracy
+// in metres. Fixes coarser than GRID_FIX_MAX_ACC_M are kept but not binned.
+static esp_err_t handler_api_gps_fix(httpd_req_t *req) {
+    if (!gps_fix_from_query(req)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "lat and lon required");
         return ESP_FAIL;
     }
+    httpd_resp_set_status(req, "204 No Content");
+    return httpd_resp_send(req, NULL, 0);
+}
 
-    char *bssid_val = strchr(bssid_str, ':');
-    if (!bssid_val) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
-    bssid_val++;
-    while (*bssid_val && (*bssid_val == ' ' || *bssid_val == '\"')) bssid_val++;
-    char bssid[18];
-    strncpy(bssid, bssid_val, 17);
-    bssid[17] = 0;
-    char *end = strchr(bssid, '\"');
-    if (end) *end = 0;
+#define GRID_COPY_BATCH 8
+
+// GET /api/grid[?lat_min=&lat_max=&lon_min=&lon_max=]: cells overlapping the
+// bounding box (all cells without one). lat/lon are the cell's south-west
+// corner; aps is a distinct-BSSID estimate.
+static esp_err_t handler_api_grid(httpd_req_t *req) {
+    int32_t lat_min = -900000000, lat_max = 900000000;
+    int32_t lon_min = -1800000000, lon_max = 1800000000;
+    query_coord_e7(req, "lat_min", 90, &lat_min);
+    query_coord_e7(req, "lat_max", 90, &lat_max);
+    query_coord_e7(req, "lon_min", 180, &lon_min);
+    query_coord_e7(req, "lon_max", 180, &lon_max);
+    int32_t lat_lo = grid_index(lat_min), lat_hi = grid_index(lat_max);
+    int32_t lon_lo = grid_index(lon_min), lon_hi = grid_index(lon_max);
+
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
 
-    char *type_val = strchr(type_str, ':');
-    if (!type_val) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
-    type_val++;
-    while (*type_val && (*type_val == ' ' || *type_val == '\"')) type_val++;
-    char packet_type[16];
-    strncpy(packet_type, type_val, 15);
-    packet_type[15] = 0;
-    end = strchr(packet_type, '\"');
-    if (end) *end = 0;
+    uint32_t now = now_ms();
+    gps_fix_t fix = {0};
+    uint32_t evictions = 0;
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        fix = g_gps_fix;
+        evictions = g_grid_evictions;
+        xSemaphoreGive(g_ap_mutex);
+    }
 
-    char *count_val = strchr(count_str, ':');
-    if (!count_val) {
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
+    stream_printf(&rs, "{\"cell_deg\":%.4f,\"capacity\":%d,\"evictions\":%lu,\"fix\":",
+                  GRID_CELL_E7 / 1e7, GRID_CELLS, (unsigned long)evictions);
+    if (fix.valid) {
+        stream_printf(&rs, "{\"lat\":%.7f,\"lon\":%.7f,\"acc_m\":%u,\"age_ms\":%lu}",
+                      fix.lat_e7 / 1e7, fix.lon_e7 / 1e7, fix.acc_m,
+                      (unsigned long)(now - fix.at_ms));
+    } else {
+        stream_printf(&rs, "null");
     }
-    int count = atoi(count_val + 1);
+    stream_printf(&rs, ",\"cells\":[");
 
-    int interval = 100;
-    if (interval_str) {
-        char *interval_val = strchr(interval_str, ':');
-        if (interval_val) {
-            interval = atoi(interval_val + 1);
+    bool first = true;
+    for (int base = 0; base < GRID_CELLS; base += GRID_COPY_BATCH) {
+        grid_cell_t batch[GRID_COPY_BATCH];
+        if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) break;
+        memcpy(batch, &g_grid[base], sizeof(batch));
+        xSemaphoreGive(g_ap_mutex);
+
+        for (int i = 0; i < GRID_COPY_BATCH; i++) {
+            const grid_cell_t *c = &batch[i];
+            if (!c->in_use ||
+                c->lat_idx < lat_lo || c->lat_idx > lat_hi ||
+                c->lon_idx < lon_lo || c->lon_idx > lon_hi) {
+                continue;
+            }
+            stream_printf(&rs,
+                          "%s{\"lat\":%.4f,\"lon\":%.4f,\"aps\":%lu,\"best_rssi\":%d,"
+                          "\"samples\":%u,\"age_s\":%lu,\"auth\":{",
+                          first ? "" : ",",
+                          (double)c->lat_idx * GRID_CELL_E7 / 1e7,
+                          (double)c->lon_idx * GRID_CELL_E7 / 1e7,
+                          (unsigned long)hll_estimate(c->aps, GRID_HLL_P),
+                          (int)c->best_rssi,
+                          c->samples,
+                          (unsigned long)((now - c->last_ms) / 1000));
+            for (int a = 0; a < GRID_AUTH_COUNT; a++) {
+                stream_printf(&rs, "%s\"%s\":%u", a ? "," : "", k_grid_auth_names[a], c->auth[a]);
+            }
+            stream_printf(&rs, "}}");
+            first = false;
         }
     }
 
-    ESP_LOGI(TAG, "Packet send request: %s to %s, count=%d, interval=%d",
-             packet_type, bssid, count, interval);
+    stream_printf(&rs, "]}");
+    return stream_end(&rs);
+}
 
-    uint8_t target_mac[6];
-    str_to_mac(bssid, target_mac);
+static esp_err_t handler_api_grid_clear(httpd_req_t *req) {
+    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        memset(g_grid, 0, sizeof(g_grid));
+        g_grid_evictions = 0;
+        xSemaphoreGive(g_ap_mutex);
+    }
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, "{\"status\":\"ok\"}", HTTPD_RESP_USE_STRLEN);
+}
 
-    uint8_t broadcast[6] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+// ======================= SNAPSHOT API ==========================
 
-    // Try to move to the AP's channel for frame types that require being on-channel
-    uint8_t original_primary;
-    wifi_second_chan_t original_second;
-    esp_wifi_get_channel(&original_primary, &original_second);
+static esp_err_t send_snapshot_state(httpd_req_t *req) {
+    char buf[384];
+    snprintf(buf, sizeof(buf),
+             "{\"ready\":%s,\"bytes\":%lu,\"raw_bytes\":%lu,\"chunks\":%d,"
+             "\"last_write_bytes\":%lu,\"last_write_chunks\":%lu,\"write_us\":%lu,"
+             "\"restore_us\":%lu,\"restored_aps\":%lu,\"saves\":%lu,\"skipped\":%lu,\"last_save_ms\":%lu,"
+             "\"save_pending\":%s,\"last_error\":\"%s\"}",
+             g_snap.ready ? "true" : "false",
+             (unsigned long)g_snap.bytes,
+             (unsigned long)(g_ap_count * sizeof(ap_info_t)),
+             SNAP_CHUNKS,
+             (unsigned long)g_snap.write_bytes,
+             (unsigned long)g_snap.write_chunks,
+             (unsigned long)g_snap.write_us,
+             (unsigned long)g_snap.restore_us,
+             (unsigned long)g_snap.restored_aps,
+             (unsigned long)g_snap.saves,
+             (unsigned long)g_snap.skipped,
+             (unsigned long)g_snap.last_save_ms,
+             g_snap.save_req ? "true" : "false",
+             esp_err_to_name(g_snap.last_err));
 
-    uint8_t target_channel = 0;
-    if (xSemaphoreTake(g_ap_mutex, pdMS_TO_TICKS(250)) == pdTRUE) {
-        for (int i = 0; i < g_ap_count; i++) {
-            ap_info_t *ap = &g_aps[i];
-            if (ap->in_use && mac_equal(ap->bssid, target_mac)) {
-                target_channel = ap->channel;
-                break;
-            }
-        }
-        xSemaphoreGive(g_ap_mutex);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t handler_api_snapshot(httpd_req_t *req) {
+    return send_snapshot_state(req);
+}
+
+// POST /api/snapshot/save: write on the next wardrive_task pass (within
+// SCAN_INTERVAL_MS) instead of waiting for SNAP_INTERVAL_MS.
+static esp_err_t handler_api_snapshot_save(httpd_req_t *req) {
+    g_snap.save_req = true;
+    return send_snapshot_state(req);
+}
+
+// ======================= TASK STATS API ==========================
+
+static void mem_register_statics(void) {
+    g_mem[MEM_AP_TABLE].static_bytes  = sizeof(g_aps) + sizeof(g_agg) + sizeof(g_idx) +
+                                        sizeof(g_radios);
+    g_mem[MEM_RESPONSES].static_bytes = sizeof(g_resp_pool);
+    g_mem[MEM_SNIFFER].static_bytes   = sizeof(g_ie_cache) + sizeof(g_beacon_track) +
+                                        sizeof(g_air_busy_us) + sizeof(g_airtime) +
+                                        sizeof(g_frame_counts) + sizeof(g_clients) +
+                                        sizeof(g_hidden) + sizeof(g_deauth_log);
+    g_mem[MEM_ANALYTICS].static_bytes = sizeof(g_unique) + sizeof(g_unique_scratch) + sizeof(g_grid) +
+                                        sizeof(g_frame_hist) + sizeof(g_task_hist);
+    g_mem[MEM_PERSIST].static_bytes   = sizeof(g_seen) + sizeof(g_snap_buf) + sizeof(g_snap_vol) +
+                                        sizeof(g_snap_order);
+}
+
+// GET /api/tasks[?history=0]: per-task CPU and stack, tagged memory and the
+// sample history (oldest first).
+static esp_err_t handler_api_tasks(httpd_req_t *req) {
+    task_acct_t tasks[TASK_MAX] = {0};
+    uint16_t busy_x10 = 0;
+    if (xSemaphoreTake(g_task_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+        memcpy(tasks, g_task_acct, sizeof(tasks));
+        busy_x10 = g_task_busy_x10;
+        xSemaphoreGive(g_task_mutex);
     }
 
-    if (target_channel > 0 && target_channel <= 14 && strcmp(packet_type, "probe") != 0) {
-        esp_err_t ch_err = esp_wifi_set_channel(target_channel, WIFI_SECOND_CHAN_NONE);
-        if (ch_err == ESP_OK) {
-            ESP_LOGI(TAG, "Switched to channel %u for injection", (unsigned)target_channel);
-        } else {
-            ESP_LOGW(TAG, "Failed to switch channel to %u: %s", (unsigned)target_channel, esp_err_to_name(ch_err));
-        }
+    resp_stream_t rs;
+    if (!stream_begin(&rs, req)) return ESP_OK;
+    httpd_resp_set_type(req, "application/json");
+
+    stream_printf(&rs, "{\"runtime_stats\":%s,\"sample_ms\":%d,\"busy_pct\":%u.%u,\"tasks\":[",
+                  TASK_RUNTIME_STATS ? "true" : "false", TASK_SAMPLE_MS, busy_x10 / 10, busy_x10 % 10);
+    bool first = true;
+    for (int i = 0; i < TASK_MAX; i++) {
+        const task_acct_t *t = &tasks[i];
+        if (!t->handle) continue;
+        stream_printf(&rs,
+                      "%s{\"name\":\"%s\",\"prio\":%u,\"state\":\"%s\",\"cpu_pct\":%u.%u,"
+                      "\"stack_free_min\":%lu}",
+                      first ? "" : ",", t->name, t->prio, task_state_str(t->state),
+                      t->cpu_x10 / 10, t->cpu_x10 % 10, (unsigned long)t->stack_free_min);
+        first = false;
     }
 
-    wifi_mode_t old_mode;
-    esp_wifi_get_mode(&old_mode);
-    bool changed_mode = false;
-    if (old_mode == WIFI_MODE_AP) {
-        if (esp_wifi_set_mode(WIFI_MODE_APSTA) == ESP_OK) {
-            changed_mode = true;
+    stream_printf(&rs, "],\"heap\":{\"free\":%lu,\"min_free\":%lu,\"largest_block\":%lu,\"tags\":[",
+                  (unsigned long)esp_get_free_heap_size(),
+                  (unsigned long)esp_get_minimum_free_heap_size(),
+                  (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        mem_tag_stats_t m;
+        taskENTER_CRITICAL(&g_mem_mux);
+        m = g_mem[i];
+        taskEXIT_CRITICAL(&g_mem_mux);
+        stream_printf(&rs,
+                      "%s{\"tag\":\"%s\",\"static\":%lu,\"live\":%lu,\"peak\":%lu,"
+                      "\"allocs\":%lu,\"failures\":%lu}",
+                      i ? "," : "", k_mem_tag_names[i],
+                      (unsigned long)m.static_bytes, (unsigned long)m.live,
+                      (unsigned long)m.peak, (unsigned long)m.allocs,
+                      (unsigned long)m.failures);
+    }
+    stream_printf(&rs, "]}");
+
+    if (query_u32(req, "history", 1)) {
+        stream_printf(&rs, ",\"history\":[");
+        uint32_t now = now_ms();
+        int count = 0, start = 0;
+        if (xSemaphoreTake(g_task_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
+            count = g_task_hist.count;
+            start = (g_task_hist.head + TASK_HISTORY - count) % TASK_HISTORY;
+            xSemaphoreGive(g_task_mutex);
+        }
+
+        for (int i = 0; i < count; i++) {
+            task_sample_t smp;
+            if (xSemaphoreTake(g_task_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) break;
+            smp = g_task_hist.s[(start + i) % TASK_HISTORY];
+            xSemaphoreGive(g_task_mutex);
+            stream_printf(&rs,
+                          "%s{\"age_s\":%lu,\"busy_pct\":%u.%u,\"top\":\"%s\",\"top_pct\":%u.%u,"
+                          "\"free_heap\":%lu,\"largest_block\":%lu,\"scans\":%u,\"scan_off_pct\":%u}",
+                          i ? "," : "",
+                          (unsigned long)((now - smp.t_ms) / 1000),
+                          smp.busy_x10 / 10, smp.busy_x10 % 10,
+                          smp.top, smp.top_x10 / 10, smp.top_x10 % 10,
+                          (unsigned long)smp.free_heap,
+                          (unsigned long)smp.largest_block,
+                          smp.scans, smp.scan_off_pct);
         }
+        stream_printf(&rs, "]");
     }
 
-    uint8_t frame[128];
-    size_t frame_len = 26;
-    int sent = 0;
-    int failed = 0;
-    esp_err_t last_err = ESP_OK;
+    stream_printf(&rs, "}");
+    return stream_end(&rs);
+}
 
-    for (int i = 0; i < count && i < 100; i++) {
-        if (strcmp(packet_type, "deauth") == 0) {
-            craft_deauth_frame(frame, broadcast, target_mac);
-            frame_len = 26;
-        } else if (strcmp(packet_type, "disassoc") == 0) {
-            craft_disassoc_frame(frame, broadcast, target_mac);
-            frame_len = 26;
-        } else if (strcmp(packet_type, "probe") == 0) {
-            craft_probe_request(frame, &frame_len, "test_probe");
-        }
+// ======================= SOFTAP CHANNEL ==========================
+// Picks the SoftAP channel with the least co- and adjacent-channel load. A
+// 20 MHz 2.4 GHz channel overlaps its neighbours up to four channels away,
+// so each AP contributes to nearby channels with a falling weight. Switching
+// needs a clear win (hysteresis) and, unless forced, no connected stations,
+// because changing channel drops every client. While the STA uplink is
+// associated the driver pins the SoftAP to the uplink's channel.
 
-        esp_err_t err = esp_wifi_80211_tx(WIFI_IF_STA, frame, frame_len, false);
-        if (err == ESP_ERR_WIFI_IF) {
-            err = esp_wifi_80211_tx(WIFI_IF_AP, frame, frame_len, false);
-        }
+#define AP_DEFAULT_CHANNEL     1
+#define CHAN_AUTO_WINDOW_MS    (5 * 60 * 1000)
+#define CHAN_AUTO_INTERVAL_S   900
+#define CHAN_HYSTERESIS_PCT    25
+#define CHAN_MIN_GAIN          100    // score of one co-channel AP
 
-        if (err == ESP_OK) {
-            sent++;
-            g_packet_stats.packets_sent++;
-        } else {
-            failed++;
-            last_err = err;
-            ESP_LOGW(TAG, "Packet TX failed (%s) on try %d", esp_err_to_name(err), i);
-        }
+static const uint8_t k_chan_overlap_weight[5] = { 100, 70, 40, 15, 5 };
 
-        if (i < count - 1) {
-            vTaskDelay(pdMS_TO_TICKS(interval));
+// Only the non-overlapping channels are candidates: parking between them
+// interferes with both neighbours and 12/13 are not legal everywhere.
+static const uint8_t k_chan_candidates[] = { 1, 6, 11 };
+
+typedef struct {
+    uint8_t     current;
+    uint8_t     best;
+    bool        boot_done;
+    bool        locked_by_sta;
+    bool        periodic;
+    uint16_t    interval_s;
+    uint8_t     stations;
+    int16_t     airtime_x10;    // measured load on the current channel, -1 unknown
+    uint32_t    last_eval_ms;
+    uint32_t    last_switch_ms;
+    uint32_t    evaluations;
+    uint32_t    switches;
+    const char *reason;
+    uint16_t    aps[SCAN_CHANNEL_MAX + 1];
+    uint32_t    score[SCAN_CHANNEL_MAX + 1];
+} chan_auto_t;
+
+// Evaluations run from wardrive_task (periodic), the httpd task (?apply=1)
+// and wifi_init (boot survey). g_chan_auto_mutex is held for a whole
+// evaluation, channel switch included, and by readers while they copy the
+// struct.
+static chan_auto_t g_chan_auto = {
+    .current    = AP_DEFAULT_CHANNEL,
+    .best       = AP_DEFAULT_CHANNEL,
+    .interval_s = CHAN_AUTO_INTERVAL_S,
+    .airtime_x10 = -1,
+    .reason     = "not evaluated",
+};
+static SemaphoreHandle_t g_chan_auto_mutex = NULL;
+
+static void chan_auto_score(chan_auto_t *ca) {
+    ap_aggregates_t agg;
+    agg_snapshot(&agg, CHAN_AUTO_WINDOW_MS);
+
+    // One radio with four SSIDs loads the channel once, not four times.
+    for (int ch = 1; ch <= SCAN_CHANNEL_MAX; ch++) {
+        ca->aps[ch] = (uint16_t)agg.radio_channel_counts[ch];
+    }
+    for (int ch = 1; ch <= SCAN_CHANNEL_MAX; ch++) {
+        uint32_t score = 0;
+        for (int other = 1; other <= SCAN_CHANNEL_MAX; other++) {
+            int d = abs(other - ch);
+            if (d < (int)sizeof(k_chan_overlap_weight)) {
+                score += ca->aps[other] * k_chan_overlap_weight[d];
+            }
         }
+        ca->score[ch] = score;
     }
+}
 
-    if (changed_mode) {
-        esp_wifi_set_mode(old_mode);
+// Re-scores every channel and switches the SoftAP if it is worth it.
+// Returns true when the channel was changed. Caller holds g_chan_auto_mutex.
+static bool chan_auto_evaluate_locked(bool force) {
+    chan_auto_t *ca = &g_chan_auto;
+    chan_auto_score(ca);
+    ca->evaluations++;
+    ca->last_eval_ms = now_ms();
+
+    uint8_t primary = 0;
+    wifi_second_chan_t second;
+    if (esp_wifi_get_channel(&primary, &second) == ESP_OK && primary) {
+        ca->current = primary;
     }
-
-    if (target_channel > 0 && target_channel != original_primary) {
-        esp_wifi_set_channel(original_primary, original_second);
-        ESP_LOGI(TAG, "Restored channel to %u", (unsigned)original_primary);
+    ca->locked_by_sta = g_sta_connected;
+
+    // Airtime is only measurable on the channel we are parked on, so it is
+    // reported alongside the scores rather than mixed into them.
+    airtime_channel_t air[AIRTIME_CHANNELS];
+    airtime_snapshot(air);
+    ca->airtime_x10 = ca->current <= SCAN_CHANNEL_MAX
+                    ? (int16_t)airtime_util_x10(&air[ca->current], ca->last_eval_ms) : -1;
+
+    wifi_sta_list_t stas;
+    ca->stations = esp_wifi_ap_get_sta_list(&stas) == ESP_OK ? (uint8_t)stas.num : 0;
+
+    // score[] only covers the scanned channels; e.g. 14 is never scored.
+    if (ca->current > SCAN_CHANNEL_MAX) {
+        ca->best = ca->current;
+        ca->reason = "current channel is not scanned";
+        return false;
     }
 
-    char response[192];
-    if (failed == 0) {
-        snprintf(response, sizeof(response), "{\"status\":\"ok\",\"sent\":%d}", sent);
-    } else {
-        snprintf(response, sizeof(response),
-                 "{\"status\":\"partial\",\"sent\":%d,\"failed\":%d,\"error\":\"%s\"}",
-                 sent, failed, esp_err_to_name(last_err));
+    uint8_t best = ca->current;
+    for (size_t i = 0; i < sizeof(k_chan_candidates); i++) {
+        uint8_t ch = k_chan_candidates[i];
+        if (ca->score[ch] < ca->score[best]) best = ch;
     }
+    ca->best = best;
 
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, response, HTTPD_RESP_USE_STRLEN);
-}
+    uint32_t cur = ca->score[ca->current];
+    if (ca->locked_by_sta) {
+        ca->reason = "locked to STA uplink channel";
+        return false;
+    }
+    if (best == ca->current) {
+        ca->reason = "current channel is least congested";
+        return false;
+    }
+    if (!force && (cur - ca->score[best] < CHAN_MIN_GAIN ||
+                   ca->score[best] * 100 > cur * (100 - CHAN_HYSTERESIS_PCT))) {
+        ca->reason = "gain within hysteresis";
+        return false;
+    }
+    if (!force && ca->stations > 0) {
+        ca->reason = "deferred: stations connected";
+        return false;
+    }
 
-static esp_err_t handler_api_handshake_start(httpd_req_t *req) {
-    g_packet_stats.handshake_listening = true;
-    g_packet_stats.handshake_captured = 0;
-    update_promiscuous_filter();
+    wifi_config_t ap_cfg;
+    if (esp_wifi_get_config(WIFI_IF_AP, &ap_cfg) != ESP_OK) {
+        ca->reason = "failed to read AP config";
+        return false;
+    }
+    ap_cfg.ap.channel = best;
+    esp_err_t err = esp_wifi_set_config(WIFI_IF_AP, &ap_cfg);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "SoftAP channel change failed: %s", esp_err_to_name(err));
+        ca->reason = "channel change failed";
+        return false;
+    }
 
-    ESP_LOGI(TAG, "Handshake capture enabled");
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, "{\"status\":\"listening\"}", HTTPD_RESP_USE_STRLEN);
+    ESP_LOGI(TAG, "SoftAP channel %u -> %u (score %lu -> %lu)",
+             ca->current, best, (unsigned long)cur, (unsigned long)ca->score[best]);
+    ca->current = best;
+    ca->switches++;
+    ca->last_switch_ms = ca->last_eval_ms;
+    ca->reason = "switched";
+    return true;
 }
 
-static esp_err_t handler_api_handshake_stop(httpd_req_t *req) {
-    g_packet_stats.handshake_listening = false;
-    update_promiscuous_filter();
+static bool chan_auto_evaluate(bool force) {
+    if (xSemaphoreTake(g_chan_auto_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) return false;
+    bool switched = chan_auto_evaluate_locked(force);
+    xSemaphoreGive(g_chan_auto_mutex);
+    return switched;
+}
 
-    ESP_LOGI(TAG, "Handshake capture disabled");
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, "{\"status\":\"stopped\"}", HTTPD_RESP_USE_STRLEN);
+// Called by the wardrive loop after each sweep.
+static void chan_auto_tick(void) {
+    if (xSemaphoreTake(g_chan_auto_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) return;
+    if (g_chan_auto.periodic &&
+        now_ms() - g_chan_auto.last_eval_ms >= g_chan_auto.interval_s * 1000UL) {
+        chan_auto_evaluate_locked(false);
+    }
+    xSemaphoreGive(g_chan_auto_mutex);
 }
 
-static esp_err_t handler_api_handshake_status(httpd_req_t *req) {
-    char buf[128];
-    snprintf(buf, sizeof(buf),
-             "{\"listening\":%s,\"captured\":%lu}",
-             g_packet_stats.handshake_listening ? "true" : "false",
-             (unsigned long)g_packet_stats.handshake_captured);
+static esp_err_t send_chan_auto(httpd_req_t *req) {
+    chan_auto_t copy;
+    if (xSemaphoreTake(g_chan_auto_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "channel evaluation busy");
+        return ESP_FAIL;
+    }
+    copy = g_chan_auto;
+    xSemaphoreGive(g_chan_auto_mutex);
+
+    const chan_auto_t *ca = &copy;
+    char buf[1024];
+    uint32_t now = now_ms();
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"current\":%u,\"best\":%u,\"locked_by_sta\":%s,\"periodic\":%s,"
+                     "\"interval_s\":%u,\"stations\":%u,\"current_airtime_x10\":%d,"
+                     "\"evaluations\":%lu,\"switches\":%lu,"
+                     "\"last_eval_age_ms\":%lu,\"last_switch_age_ms\":%lu,\"reason\":\"%s\","
+                     "\"hysteresis_pct\":%d,\"window_s\":%d,\"channels\":[",
+                     ca->current, ca->best,
+                     ca->locked_by_sta ? "true" : "false",
+                     ca->periodic ? "true" : "false",
+                     ca->interval_s, ca->stations, ca->airtime_x10,
+                     (unsigned long)ca->evaluations,
+                     (unsigned long)ca->switches,
+                     (unsigned long)(ca->evaluations ? now - ca->last_eval_ms : 0),
+                     (unsigned long)(ca->switches ? now - ca->last_switch_ms : 0),
+                     ca->reason,
+                     CHAN_HYSTERESIS_PCT, CHAN_AUTO_WINDOW_MS / 1000);
+    for (int ch = 1; ch <= SCAN_CHANNEL_MAX && n > 0 && n < (int)sizeof(buf); ch++) {
+        n += snprintf(buf + n, sizeof(buf) - n, "%s{\"channel\":%d,\"radios\":%u,\"score\":%lu}",
+                      ch > 1 ? "," : "", ch, ca->aps[ch], (unsigned long)ca->score[ch]);
+    }
+    if (n > 0 && n < (int)sizeof(buf) - 2) {
+        n += snprintf(buf + n, sizeof(buf) - n, "]}");
+    }
 
     httpd_resp_set_type(req, "application/json");
     return httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
 }
 
-// ======================= WARDRIVE ON/OFF ==========================
-
-static esp_err_t handler_api_wardrive_on(httpd_req_t *req) {
-    g_wardrive_on = true;
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, "{\"status\":\"on\"}", HTTPD_RESP_USE_STRLEN);
+static esp_err_t handler_api_channel_auto_get(httpd_req_t *req) {
+    return send_chan_auto(req);
 }
 
-static esp_err_t handler_api_wardrive_off(httpd_req_t *req) {
-    g_wardrive_on = false;
-    httpd_resp_set_type(req, "application/json");
-    return httpd_resp_send(req, "{\"status\":\"off\"}", HTTPD_RESP_USE_STRLEN);
+// POST /api/channel/auto?periodic=0|1&interval_s=N&apply=1&force=1
+// apply re-evaluates now; force also ignores hysteresis and connected
+// stations.
+static esp_err_t handler_api_channel_auto_set(httpd_req_t *req) {
+    uint32_t periodic = query_u32(req, "periodic", g_chan_auto.periodic);
+    uint32_t interval = query_u32(req, "interval_s", g_chan_auto.interval_s);
+    if (interval < 60 || interval > 86400) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "interval_s must be 60-86400");
+        return ESP_FAIL;
+    }
+    bool force = query_u32(req, "force", 0) != 0;
+    bool apply = force || query_u32(req, "apply", 0);
+
+    if (xSemaphoreTake(g_chan_auto_mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "channel evaluation busy");
+        return ESP_FAIL;
+    }
+    g_chan_auto.periodic   = periodic != 0;
+    g_chan_auto.interval_s = (uint16_t)(interval > 65535 ? 65535 : interval);
+    if (apply) chan_auto_evaluate_locked(force);
+    xSemaphoreGive(g_chan_auto_mutex);
+    return send_chan_auto(req);
 }
 
 // ========================= HTTP SERVER =========================
@@ -1495,6 +6126,223 @@ static esp_err_t handler_success_txt(httpd_req_t *req) {
     return ESP_OK;
 }
 
+// ========================= HTTP DISPATCH =========================
+// Every /api route goes through api_dispatch(): it applies the per-client
+// rate limit and hands long-running routes (exports, blocking scans, full
+// table walks) to a small worker pool so status polls are never queued
+// behind them on the single httpd task.
+
+#define HTTPD_MAX_OPEN_SOCKETS 10
+#define HTTPD_KEEPALIVE_IDLE_S 5
+#define API_WORKERS            2
+#define API_WORKER_STACK       6144
+#define API_WORKER_QUEUE_LEN   4
+#define RATE_LIMIT_CLIENTS     8
+#define RATE_LIMIT_BURST       20     // requests
+#define RATE_LIMIT_PER_SEC     8      // refill rate
+
+#define ROUTE_ASYNC      0x01   // run on a worker, not the httpd task
+#define ROUTE_NO_LIMIT   0x02   // exempt from rate limiting
+
+typedef struct {
+    const char     *uri;
+    httpd_method_t  method;
+    esp_err_t     (*handler)(httpd_req_t *req);
+    uint8_t         flags;
+} api_route_t;
+
+typedef struct {
+    uint32_t addr;          // hashed peer address, 0 = free slot
+    uint32_t milli_tokens;
+    uint32_t last_ms;
+} rate_bucket_t;
+
+static rate_bucket_t     g_rate_buckets[RATE_LIMIT_CLIENTS];
+static QueueHandle_t     g_api_queue    = NULL;
+static SemaphoreHandle_t g_api_workers  = NULL;   // counts idle workers
+static TaskHandle_t      g_api_worker_tasks[API_WORKERS];
+
+// True on an API worker, where blocking does not hold up other connections.
+static bool on_api_worker(void) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < API_WORKERS; i++) {
+        if (g_api_worker_tasks[i] == self) return true;
+    }
+    return false;
+}
+
+// Hashes the peer address of the request socket (IPv4 or IPv6/v4-mapped).
+static uint32_t req_peer_addr(httpd_req_t *req) {
+    struct sockaddr_storage sa;
+    socklen_t sl = sizeof(sa);
+    int fd = httpd_req_to_sockfd(req);
+    if (fd < 0 || getpeername(fd, (struct sockaddr *)&sa, &sl) != 0) return 0;
+
+    const uint8_t *p;
+    size_t n;
+    if (sa.ss_family == AF_INET) {
+        p = (const uint8_t *)&((struct sockaddr_in *)&sa)->sin_addr;
+        n = 4;
+    } else {
+        p = (const uint8_t *)&((struct sockaddr_in6 *)&sa)->sin6_addr;
+        n = 16;
+    }
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) h = (h ^ p[i]) * 16777619u;
+    return h ? h : 1;
+}
+
+// Token bucket per client. Returns false when the client is over budget.
+// Only called from the httpd task, so no locking is needed.
+static bool rate_limit_allow(uint32_t addr) {
+    if (!addr) return true;
+    uint32_t now = now_ms();
+
+    rate_bucket_t *b = NULL, *oldest = &g_rate_buckets[0];
+    for (int i = 0; i < RATE_LIMIT_CLIENTS; i++) {
+        rate_bucket_t *c = &g_rate_buckets[i];
+        if (c->addr == addr) { b = c; break; }
+        if (!c->addr || now - c->last_ms > now - oldest->last_ms) oldest = c;
+        if (!c->addr) break;
+    }
+    if (!b) {
+        b = oldest;
+        b->addr = addr;
+        b->milli_tokens = RATE_LIMIT_BURST * 1000;
+        b->last_ms = now;
+    }
+
+    uint32_t refill = (now - b->last_ms) * RATE_LIMIT_PER_SEC;
+    b->milli_tokens = refill >= RATE_LIMIT_BURST * 1000 - b->milli_tokens
+                    ? RATE_LIMIT_BURST * 1000 : b->milli_tokens + refill;
+    b->last_ms = now;
+
+    if (b->milli_tokens < 1000) return false;
+    b->milli_tokens -= 1000;
+    return true;
+}
+
+static void api_worker_task(void *arg) {
+    httpd_req_t *req;
+    while (1) {
+        if (xQueueReceive(g_api_queue, &req, portMAX_DELAY) != pdTRUE) continue;
+        const api_route_t *route = (const api_route_t *)req->user_ctx;
+        route->handler(req);
+        httpd_req_async_handler_complete(req);
+        xSemaphoreGive(g_api_workers);
+    }
+}
+
+static esp_err_t api_dispatch(httpd_req_t *req) {
+    const api_route_t *route = (const api_route_t *)req->user_ctx;
+    g_httpd_stats.dispatched++;
+
+    // Clients piggyback the round trip of their previous poll as ?rtt_ms=.
+    uint32_t rtt = query_u32(req, "rtt_ms", 0);
+    if (rtt) scan_metrics_note_rtt(rtt);
+
+    if (!(route->flags & ROUTE_NO_LIMIT) && !rate_limit_allow(req_peer_addr(req))) {
+        g_httpd_stats.rate_limited++;
+        httpd_resp_set_status(req, "429 Too Many Requests");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_send(req, "{\"error\":\"rate limited\"}", HTTPD_RESP_USE_STRLEN);
+    }
+
+    if (!(route->flags & ROUTE_ASYNC) || !g_api_queue) {
+        return route->handler(req);
+    }
+
+    // Never block the httpd task waiting for a worker.
+    if (xSemaphoreTake(g_api_workers, 0) != pdTRUE) {
+        g_httpd_stats.async_busy++;
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "2");
+        httpd_resp_set_type(req, "application/json");
+        return httpd_resp_send(req, "{\"error\":\"busy\"}", HTTPD_RESP_USE_STRLEN);
+    }
+
+    httpd_req_t *copy = NULL;
+    if (httpd_req_async_handler_begin(req, &copy) != ESP_OK) {
+        xSemaphoreGive(g_api_workers);
+        return route->handler(req);
+    }
+    if (xQueueSend(g_api_queue, &copy, 0) != pdTRUE) {
+        httpd_req_async_handler_complete(copy);
+        xSemaphoreGive(g_api_workers);
+        return route->handler(req);
+    }
+    g_httpd_stats.async_dispatched++;
+    return ESP_OK;
+}
+
+static void api_workers_init(void) {
+    g_api_queue   = xQueueCreate(API_WORKER_QUEUE_LEN, sizeof(httpd_req_t *));
+    g_api_workers = xSemaphoreCreateCounting(API_WORKERS, API_WORKERS);
+    if (!g_api_queue || !g_api_workers) {
+        ESP_LOGE(TAG, "Failed to create API worker pool, long routes run inline");
+        g_api_queue = NULL;
+        return;
+    }
+    for (int i = 0; i < API_WORKERS; i++) {
+        char name[12];
+        snprintf(name, sizeof(name), "api_wrk%d", i);
+        xTaskCreate(api_worker_task, name, API_WORKER_STACK, NULL, 5, &g_api_worker_tasks[i]);
+    }
+}
+
+static const api_route_t k_api_routes[] = {
+    { "/api/aps",                      HTTP_GET,  handler_api_aps,                0 },
+    { "/api/state",                    HTTP_GET,  handler_api_state,              0 },
+    { "/api/dashboard",                HTTP_GET,  handler_api_dashboard,          0 },
+    { "/api/channels",                 HTTP_GET,  handler_api_channels,           0 },
+    { "/api/aps/clear",                HTTP_POST, handler_api_clear,              0 },
+    { "/api/wardrive/on",              HTTP_POST, handler_api_wardrive_on,        0 },
+    { "/api/wardrive/off",             HTTP_POST, handler_api_wardrive_off,       0 },
+    { "/api/scan/mode",                HTTP_GET,  handler_api_scan_mode_get,      0 },
+    { "/api/scan/mode",                HTTP_POST, handler_api_scan_mode_set,      0 },
+    { "/api/channel/auto",             HTTP_GET,  handler_api_channel_auto_get,   0 },
+    { "/api/channel/auto",             HTTP_POST, handler_api_channel_auto_set,   0 },
+    { "/api/scan/once",                HTTP_POST, handler_api_scan_once,          ROUTE_ASYNC },
+    { "/api/export/csv",               HTTP_GET,  handler_api_export_csv,         ROUTE_ASYNC },
+    { "/api/security/analysis",        HTTP_GET,  handler_api_security_analysis,  0 },
+    { "/api/security/congestion",      HTTP_GET,  handler_api_channel_congestion, 0 },
+    { "/api/airtime",                  HTTP_GET,  handler_api_airtime,            0 },
+    { "/api/frames",                   HTTP_GET,  handler_api_frames,             0 },
+    { "/api/frames/history",           HTTP_GET,  handler_api_frames_history,     0 },
+    { "/api/unique",                   HTTP_GET,  handler_api_unique,             0 },
+    { "/api/unique/sketch",            HTTP_GET,  handler_api_unique_sketch_get,  0 },
+    { "/api/unique/sketch",            HTTP_POST, handler_api_unique_sketch_merge, 0 },
+    { "/api/unique/reset",             HTTP_POST, handler_api_unique_reset,       0 },
+    { "/api/seen",                     HTTP_GET,  handler_api_seen,               0 },
+    { "/api/seen/clear",               HTTP_POST, handler_api_seen_clear,         0 },
+    { "/api/security/rogues",          HTTP_GET,  handler_api_rogue_detection,    ROUTE_ASYNC },
+    { "/api/security/beacon_timing",   HTTP_GET,  handler_api_beacon_timing,      0 },
+    { "/api/security/vulnerabilities", HTTP_GET,  handler_api_vulnerabilities,    ROUTE_ASYNC },
+    { "/api/classifications",          HTTP_GET,  handler_api_classifications,    ROUTE_ASYNC },
+    { "/api/security/deauth",          HTTP_GET,  handler_api_deauth,             0 },
+    { "/api/packets/send",             HTTP_POST, handler_api_packets_send,       0 },
+    { "/api/wifi/scan",                HTTP_GET,  handler_api_wifi_scan,          ROUTE_ASYNC },
+    { "/api/wifi/connect",             HTTP_POST, handler_api_wifi_connect,       0 },
+    { "/api/wifi/status",              HTTP_GET,  handler_api_wifi_status,        0 },
+    { "/api/gps/network",              HTTP_GET,  handler_api_gps_network,        0 },
+    { "/api/gps/fix",                  HTTP_POST, handler_api_gps_fix,            ROUTE_NO_LIMIT },
+    { "/api/grid",                     HTTP_GET,  handler_api_grid,               ROUTE_ASYNC },
+    { "/api/grid/clear",               HTTP_POST, handler_api_grid_clear,         0 },
+    { "/api/snapshot",                 HTTP_GET,  handler_api_snapshot,           0 },
+    { "/api/snapshot/save",            HTTP_POST, handler_api_snapshot_save,      0 },
+    { "/api/tasks",                    HTTP_GET,  handler_api_tasks,              0 },
+    { "/api/profiles",                 HTTP_GET,  handler_api_profiles,           0 },
+    { "/api/profiles",                 HTTP_POST, handler_api_profiles_set,       0 },
+    { "/api/profiles/delete",          HTTP_POST, handler_api_profiles_delete,    0 },
+    { "/api/profile",                  HTTP_POST, handler_api_profile_activate,   0 },
+    { "/api/cadence",                  HTTP_GET,  handler_api_cadence,            0 },
+    { "/api/cadence",                  HTTP_POST, handler_api_cadence_set,        0 },
+    { "/api/handshake/start",          HTTP_POST, handler_api_handshake_start,    ROUTE_NO_LIMIT },
+    { "/api/handshake/stop",           HTTP_POST, handler_api_handshake_stop,     ROUTE_NO_LIMIT },
+    { "/api/handshake/status",         HTTP_GET,  handler_api_handshake_status,   0 },
+};
+
 static void register_uri_checked(httpd_handle_t server, const httpd_uri_t *uri) {
     esp_err_t err = httpd_register_uri_handler(server, uri);
     if (err != ESP_OK) {
@@ -1506,8 +6354,16 @@ static void register_uri_checked(httpd_handle_t server, const httpd_uri_t *uri)
 static void start_webserver(void)
 {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.max_uri_handlers = 40;  // Ensure we have room for all handlers
+    config.max_uri_handlers = 64;  // Ensure we have room for all handlers
     config.stack_size       = 8192;
+    config.max_open_sockets = HTTPD_MAX_OPEN_SOCKETS;
+    config.lru_purge_enable = true;   // recycle the idlest socket instead of refusing
+    config.keep_alive_enable = true;
+    config.keep_alive_idle   = HTTPD_KEEPALIVE_IDLE_S;
+    config.keep_alive_interval = HTTPD_KEEPALIVE_IDLE_S;
+    config.keep_alive_count  = 3;
+
+    api_workers_init();
 
     if (httpd_start(&g_httpd, &config) != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start HTTP server");
@@ -1533,52 +6389,16 @@ static void start_webserver(void)
     httpd_uri_t uri_connecttest = { .uri = "/connecttest.txt", .method = HTTP_GET, .handler = handler_success_txt };
     register_uri_checked(g_httpd, &uri_connecttest);
 
-    // === YOUR NORMAL HANDLERS (keep all existing ones) ===
-    httpd_uri_t uri_api_aps        = { .uri = "/api/aps",              .method = HTTP_GET,  .handler = handler_api_aps };
-    httpd_uri_t uri_api_state      = { .uri = "/api/state",            .method = HTTP_GET,  .handler = handler_api_state };
-    httpd_uri_t uri_api_channels   = { .uri = "/api/channels",         .method = HTTP_GET,  .handler = handler_api_channels };
-    httpd_uri_t uri_api_clear      = { .uri = "/api/aps/clear",        .method = HTTP_POST, .handler = handler_api_clear };
-    httpd_uri_t uri_wardrive_on    = { .uri = "/api/wardrive/on",      .method = HTTP_POST, .handler = handler_api_wardrive_on };
-    httpd_uri_t uri_wardrive_off   = { .uri = "/api/wardrive/off",     .method = HTTP_POST, .handler = handler_api_wardrive_off };
-    httpd_uri_t uri_scan_once      = { .uri = "/api/scan/once",        .method = HTTP_POST, .handler = handler_api_scan_once };
-    httpd_uri_t uri_export_csv     = { .uri = "/api/export/csv",       .method = HTTP_GET,  .handler = handler_api_export_csv };
-    httpd_uri_t uri_security_analysis = { .uri = "/api/security/analysis", .method = HTTP_GET, .handler = handler_api_security_analysis };
-    httpd_uri_t uri_channel_congestion = { .uri = "/api/security/congestion", .method = HTTP_GET, .handler = handler_api_channel_congestion };
-    httpd_uri_t uri_rogue_detection = { .uri = "/api/security/rogues", .method = HTTP_GET,  .handler = handler_api_rogue_detection };
-    httpd_uri_t uri_vulnerabilities = { .uri = "/api/security/vulnerabilities", .method = HTTP_GET, .handler = handler_api_vulnerabilities };
-    httpd_uri_t uri_classifications = { .uri = "/api/classifications", .method = HTTP_GET,  .handler = handler_api_classifications };
-    httpd_uri_t uri_deauth         = { .uri = "/api/security/deauth",  .method = HTTP_GET,  .handler = handler_api_deauth };
-    httpd_uri_t uri_packets_send   = { .uri = "/api/packets/send",     .method = HTTP_POST, .handler = handler_api_packets_send };
-    httpd_uri_t uri_wifi_scan      = { .uri = "/api/wifi/scan",        .method = HTTP_GET,  .handler = handler_api_wifi_scan };
-    httpd_uri_t uri_wifi_connect   = { .uri = "/api/wifi/connect",     .method = HTTP_POST, .handler = handler_api_wifi_connect };
-    httpd_uri_t uri_wifi_status    = { .uri = "/api/wifi/status",      .method = HTTP_GET,  .handler = handler_api_wifi_status };
-    httpd_uri_t uri_gps_network    = { .uri = "/api/gps/network",      .method = HTTP_GET,  .handler = handler_api_gps_network };
-    httpd_uri_t uri_handshake_start= { .uri = "/api/handshake/start",  .method = HTTP_POST, .handler = handler_api_handshake_start };
-    httpd_uri_t uri_handshake_stop = { .uri = "/api/handshake/stop",   .method = HTTP_POST, .handler = handler_api_handshake_stop };
-    httpd_uri_t uri_handshake_stat = { .uri = "/api/handshake/status", .method = HTTP_GET,  .handler = handler_api_handshake_status };
-
-    register_uri_checked(g_httpd, &uri_api_aps);
-    register_uri_checked(g_httpd, &uri_api_state);
-    register_uri_checked(g_httpd, &uri_api_channels);
-    register_uri_checked(g_httpd, &uri_api_clear);
-    register_uri_checked(g_httpd, &uri_wardrive_on);
-    register_uri_checked(g_httpd, &uri_wardrive_off);
-    register_uri_checked(g_httpd, &uri_scan_once);
-    register_uri_checked(g_httpd, &uri_export_csv);
-    register_uri_checked(g_httpd, &uri_security_analysis);
-    register_uri_checked(g_httpd, &uri_channel_congestion);
-    register_uri_checked(g_httpd, &uri_rogue_detection);
-    register_uri_checked(g_httpd, &uri_vulnerabilities);
-    register_uri_checked(g_httpd, &uri_classifications);
-    register_uri_checked(g_httpd, &uri_deauth);
-    register_uri_checked(g_httpd, &uri_packets_send);
-    register_uri_checked(g_httpd, &uri_wifi_scan);
-    register_uri_checked(g_httpd, &uri_wifi_connect);
-    register_uri_checked(g_httpd, &uri_wifi_status);
-    register_uri_checked(g_httpd, &uri_gps_network);
-    register_uri_checked(g_httpd, &uri_handshake_start);
-    register_uri_checked(g_httpd, &uri_handshake_stop);
-    register_uri_checked(g_httpd, &uri_handshake_stat);
+    // === API HANDLERS (via api_dispatch) ===
+    for (size_t i = 0; i < sizeof(k_api_routes) / sizeof(k_api_routes[0]); i++) {
+        httpd_uri_t uri = {
+            .uri      = k_api_routes[i].uri,
+            .method   = k_api_routes[i].method,
+            .handler  = api_dispatch,
+            .user_ctx = (void *)&k_api_routes[i],
+        };
+        register_uri_checked(g_httpd, &uri);
+    }
 
     // === STATIC ASSETS ===
     httpd_uri_t uri_index = {
@@ -1640,6 +6460,27 @@ IRAM_ATTR static void wifi_sniffer_cb(void *buf, wifi_promiscuous_pkt_type_t typ
     uint8_t fc = hdr[0];
     uint8_t frame_type = (fc & 0x0C) >> 2; // 0=mgmt, 1=ctrl, 2=data
 
+    airtime_account(&pkt->rx_ctrl, type);
+    frame_stats_count(fc, pkt->rx_ctrl.channel);
+
+    // Beacon (0x80) or probe response (0x50)
+    if (type == WIFI_PKT_MGMT && (fc == 0x80 || fc == 0x50)) {
+        ie_cache_update(hdr, (int)pkt->rx_ctrl.sig_len - 4);
+        unique_note(&hdr[16], pkt->rx_ctrl.channel, -1);
+        if (fc == 0x50) hidden_observe(hdr, (int)pkt->rx_ctrl.sig_len - 4);
+        if (fc == 0x80) {
+            beacon_track_update(hdr, (int)pkt->rx_ctrl.sig_len - 4, &pkt->rx_ctrl);
+        }
+    }
+
+    if (type == WIFI_PKT_DATA) {
+        client_note(hdr, (int)pkt->rx_ctrl.sig_len - 4, pkt->rx_ctrl.channel);
+    }
+
+    if (type == WIFI_PKT_MGMT && (fc == 0x00 || fc == 0x20)) {
+        hidden_observe(hdr, (int)pkt->rx_ctrl.sig_len - 4);
+    }
+
     if (type == WIFI_PKT_MGMT && ((fc & 0xF0) == 0xC0 || (fc & 0xF0) == 0xA0)) {
         const uint8_t *da = &hdr[4];
         const uint8_t *sa = &hdr[10];
@@ -1670,7 +6511,15 @@ IRAM_ATTR static void wifi_sniffer_cb(void *buf, wifi_promiscuous_pkt_type_t typ
     }
 }
 
-// DNS Server - Returns our IP for all queries (makes captive portal work)
+/* ========================= CAPTIVE DNS ========================= */
+
+// Query parsing and answer building live in components/captive_dns.
+
+// Queries a burst may leave queued in the socket (CONFIG_LWIP_UDP_RECVMBOX_SIZE).
+// Once woken, the task drains the queue without blocking before it sleeps again.
+#define DNS_BURST_MAX   16
+
+// DNS Server - Returns our IP for all A queries (makes captive portal work)
 static void dns_server_task(void *pvParameters) {
     int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (sock < 0) {
@@ -1682,7 +6531,7 @@ static void dns_server_task(void *pvParameters) {
     struct sockaddr_in server_addr;
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    server_addr.sin_port = htons(53);  // DNS port
+    server_addr.sin_port = htons(DNS_PORT);
 
     if (bind(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         ESP_LOGE(TAG, "DNS socket bind failed");
@@ -1691,11 +6540,11 @@ static void dns_server_task(void *pvParameters) {
         return;
     }
 
-    ESP_LOGI(TAG, "DNS server started on port 53");
+    ESP_LOGI(TAG, "DNS server started on port %d", DNS_PORT);
 
-    uint8_t rx_buffer[512];
+    // Query and response share one buffer; the answer is appended in place.
+    uint8_t pkt[DNS_MAX_PACKET];
     struct sockaddr_in client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
 
     // Get our AP IP address
     esp_netif_ip_info_t ip_info;
@@ -1703,78 +6552,36 @@ static void dns_server_task(void *pvParameters) {
     uint32_t our_ip = ip_info.ip.addr;
 
     while (1) {
-        int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer) - 1, 0,
-                          (struct sockaddr *)&client_addr, &client_addr_len);
-        
-        if (len < 12) continue;  // Invalid DNS packet
-
-        // Build DNS response
-        // Copy query ID and flags
-        uint8_t response[512];
-        memcpy(response, rx_buffer, 2);  // Transaction ID
-        
-        // Set flags: Response, Authoritative, No error
-        response[2] = 0x81;
-        response[3] = 0x80;
-        
-        // Copy question count
-        memcpy(response + 4, rx_buffer + 4, 2);
-        
-        // Answer count = 1
-        response[6] = 0x00;
-        response[7] = 0x01;
-        
-        // Authority and Additional = 0
-        response[8] = 0x00;
-        response[9] = 0x00;
-        response[10] = 0x00;
-        response[11] = 0x00;
-        
-        // Copy the question section
-        int question_len = 12;
-        while (question_len < len && rx_buffer[question_len] != 0) {
-            question_len++;
-        }
-        question_len += 5;  // null + type + class
-        
-        if (question_len > len) continue;
-        
-        memcpy(response + 12, rx_buffer + 12, question_len - 12);
-        
-        // Add answer section
-        int answer_offset = question_len;
-        
-        // Pointer to question name
-        response[answer_offset++] = 0xC0;
-        response[answer_offset++] = 0x0C;
-        
-        // Type A (host address)
-        response[answer_offset++] = 0x00;
-        response[answer_offset++] = 0x01;
-        
-        // Class IN
-        response[answer_offset++] = 0x00;
-        response[answer_offset++] = 0x01;
-        
-        // TTL (60 seconds)
-        response[answer_offset++] = 0x00;
-        response[answer_offset++] = 0x00;
-        response[answer_offset++] = 0x00;
-        response[answer_offset++] = 0x3C;
-        
-        // Data length (4 bytes for IPv4)
-        response[answer_offset++] = 0x00;
-        response[answer_offset++] = 0x04;
-        
-        // Our IP address
-        memcpy(response + answer_offset, &our_ip, 4);
-        answer_offset += 4;
-        
-        // Send response
-        sendto(sock, response, answer_offset, 0,
-               (struct sockaddr *)&client_addr, client_addr_len);
+        // Block for the first query of a burst, then drain whatever else is
+        // queued so a storm of probes from several phones is answered
+        // back-to-back instead of overflowing the receive mailbox.
+        int flags = 0;
+        uint32_t burst = 0;
+        while (burst < DNS_BURST_MAX) {
+            socklen_t client_addr_len = sizeof(client_addr);
+            int len = recvfrom(sock, pkt, sizeof(pkt), flags,
+                               (struct sockaddr *)&client_addr, &client_addr_len);
+            if (len < 0) break;
+            flags = MSG_DONTWAIT;
+            burst++;
+
+            g_dns_stats.queries++;
+            int resp_len = dns_build_response(pkt, len, sizeof(pkt), our_ip);
+            if (resp_len < 0) {
+                g_dns_stats.dropped++;
+                continue;
+            }
+            if (dns_response_answers(pkt)) g_dns_stats.answered_a++;
+            else                           g_dns_stats.answered_empty++;
+
+            if (sendto(sock, pkt, resp_len, 0,
+                       (struct sockaddr *)&client_addr, client_addr_len) < 0) {
+                g_dns_stats.send_failed++;
+            }
+        }
+        if (burst > g_dns_stats.max_burst) g_dns_stats.max_burst = burst;
     }
-    
+
     close(sock);
     vTaskDelete(NULL);
 }
@@ -1784,24 +6591,43 @@ static void dns_server_task(void *pvParameters) {
 
 static void wardrive_task(void *arg) {
     while (1) {
+        uint32_t t0 = now_ms();
+        uint8_t prof = g_profile_idx;
+        bool swept = g_wardrive_on;
+        uint32_t inserts = g_ap_inserts;
+        uint32_t merges = g_ap_merges;
 
         if (g_wardrive_on) {
 
-            esp_err_t err = safe_scan_start();
+            esp_err_t err = scan_run_sweep(true);
 
             g_stats.total_scans++;
 
             if (err == ESP_OK) {
                 g_stats.successful_scans++;
-                update_ap_list_from_scan();
             } else {
                 g_stats.failed_scans++;
                 ESP_LOGW(TAG, "Background scan failed: %s", esp_err_to_name(err));
             }
+            chan_auto_tick();
+        }
+        seen_maybe_save();
+        snap_save();
+
+        scan_profile_t profile = profile_active();
+        uint32_t sweep_ms = now_ms() - t0;
+        uint32_t pause = cadence_update(&profile, swept, g_ap_inserts - inserts, sweep_ms);
+
+        // Random delay to avoid locking channel; a profile switch wakes us early
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(pause + (esp_random() % 750)));
+
+        if (swept && prof == g_profile_idx) {
+            profile_stats_t *ps = &g_profile_stats[prof];
+            ps->sweeps++;
+            ps->active_ms += now_ms() - t0;
+            ps->new_aps += g_ap_inserts - inserts;
+            ps->records += g_ap_merges - merges;
         }
-
-        // Random delay to avoid locking channel
-        vTaskDelay(pdMS_TO_TICKS(SCAN_INTERVAL_MS + (esp_random() % 750)));
     }
 }
 
@@ -1812,8 +6638,11 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                int32_t event_id, void* event_data)
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-        ESP_LOGI(TAG, "STA started, connecting to %s...", STA_SSID);
+        // Before the boot channel survey wifi_init() connects on its own.
+        if (g_chan_auto.boot_done) {
+            esp_wifi_connect();
+            ESP_LOGI(TAG, "STA started, connecting to %s...", STA_SSID);
+        }
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
         ESP_LOGW(TAG, "Disconnected from AP, retrying...");
         g_sta_connected = false;
@@ -1823,8 +6652,14 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "Got IP from upstream AP: " IPSTR, IP2STR(&event->ip_info.ip));
+        char ip[16];
+        snprintf(ip, sizeof(ip), IPSTR, IP2STR(&event->ip_info.ip));
+        bool changed = !g_sta_connected || strcmp(ip, g_sta_ip) != 0 || event->ip_changed;
         g_sta_connected = true;
-        snprintf(g_sta_ip, sizeof(g_sta_ip), IPSTR, IP2STR(&event->ip_info.ip));
+        snprintf(g_sta_ip, sizeof(g_sta_ip), "%s", ip);
+        if (changed) {
+            geo_invalidate();
+        }
     }
 }
 
@@ -1853,7 +6688,7 @@ static void wifi_init(void) {
     strncpy((char *)ap_cfg.ap.password, AP_PASS, sizeof(ap_cfg.ap.password) - 1);
     ap_cfg.ap.ssid_len = strlen((const char *)ap_cfg.ap.ssid);
 
-    ap_cfg.ap.channel        = 1;
+    ap_cfg.ap.channel        = AP_DEFAULT_CHANNEL;
     ap_cfg.ap.max_connection = 4;
     ap_cfg.ap.authmode       = WIFI_AUTH_WPA_WPA2_PSK;
     ap_cfg.ap.ssid_hidden    = 0;
@@ -1893,7 +6728,19 @@ static void wifi_init(void) {
     ESP_ERROR_CHECK(esp_wifi_set_promiscuous_rx_cb(wifi_sniffer_cb));
     ESP_ERROR_CHECK(esp_wifi_set_promiscuous(true));
 
-    ESP_LOGI(TAG, "WiFi AP started: SSID=%s", ap_cfg.ap.ssid);
+    // Survey once before the uplink connects (which would pin the channel)
+    // and move the SoftAP off a crowded default.
+    xSemaphoreTake(g_scan_mutex, portMAX_DELAY);
+    if (safe_scan_start(0, 0) == ESP_OK) {
+        update_ap_list_from_scan();
+    }
+    xSemaphoreGive(g_scan_mutex);
+    chan_auto_evaluate(false);
+    g_chan_auto.boot_done = true;
+    esp_wifi_connect();
+
+    ESP_LOGI(TAG, "WiFi AP started: SSID=%s, channel %u (%s)",
+             ap_cfg.ap.ssid, g_chan_auto.current, g_chan_auto.reason);
     if (ENABLE_STA_MODE && strlen(STA_SSID) > 0) {
         ESP_LOGI(TAG, "Connecting to upstream AP: %s", STA_SSID);
     }
@@ -1908,16 +6755,37 @@ void app_main(void) {
     }
 
     g_ap_mutex = xSemaphoreCreateMutex();
+    g_cadence_mutex = xSemaphoreCreateMutex();
+    g_scan_mutex = xSemaphoreCreateMutex();
+    g_task_mutex = xSemaphoreCreateMutex();
+    g_unique_scratch_mutex = xSemaphoreCreateMutex();
+    g_chan_auto_mutex = xSemaphoreCreateMutex();
     if (!g_ap_mutex) {
         ESP_LOGE(TAG, "Failed to create AP mutex");
         return;
     }
+    resp_pool_init();
+    mem_register_statics();
+    seen_load();
+    profiles_load();
+    snap_restore();
+
+    g_geo_mutex = xSemaphoreCreateMutex();
+    if (!g_geo_mutex) {
+        ESP_LOGE(TAG, "Failed to create geo mutex");
+        return;
+    }
 
     wifi_init();
     start_webserver();
 
+    xTaskCreate(geo_task, "geo_lookup", 4096, NULL, 4, &g_geo_task);
+    xTaskCreate(stats_task, "stats", 3072, NULL, 3, NULL);
+
     // START DNS SERVER FOR CAPTIVE PORTAL
-    xTaskCreate(dns_server_task, "dns_server", 4096, NULL, 5, NULL);
+    // Above httpd and the API workers: answers are tiny and phones give up on
+    // the portal probe if DNS stalls behind a large JSON response.
+    xTaskCreate(dns_server_task, "dns_server", 4096, NULL, 6, NULL);
 
     xTaskCreatePinnedToCore(
         wardrive_task,
@@ -1925,7 +6793,7 @@ void app_main(void) {
         4096,
         NULL,
         5,
-        NULL,
+        &g_wardrive_task,
         tskNO_AFFINITY
     );
 